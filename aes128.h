@@ -0,0 +1,189 @@
+#ifndef AES128_H
+#define AES128_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * AES-128 decryption in CBC mode, as used by wireless M-Bus security mode 5.
+ * This is the portable implementation working byte by byte; dsp_kernels.h
+ * holds the ones using the AES instructions of x86 and ARMv8.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define AES128_BLOCK_SIZE 16u
+#define AES128_ROUNDS 10u
+
+struct aes128_key
+{
+    uint8_t enc[AES128_ROUNDS + 1][AES128_BLOCK_SIZE]; // round keys of the cipher
+    uint8_t dec[AES128_ROUNDS + 1][AES128_BLOCK_SIZE]; // round keys of the equivalent inverse cipher, in the order of use
+};
+
+static uint8_t AES128_SBOX[256];
+static uint8_t AES128_INV_SBOX[256];
+
+static inline uint8_t aes128_xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x & 0x80u) ? 0x1Bu : 0u));
+}
+
+static inline uint8_t aes128_rotl8(uint8_t x, unsigned n)
+{
+    return (uint8_t)((x << n) | (x >> (8u - n)));
+}
+
+/* Builds the S-boxes: walks all elements of GF(2^8) as powers of 3 and
+   their inverses as powers of 3^-1, then applies the affine transformation. */
+static void aes128_init_tables(void)
+{
+    uint8_t p = 1, q = 1;
+
+    do
+    {
+        p = (uint8_t)(p ^ aes128_xtime(p));
+        q ^= (uint8_t)(q << 1);
+        q ^= (uint8_t)(q << 2);
+        q ^= (uint8_t)(q << 4);
+        if (q & 0x80u) q ^= 0x09u;
+
+        AES128_SBOX[p] = (uint8_t)(q ^ aes128_rotl8(q, 1) ^ aes128_rotl8(q, 2) ^ aes128_rotl8(q, 3) ^ aes128_rotl8(q, 4) ^ 0x63u);
+    } while (p != 1);
+
+    AES128_SBOX[0] = 0x63u;
+
+    for (unsigned k = 0; k < 256; k++) AES128_INV_SBOX[AES128_SBOX[k]] = (uint8_t)k;
+}
+
+static inline uint8_t aes128_mul(uint8_t x, uint8_t y)
+{
+    uint8_t product = 0;
+
+    for (; y; y >>= 1, x = aes128_xtime(x))
+    {
+        if (y & 1u) product ^= x;
+    }
+    return product;
+}
+
+static void aes128_inv_mix_columns(uint8_t *s)
+{
+    for (unsigned c = 0; c < 4; c++, s += 4)
+    {
+        const uint8_t a0 = s[0], a1 = s[1], a2 = s[2], a3 = s[3];
+
+        s[0] = aes128_mul(a0, 14) ^ aes128_mul(a1, 11) ^ aes128_mul(a2, 13) ^ aes128_mul(a3, 9);
+        s[1] = aes128_mul(a0, 9) ^ aes128_mul(a1, 14) ^ aes128_mul(a2, 11) ^ aes128_mul(a3, 13);
+        s[2] = aes128_mul(a0, 13) ^ aes128_mul(a1, 9) ^ aes128_mul(a2, 14) ^ aes128_mul(a3, 11);
+        s[3] = aes128_mul(a0, 11) ^ aes128_mul(a1, 13) ^ aes128_mul(a2, 9) ^ aes128_mul(a3, 14);
+    }
+}
+
+/* InvShiftRows and InvSubBytes; the state is stored column by column. */
+static void aes128_inv_shift_sub(uint8_t *s)
+{
+    uint8_t t[AES128_BLOCK_SIZE];
+
+    for (unsigned k = 0; k < AES128_BLOCK_SIZE; k++)
+    {
+        const unsigned row = k & 3u, column = k >> 2;
+        t[k] = AES128_INV_SBOX[s[row + 4*((column + 4 - row) & 3u)]];
+    }
+    memcpy(s, t, sizeof(t));
+}
+
+static inline void aes128_xor(uint8_t *s, const uint8_t *x)
+{
+    for (unsigned k = 0; k < AES128_BLOCK_SIZE; k++) s[k] ^= x[k];
+}
+
+/** @brief Key schedule; aes128_init_tables() must have been called. */
+static void aes128_key_expand(struct aes128_key *key, const uint8_t secret[AES128_BLOCK_SIZE])
+{
+    uint8_t *w = &key->enc[0][0];
+    uint8_t rcon = 1;
+
+    memcpy(w, secret, AES128_BLOCK_SIZE);
+
+    for (unsigned k = 4; k < 4*(AES128_ROUNDS + 1); k++)
+    {
+        uint8_t t[4] = { w[4*k - 4], w[4*k - 3], w[4*k - 2], w[4*k - 1] };
+
+        if (k % 4 == 0)
+        {
+            const uint8_t t0 = t[0];
+            t[0] = AES128_SBOX[t[1]] ^ rcon;
+            t[1] = AES128_SBOX[t[2]];
+            t[2] = AES128_SBOX[t[3]];
+            t[3] = AES128_SBOX[t0];
+            rcon = aes128_xtime(rcon);
+        }
+
+        for (unsigned l = 0; l < 4; l++) w[4*k + l] = w[4*k - 16 + l] ^ t[l];
+    }
+
+    memcpy(key->dec[0], key->enc[AES128_ROUNDS], AES128_BLOCK_SIZE);
+    for (unsigned r = 1; r < AES128_ROUNDS; r++)
+    {
+        memcpy(key->dec[r], key->enc[AES128_ROUNDS - r], AES128_BLOCK_SIZE);
+        aes128_inv_mix_columns(key->dec[r]);
+    }
+    memcpy(key->dec[AES128_ROUNDS], key->enc[0], AES128_BLOCK_SIZE);
+}
+
+/** @brief Decrypt blocks in CBC mode; src and dst may be the same buffer. */
+static void aes128_cbc_decrypt_generic(const struct aes128_key *key, const uint8_t *iv, const uint8_t *src, uint8_t *dst, size_t blocks)
+{
+    uint8_t chain[AES128_BLOCK_SIZE], cipher[AES128_BLOCK_SIZE];
+
+    memcpy(chain, iv, sizeof(chain));
+
+    for (size_t b = 0; b < blocks; b++, src += AES128_BLOCK_SIZE, dst += AES128_BLOCK_SIZE)
+    {
+        uint8_t s[AES128_BLOCK_SIZE];
+
+        memcpy(cipher, src, sizeof(cipher));
+        memcpy(s, src, sizeof(s));
+
+        aes128_xor(s, key->enc[AES128_ROUNDS]);
+        for (unsigned r = AES128_ROUNDS - 1; r > 0; r--)
+        {
+            aes128_inv_shift_sub(s);
+            aes128_xor(s, key->enc[r]);
+            aes128_inv_mix_columns(s);
+        }
+        aes128_inv_shift_sub(s);
+        aes128_xor(s, key->enc[0]);
+
+        aes128_xor(s, chain);
+        memcpy(dst, s, sizeof(s));
+        memcpy(chain, cipher, sizeof(chain));
+    }
+}
+
+#endif /* AES128_H */
@@ -0,0 +1,2 @@
+#define VERSION "0f7a45a"
+#define COMMIT "0f7a45ac1a3d4d03bb36d4b6d4f8bf609fae12d5"
@@ -0,0 +1,184 @@
+#ifndef BURST_QUEUE_H
+#define BURST_QUEUE_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Pool of burst buffers and the queue handing them over from the receiver
+ * thread to a decoder thread. A burst holds the filtered and decimated i/q
+ * samples of one channel while the channel was busy; i[-1] and q[-1] hold
+ * the sample before the burst which the discriminators need.
+ *
+ * The pool is allocated once. If the decoder thread cannot keep up, the
+ * receiver thread either waits for a free buffer, so no burst gets lost when
+ * decoding a file, or gets none and drops the burst, so a live stream is not
+ * held up.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+
+struct burst
+{
+    unsigned channel;
+    unsigned continued; // starts with the end of the previous burst of the channel
+    size_t preamble;    // samples up to the last preamble found, 0 if none: the burst isn't decoded
+    int64_t time_ns;    // wall clock time when the burst started
+    uint64_t sample;    // telegram_clock when the burst started
+    size_t n;           // samples in i and q
+    float *i, *q;
+    struct burst *next;
+};
+
+struct burst_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t released;
+    size_t capacity;           // max. samples per burst
+    struct burst *pool;
+    float *samples;
+    struct burst *free_bursts;
+    struct burst *head, *tail; // bursts waiting for the decoder thread
+    int wait;                  // burst_queue_get waits for a free buffer instead of failing
+    int closed;
+};
+
+static void burst_queue_init(struct burst_queue *bq, size_t count, size_t capacity, int wait)
+{
+    bq->pool = calloc(count, sizeof(bq->pool[0]));
+    bq->samples = malloc(count * 2 * (1 + capacity) * sizeof(bq->samples[0]));
+    if (!bq->pool || !bq->samples)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot allocate %zu burst buffers!\n", count);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&bq->lock, NULL);
+    pthread_cond_init(&bq->ready, NULL);
+    pthread_cond_init(&bq->released, NULL);
+    bq->capacity = capacity;
+    bq->free_bursts = NULL;
+    bq->head = bq->tail = NULL;
+    bq->wait = wait;
+    bq->closed = 0;
+
+    for (size_t k = 0; k < count; k++)
+    {
+        struct burst *b = &bq->pool[k];
+
+        b->i = &bq->samples[(2*k + 0) * (1 + capacity) + 1];
+        b->q = &bq->samples[(2*k + 1) * (1 + capacity) + 1];
+        b->next = bq->free_bursts;
+        bq->free_bursts = b;
+    }
+}
+
+static void burst_queue_free(struct burst_queue *bq)
+{
+    pthread_cond_destroy(&bq->released);
+    pthread_cond_destroy(&bq->ready);
+    pthread_mutex_destroy(&bq->lock);
+    free(bq->samples);
+    free(bq->pool);
+}
+
+/** @brief Take an empty burst buffer from the pool.
+ *
+ *  Waits until one is released if the pool is empty and wait was set.
+ *
+ *  @return NULL if the pool is empty and wait wasn't set.
+ */
+static struct burst *burst_queue_get(struct burst_queue *bq)
+{
+    pthread_mutex_lock(&bq->lock);
+    while (!bq->free_bursts && bq->wait) pthread_cond_wait(&bq->released, &bq->lock);
+    struct burst *b = bq->free_bursts;
+    if (b) bq->free_bursts = b->next;
+    pthread_mutex_unlock(&bq->lock);
+
+    if (!b) return NULL;
+
+    b->n = 0;
+    b->next = NULL;
+    return b;
+}
+
+/* Give a burst buffer back to the pool. */
+static void burst_queue_release(struct burst_queue *bq, struct burst *b)
+{
+    pthread_mutex_lock(&bq->lock);
+    b->next = bq->free_bursts;
+    bq->free_bursts = b;
+    pthread_cond_signal(&bq->released);
+    pthread_mutex_unlock(&bq->lock);
+}
+
+/* Hand a filled burst over to the decoder thread. */
+static void burst_queue_push(struct burst_queue *bq, struct burst *b)
+{
+    pthread_mutex_lock(&bq->lock);
+    b->next = NULL;
+    if (bq->tail) bq->tail->next = b;
+    else bq->head = b;
+    bq->tail = b;
+    pthread_cond_signal(&bq->ready);
+    pthread_mutex_unlock(&bq->lock);
+}
+
+/** @brief Wait for the next burst to decode.
+ *
+ *  @return NULL if the queue has been closed and no burst is left.
+ */
+static struct burst *burst_queue_pop(struct burst_queue *bq)
+{
+    pthread_mutex_lock(&bq->lock);
+    while (!bq->head && !bq->closed) pthread_cond_wait(&bq->ready, &bq->lock);
+
+    struct burst *b = bq->head;
+    if (b)
+    {
+        bq->head = b->next;
+        if (!bq->head) bq->tail = NULL;
+    }
+    pthread_mutex_unlock(&bq->lock);
+
+    return b;
+}
+
+/* No more bursts will come; the decoder thread finishes the queued ones. */
+static void burst_queue_close(struct burst_queue *bq)
+{
+    pthread_mutex_lock(&bq->lock);
+    bq->closed = 1;
+    pthread_cond_broadcast(&bq->ready);
+    pthread_mutex_unlock(&bq->lock);
+}
+
+#endif /* BURST_QUEUE_H */
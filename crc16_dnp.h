@@ -0,0 +1,124 @@
+#ifndef CRC16_DNP_H
+#define CRC16_DNP_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * CRC16 as used by wireless M-Bus (polynomial 0x3D65, known as CRC-16/DNP).
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+static const uint16_t CRC16_DNP_TABLE[] =
+{
+    0x0000, 0x3d65, 0x7aca, 0x47af, 0xf594, 0xc8f1, 0x8f5e, 0xb23b,
+    0xd64d, 0xeb28, 0xac87, 0x91e2, 0x23d9, 0x1ebc, 0x5913, 0x6476,
+    0x91ff, 0xac9a, 0xeb35, 0xd650, 0x646b, 0x590e, 0x1ea1, 0x23c4,
+    0x47b2, 0x7ad7, 0x3d78, 0x001d, 0xb226, 0x8f43, 0xc8ec, 0xf589,
+    0x1e9b, 0x23fe, 0x6451, 0x5934, 0xeb0f, 0xd66a, 0x91c5, 0xaca0,
+    0xc8d6, 0xf5b3, 0xb21c, 0x8f79, 0x3d42, 0x0027, 0x4788, 0x7aed,
+    0x8f64, 0xb201, 0xf5ae, 0xc8cb, 0x7af0, 0x4795, 0x003a, 0x3d5f,
+    0x5929, 0x644c, 0x23e3, 0x1e86, 0xacbd, 0x91d8, 0xd677, 0xeb12,
+    0x3d36, 0x0053, 0x47fc, 0x7a99, 0xc8a2, 0xf5c7, 0xb268, 0x8f0d,
+    0xeb7b, 0xd61e, 0x91b1, 0xacd4, 0x1eef, 0x238a, 0x6425, 0x5940,
+    0xacc9, 0x91ac, 0xd603, 0xeb66, 0x595d, 0x6438, 0x2397, 0x1ef2,
+    0x7a84, 0x47e1, 0x004e, 0x3d2b, 0x8f10, 0xb275, 0xf5da, 0xc8bf,
+    0x23ad, 0x1ec8, 0x5967, 0x6402, 0xd639, 0xeb5c, 0xacf3, 0x9196,
+    0xf5e0, 0xc885, 0x8f2a, 0xb24f, 0x0074, 0x3d11, 0x7abe, 0x47db,
+    0xb252, 0x8f37, 0xc898, 0xf5fd, 0x47c6, 0x7aa3, 0x3d0c, 0x0069,
+    0x641f, 0x597a, 0x1ed5, 0x23b0, 0x918b, 0xacee, 0xeb41, 0xd624,
+    0x7a6c, 0x4709, 0x00a6, 0x3dc3, 0x8ff8, 0xb29d, 0xf532, 0xc857,
+    0xac21, 0x9144, 0xd6eb, 0xeb8e, 0x59b5, 0x64d0, 0x237f, 0x1e1a,
+    0xeb93, 0xd6f6, 0x9159, 0xac3c, 0x1e07, 0x2362, 0x64cd, 0x59a8,
+    0x3dde, 0x00bb, 0x4714, 0x7a71, 0xc84a, 0xf52f, 0xb280, 0x8fe5,
+    0x64f7, 0x5992, 0x1e3d, 0x2358, 0x9163, 0xac06, 0xeba9, 0xd6cc,
+    0xb2ba, 0x8fdf, 0xc870, 0xf515, 0x472e, 0x7a4b, 0x3de4, 0x0081,
+    0xf508, 0xc86d, 0x8fc2, 0xb2a7, 0x009c, 0x3df9, 0x7a56, 0x4733,
+    0x2345, 0x1e20, 0x598f, 0x64ea, 0xd6d1, 0xebb4, 0xac1b, 0x917e,
+    0x475a, 0x7a3f, 0x3d90, 0x00f5, 0xb2ce, 0x8fab, 0xc804, 0xf561,
+    0x9117, 0xac72, 0xebdd, 0xd6b8, 0x6483, 0x59e6, 0x1e49, 0x232c,
+    0xd6a5, 0xebc0, 0xac6f, 0x910a, 0x2331, 0x1e54, 0x59fb, 0x649e,
+    0x00e8, 0x3d8d, 0x7a22, 0x4747, 0xf57c, 0xc819, 0x8fb6, 0xb2d3,
+    0x59c1, 0x64a4, 0x230b, 0x1e6e, 0xac55, 0x9130, 0xd69f, 0xebfa,
+    0x8f8c, 0xb2e9, 0xf546, 0xc823, 0x7a18, 0x477d, 0x00d2, 0x3db7,
+    0xc83e, 0xf55b, 0xb2f4, 0x8f91, 0x3daa, 0x00cf, 0x4760, 0x7a05,
+    0x1e73, 0x2316, 0x64b9, 0x59dc, 0xebe7, 0xd682, 0x912d, 0xac48,
+};
+
+/** @brief Byte-wise table driven CRC without the final inversion. */
+static uint16_t crc16_dnp_generic(uint16_t crc, const uint8_t *data, size_t datalen)
+{
+    while (datalen--) crc = CRC16_DNP_TABLE[*data++ ^ (crc >> 8)] ^ (crc << 8);
+    return crc;
+}
+
+/* CRC16_DNP_SLICE8[k][b] is the CRC of byte b followed by k zero bytes. */
+static uint16_t CRC16_DNP_SLICE8[8][256];
+
+static void crc16_dnp_init_tables(void)
+{
+    for (unsigned b = 0; b < 256; b++)
+    {
+        CRC16_DNP_SLICE8[0][b] = CRC16_DNP_TABLE[b];
+    }
+
+    for (unsigned k = 1; k < 8; k++)
+    {
+        for (unsigned b = 0; b < 256; b++)
+        {
+            const uint16_t crc = CRC16_DNP_SLICE8[k-1][b];
+            CRC16_DNP_SLICE8[k][b] = CRC16_DNP_TABLE[crc >> 8] ^ (uint16_t)(crc << 8);
+        }
+    }
+}
+
+/** @brief Slicing-by-8: eight independent table lookups per 8 bytes instead of a chain of eight. */
+static uint16_t crc16_dnp_slice8(uint16_t crc, const uint8_t *data, size_t datalen)
+{
+    while (datalen >= 8)
+    {
+        crc = CRC16_DNP_SLICE8[7][data[0] ^ (crc >> 8)] ^
+              CRC16_DNP_SLICE8[6][data[1] ^ (crc & 0xFFu)] ^
+              CRC16_DNP_SLICE8[5][data[2]] ^
+              CRC16_DNP_SLICE8[4][data[3]] ^
+              CRC16_DNP_SLICE8[3][data[4]] ^
+              CRC16_DNP_SLICE8[2][data[5]] ^
+              CRC16_DNP_SLICE8[1][data[6]] ^
+              CRC16_DNP_SLICE8[0][data[7]];
+        data += 8;
+        datalen -= 8;
+    }
+
+    return crc16_dnp_generic(crc, data, datalen);
+}
+
+/* Folding constants of the carry-less multiply implementations: x^192 mod P and x^128 mod P.
+   A 128-bit block A in front of the block B is congruent to A_hi * x^192 + A_lo * x^128 + B. */
+#define CRC16_DNP_FOLD_X192 0x7660u
+#define CRC16_DNP_FOLD_X128 0x1EF8u
+
+#endif /* CRC16_DNP_H */
@@ -0,0 +1,1818 @@
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Registry of the hot DSP kernels. Every kernel has a generic C implementation
+ * and optionally SIMD implementations. The best implementation supported by
+ * the CPU we are running on is picked once at startup, so one binary built
+ * for a generic target runs at full speed on every machine.
+ *
+ * All kernels work on blocks of samples. Kernels which need a history
+ * (FIR, moving average, discriminator) expect it to be stored in front of
+ * the block they are given.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "crc16_dnp.h"
+#include "aes128.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DSP_X86 1
+#include <immintrin.h>
+#else
+#define DSP_X86 0
+#endif
+
+/* The NEON kernels have not been built and checked against the generic ones
+   on an ARM machine yet. They are left out unless built with -DDSP_NEON=1, so
+   ARM runs the generic kernels meanwhile. */
+#ifndef DSP_NEON
+#define DSP_NEON 0
+#endif
+
+#if DSP_NEON
+#if !defined(__aarch64__) && !defined(__ARM_NEON)
+#error "DSP_NEON needs a target with NEON, e.g. -mfpu=neon on 32-bit ARM"
+#endif
+#include <arm_neon.h>
+#endif
+
+/* The same holds for the kernels using the ARMv8 crypto extension (PMULL CRC
+   folding, AES); they need -DDSP_ARMV8_CRYPTO=1 in addition. */
+#ifndef DSP_ARMV8_CRYPTO
+#define DSP_ARMV8_CRYPTO 0
+#endif
+
+#if DSP_NEON && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/* Number of complex samples processed at once. */
+#define DSP_BLOCK_SIZE 2048u
+
+/* CPU features, kernel implementations are tagged with. */
+#define DSP_CPU_SSE2    (1u<<0)
+#define DSP_CPU_AVX2    (1u<<1) // AVX2 and FMA
+#define DSP_CPU_AVX512  (1u<<2) // AVX-512F
+#define DSP_CPU_NEON    (1u<<3)
+#define DSP_CPU_AVX512_VPOPCNTDQ (1u<<4)
+#define DSP_CPU_PCLMUL  (1u<<5) // PCLMULQDQ and SSSE3
+#define DSP_CPU_PMULL   (1u<<6) // 64-bit polynomial multiply of ARMv8
+#define DSP_CPU_AES     (1u<<7) // AES-NI or the AES instructions of ARMv8
+
+/* Features an ISA level of dsp_kernels_force() makes use of, but does not require. */
+#define DSP_CPU_OPTIONAL (DSP_CPU_AVX512_VPOPCNTDQ | DSP_CPU_PCLMUL | DSP_CPU_PMULL | DSP_CPU_AES)
+
+enum dsp_kernel_id
+{
+    DSP_KERNEL_U8_TO_IQ,
+    DSP_KERNEL_MIXER,
+    DSP_KERNEL_MOVING_AVERAGE,
+    DSP_KERNEL_FIR,
+    DSP_KERNEL_IIR,
+    DSP_KERNEL_DISCRIMINATOR,
+    DSP_KERNEL_DISCRIMINATOR_FAST,
+    DSP_KERNEL_CRC16,
+    DSP_KERNEL_SYNC_SEARCH,
+    DSP_KERNEL_SLICER,
+    DSP_KERNEL_ENERGY,
+    DSP_KERNEL_CORRELATE,
+    DSP_KERNEL_AES128_CBC,
+    DSP_KERNEL_COUNT
+};
+
+typedef void (*dsp_kernel_fn)(void);
+
+typedef void (*dsp_u8_to_iq_fn)(const uint8_t *src, float *i, float *q, size_t n);
+typedef void (*dsp_mixer_fn)(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n);
+typedef void (*dsp_moving_average_fn)(const float *x, size_t length, size_t decimation, float *y, size_t n);
+typedef void (*dsp_fir_fn)(const float *x, const float *b, size_t length, float *y, size_t n);
+typedef void (*dsp_iir_fn)(const float *x, float *y, size_t n, const float *b, const float *a, float gain, float *hist, size_t sections);
+typedef void (*dsp_discriminator_fn)(const float *i, const float *q, float *delta_phi, size_t n);
+typedef uint16_t (*dsp_crc16_fn)(uint16_t crc, const uint8_t *data, size_t datalen);
+typedef uint64_t (*dsp_sync_search_fn)(uint64_t history, uint64_t bits, unsigned n, uint32_t access_code, unsigned length, unsigned errors);
+typedef void (*dsp_slicer_fn)(const float *x, uint64_t *bits, size_t n);
+typedef float (*dsp_energy_fn)(const float *i, const float *q, size_t n);
+typedef void (*dsp_correlate_fn)(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n);
+typedef void (*dsp_aes128_cbc_fn)(const struct aes128_key *key, const uint8_t *iv, const uint8_t *src, uint8_t *dst, size_t blocks);
+
+struct dsp_kernel_impl
+{
+    const char *isa;
+    unsigned features; // DSP_CPU_* bits needed to run this implementation
+    dsp_kernel_fn fn;
+};
+
+struct dsp_kernel
+{
+    const char *name;
+    const struct dsp_kernel_impl *impls; // ordered from the slowest to the fastest one
+    size_t count;
+    const struct dsp_kernel_impl *active;
+};
+
+#define DSP_KERNEL_IMPL(isa, features, fn) { isa, features, (dsp_kernel_fn)fn }
+
+
+/* ------------------------------------------------------------------------- */
+/* Generic implementations.                                                  */
+/* ------------------------------------------------------------------------- */
+
+static void u8_to_iq_generic(const uint8_t *src, float *i, float *q, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        i[k] = (float)src[2*k]     - 127.5f;
+        q[k] = (float)src[2*k + 1] - 127.5f;
+    }
+}
+
+/* Shifts (i, q) by +ft in place and writes the shift by -ft into (i_minus, q_minus).
+   (i+Jq)*(x+Jz) =ix-qz + J(qx+iz) positive rotation
+   (i+Jq)*(x-Jz) =ix+qz + J(qx-iz) negative rotation */
+static void mixer_generic(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        const float ix = i[k] * cosine[k];
+        const float qx = q[k] * cosine[k];
+        const float iz = i[k] * sine[k];
+        const float qz = q[k] * sine[k];
+
+        i[k] = ix - qz;
+        q[k] = qx + iz;
+        i_minus[k] = ix + qz;
+        q_minus[k] = qx - iz;
+    }
+}
+
+/* y[m] = sum((int)x[m*decimation .. m*decimation + length-1]) / length */
+static void moving_average_generic(const float *x, size_t length, size_t decimation, float *y, size_t n)
+{
+    for (size_t m = 0; m < n; m++, x += decimation)
+    {
+        int sum = 0;
+        for (size_t k = 0; k < length; k++) sum += (int)x[k];
+        y[m] = (float)sum / length;
+    }
+}
+
+/* y[m] = sum(b[k] * x[m + length-1 - k]); x[0 .. length-2] is the history. */
+static void fir_generic(const float *x, const float *b, size_t length, float *y, size_t n)
+{
+    for (size_t m = 0; m < n; m++)
+    {
+        const float *hist = &x[m + length - 1];
+        float sample = 0;
+
+        for (size_t k = 0; k < length; k++) sample += b[k] * *hist--;
+
+        y[m] = sample;
+    }
+}
+
+static void iir_generic(const float *x, float *y, size_t n, const float *b, const float *a, float gain, float *hist, size_t sections)
+{
+    for (size_t m = 0; m < n; m++)
+    {
+        float sample = x[m];
+
+        for (size_t s = 0; s < sections; s++)
+        {
+            const float *as = a + 3*s;
+            const float *bs = b + 3*s;
+            float *h = hist + 3*s;
+
+            h[0] = sample - (as[1]*h[1] + as[2]*h[2]);
+            sample = bs[0]*h[0] + bs[1]*h[1] + bs[2]*h[2];
+            h[2] = h[1];
+            h[1] = h[0];
+        }
+
+        y[m] = sample * gain;
+    }
+}
+
+/* Phase difference between consecutive samples normalized to [-1, 1].
+   i[-1], q[-1] have to hold the last sample of the previous block. */
+static void discriminator_generic(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        const float re = i[k]*i[k-1] + q[k]*q[k-1];
+        const float im = q[k]*i[k-1] - i[k]*q[k-1];
+
+        delta_phi[k] = atan2f(im, re) * (float)M_1_PI;
+    }
+}
+
+/* We are going to use only complex part of the phase difference
+   so avoid unnecesary computation of real part. The math behind:
+   cargf = atan (delta_phi_imag / delta_phi_real) / pi;
+   In the formula only the sign is of interest - we compute delta_phi_imag only. */
+static void discriminator_fast_generic(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        delta_phi[k] = i[k-1]*q[k] - i[k]*q[k-1];
+    }
+}
+
+/* atan(x) for 0 <= x <= 1 after Abramowitz and Stegun 4.4.49, |error| <= 2e-8. */
+#define DSP_ATAN_A2  (-0.3333314528f)
+#define DSP_ATAN_A4  ( 0.1999355085f)
+#define DSP_ATAN_A6  (-0.1420889944f)
+#define DSP_ATAN_A8  ( 0.1065626393f)
+#define DSP_ATAN_A10 (-0.0752896400f)
+#define DSP_ATAN_A12 ( 0.0429096138f)
+#define DSP_ATAN_A14 (-0.0161657367f)
+#define DSP_ATAN_A16 ( 0.0028662257f)
+
+/* The generic sync search counts mismatches with a 2-bit counter and an
+   overflow flag, so no kernel accepts more wrong bits than this. */
+#define DSP_SYNC_SEARCH_MAX_ERRORS 3u
+
+/* Searches a bit stream for an access code at every bit offset at once.
+   bits holds n <= 64 new bits, the newest one in bit 0; history holds the
+   bits received before them the same way. Bit k of the result is set if the
+   length bits ending with bit k of bits differ from the access code in at
+   most errors <= DSP_SYNC_SEARCH_MAX_ERRORS bits.
+
+   Bit-sliced: for every bit j of the access code a 64-bit word flags the
+   offsets mismatching at that bit, and the mismatches are summed up for all
+   offsets in parallel by a 2-bit counter with an overflow flag. */
+static uint64_t sync_search_generic(uint64_t history, uint64_t bits, unsigned n, uint32_t access_code, unsigned length, unsigned errors)
+{
+    uint64_t c0 = 0, c1 = 0, overflow = 0;
+
+    for (unsigned j = 0; j < length; j++)
+    {
+        uint64_t v;
+
+        if (j == 0) v = bits;
+        else if (j < n) v = (bits >> j) | (history << (n - j));
+        else v = history >> (j - n);
+
+        const uint64_t mismatch = ((access_code >> j) & 1u) ? ~v : v;
+        const uint64_t carry = c0 & mismatch;
+
+        c0 ^= mismatch;
+        overflow |= c1 & carry;
+        c1 ^= carry;
+    }
+
+    uint64_t rejected;
+    switch (errors)
+    {
+    case 0: rejected = c0 | c1 | overflow; break;
+    case 1: rejected = c1 | overflow; break;
+    case 2: rejected = (c0 & c1) | overflow; break;
+    default: rejected = overflow; break;
+    }
+
+    return (n < 64) ? ~rejected & ((1ull << n) - 1) : ~rejected;
+}
+
+/* Packs the signs of x into bits: bit k%64 of bits[k/64] is set if x[k] >= 0,
+   so the first sample is in bit 0. Unused bits of the last word are 0. */
+static void slicer_generic(const float *x, uint64_t *bits, size_t n)
+{
+    for (size_t w = 0; w < (n + 63) / 64; w++)
+    {
+        const size_t m = (n - 64*w < 64) ? n - 64*w : 64;
+        uint64_t word = 0;
+
+        for (size_t k = 0; k < m; k++)
+        {
+            word |= (uint64_t)(x[64*w + k] >= 0) << k;
+        }
+        bits[w] = word;
+    }
+}
+
+/* Sum of i[k]^2 + q[k]^2. */
+static float energy_generic(const float *i, const float *q, size_t n)
+{
+    float energy = 0.f;
+
+    for (size_t k = 0; k < n; k++)
+    {
+        energy += i[k]*i[k] + q[k]*q[k];
+    }
+
+    return energy;
+}
+
+/* Sparse correlation y[k] = sum of taps[j] * x[k - delays[j]]. The samples
+   x[-max(delays)]...x[-1] have to be valid. */
+static void correlate_generic(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n)
+{
+    for (size_t k = 0; k < n; k++)
+    {
+        float sum = 0.f;
+
+        for (size_t j = 0; j < count; j++)
+        {
+            sum += taps[j] * x[(ptrdiff_t)k - (ptrdiff_t)delays[j]];
+        }
+        y[k] = sum;
+    }
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* x86 implementations.                                                      */
+/* ------------------------------------------------------------------------- */
+
+#if DSP_X86
+
+__attribute__((target("sse2")))
+static void u8_to_iq_sse2(const uint8_t *src, float *i, float *q, size_t n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 offset = _mm_set1_ps(127.5f);
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&src[2*k]);
+        const __m128i vi = _mm_and_si128(v, mask);
+        const __m128i vq = _mm_srli_epi16(v, 8);
+
+        _mm_storeu_ps(&i[k],     _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(vi, zero)), offset));
+        _mm_storeu_ps(&i[k + 4], _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(vi, zero)), offset));
+        _mm_storeu_ps(&q[k],     _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(vq, zero)), offset));
+        _mm_storeu_ps(&q[k + 4], _mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(vq, zero)), offset));
+    }
+
+    u8_to_iq_generic(&src[2*k], &i[k], &q[k], n - k);
+}
+
+__attribute__((target("sse2")))
+static void mixer_sse2(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const __m128 vi = _mm_loadu_ps(&i[k]);
+        const __m128 vq = _mm_loadu_ps(&q[k]);
+        const __m128 x = _mm_loadu_ps(&cosine[k]);
+        const __m128 z = _mm_loadu_ps(&sine[k]);
+        const __m128 ix = _mm_mul_ps(vi, x);
+        const __m128 qx = _mm_mul_ps(vq, x);
+        const __m128 iz = _mm_mul_ps(vi, z);
+        const __m128 qz = _mm_mul_ps(vq, z);
+
+        _mm_storeu_ps(&i[k], _mm_sub_ps(ix, qz));
+        _mm_storeu_ps(&q[k], _mm_add_ps(qx, iz));
+        _mm_storeu_ps(&i_minus[k], _mm_add_ps(ix, qz));
+        _mm_storeu_ps(&q_minus[k], _mm_sub_ps(qx, iz));
+    }
+
+    mixer_generic(&i[k], &q[k], &i_minus[k], &q_minus[k], &cosine[k], &sine[k], n - k);
+}
+
+/* Moving sums over power of two lengths are built by repeated doubling of
+   the window: s2[k] = x[k] + x[k+1], s4[k] = s2[k] + s2[k+2], ...
+   Integer arithmetic makes the result exactly the same as of the generic version.
+   Sums reaching past the end of the input are never used, their inputs are zeroed. */
+#define DSP_MOVING_AVERAGE_CHUNK 256u
+
+__attribute__((target("sse2")))
+static void moving_average_sse2(const float *x, size_t length, size_t decimation, float *y, size_t n)
+{
+    if (length & (length - 1))
+    {
+        moving_average_generic(x, length, decimation, y, n);
+        return;
+    }
+
+    __attribute__((__aligned__(16))) int32_t sum[DSP_MOVING_AVERAGE_CHUNK * 16 + 64];
+    const size_t outputs_per_chunk = DSP_MOVING_AVERAGE_CHUNK * 16 / decimation;
+
+    if (outputs_per_chunk == 0)
+    {
+        moving_average_generic(x, length, decimation, y, n);
+        return;
+    }
+
+    while (n)
+    {
+        const size_t outputs = (n < outputs_per_chunk) ? n : outputs_per_chunk;
+        const size_t inputs = (outputs - 1) * decimation + length;
+        size_t k;
+
+        for (k = 0; k + 4 <= inputs; k += 4) _mm_store_si128((__m128i *)&sum[k], _mm_cvttps_epi32(_mm_loadu_ps(&x[k])));
+        for (; k < inputs; k++) sum[k] = (int)x[k];
+        memset(&sum[inputs], 0, 32 * sizeof(sum[0]));
+
+        for (size_t w = 1; w < length; w *= 2)
+        {
+            for (k = 0; k + w < inputs; k += 4)
+            {
+                _mm_storeu_si128((__m128i *)&sum[k], _mm_add_epi32(_mm_loadu_si128((const __m128i *)&sum[k]),
+                                                                   _mm_loadu_si128((const __m128i *)&sum[k + w])));
+            }
+        }
+
+        for (k = 0; k < outputs; k++) y[k] = (float)sum[k*decimation] / length;
+
+        x += outputs * decimation;
+        y += outputs;
+        n -= outputs;
+    }
+}
+
+__attribute__((target("sse2")))
+static void fir_sse2(const float *x, const float *b, size_t length, float *y, size_t n)
+{
+    size_t m;
+
+    for (m = 0; m + 8 <= n; m += 8)
+    {
+        const float *hist = &x[m + length - 1];
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+
+        for (size_t k = 0; k < length; k++, hist--)
+        {
+            const __m128 bk = _mm_set1_ps(b[k]);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(bk, _mm_loadu_ps(hist)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(bk, _mm_loadu_ps(hist + 4)));
+        }
+
+        _mm_storeu_ps(&y[m], acc0);
+        _mm_storeu_ps(&y[m + 4], acc1);
+    }
+
+    fir_generic(&x[m], b, length, &y[m], n - m);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 atan2_sse2(__m128 im, __m128 re)
+{
+    const __m128 sign_mask = _mm_set1_ps(-0.f);
+    const __m128 abs_re = _mm_andnot_ps(sign_mask, re);
+    const __m128 abs_im = _mm_andnot_ps(sign_mask, im);
+    const __m128 swap = _mm_cmpgt_ps(abs_im, abs_re);
+    const __m128 num = _mm_min_ps(abs_re, abs_im);
+    const __m128 den = _mm_max_ps(abs_re, abs_im);
+    const __m128 zero = _mm_cmpeq_ps(den, _mm_setzero_ps());
+    const __m128 t = _mm_andnot_ps(zero, _mm_div_ps(num, _mm_or_ps(den, _mm_and_ps(zero, _mm_set1_ps(1.f)))));
+    const __m128 t2 = _mm_mul_ps(t, t);
+
+    __m128 p = _mm_set1_ps(DSP_ATAN_A16);
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A14));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A12));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A10));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A8));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A6));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A4));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(DSP_ATAN_A2));
+    p = _mm_add_ps(_mm_mul_ps(p, t2), _mm_set1_ps(1.f));
+
+    __m128 angle = _mm_mul_ps(p, t);
+
+    // Octant correction: |im| > |re| -> pi/2 - angle; re < 0 -> pi - angle; im < 0 -> -angle.
+    angle = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps((float)M_PI_2), angle)), _mm_andnot_ps(swap, angle));
+    const __m128 negative_re = _mm_cmplt_ps(re, _mm_setzero_ps());
+    angle = _mm_or_ps(_mm_and_ps(negative_re, _mm_sub_ps(_mm_set1_ps((float)M_PI), angle)), _mm_andnot_ps(negative_re, angle));
+    angle = _mm_or_ps(angle, _mm_and_ps(im, sign_mask));
+
+    return _mm_mul_ps(angle, _mm_set1_ps((float)M_1_PI));
+}
+
+__attribute__((target("sse2")))
+static void discriminator_sse2(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const __m128 vi = _mm_loadu_ps(&i[k]);
+        const __m128 vq = _mm_loadu_ps(&q[k]);
+        const __m128 vi_last = _mm_loadu_ps(&i[k - 1]);
+        const __m128 vq_last = _mm_loadu_ps(&q[k - 1]);
+        const __m128 re = _mm_add_ps(_mm_mul_ps(vi, vi_last), _mm_mul_ps(vq, vq_last));
+        const __m128 im = _mm_sub_ps(_mm_mul_ps(vq, vi_last), _mm_mul_ps(vi, vq_last));
+
+        _mm_storeu_ps(&delta_phi[k], atan2_sse2(im, re));
+    }
+
+    discriminator_generic(&i[k], &q[k], &delta_phi[k], n - k);
+}
+
+__attribute__((target("sse2")))
+static void discriminator_fast_sse2(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const __m128 im = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(&i[k - 1]), _mm_loadu_ps(&q[k])),
+                                     _mm_mul_ps(_mm_loadu_ps(&i[k]), _mm_loadu_ps(&q[k - 1])));
+        _mm_storeu_ps(&delta_phi[k], im);
+    }
+
+    discriminator_fast_generic(&i[k], &q[k], &delta_phi[k], n - k);
+}
+
+__attribute__((target("sse2")))
+static void slicer_sse2(const float *x, uint64_t *bits, size_t n)
+{
+    const __m128 zero = _mm_setzero_ps();
+    size_t w;
+
+    for (w = 0; 64*w + 64 <= n; w++)
+    {
+        uint64_t word = 0;
+
+        for (unsigned k = 0; k < 64; k += 4)
+        {
+            word |= (uint64_t)_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(&x[64*w + k]), zero)) << k;
+        }
+        bits[w] = word;
+    }
+
+    if (64*w < n) slicer_generic(&x[64*w], &bits[w], n - 64*w);
+}
+
+__attribute__((target("sse2")))
+static float energy_sse2(const float *i, const float *q, size_t n)
+{
+    __m128 acc = _mm_setzero_ps();
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const __m128 vi = _mm_loadu_ps(&i[k]);
+        const __m128 vq = _mm_loadu_ps(&q[k]);
+        acc = _mm_add_ps(acc, _mm_add_ps(_mm_mul_ps(vi, vi), _mm_mul_ps(vq, vq)));
+    }
+
+    float sum[4];
+    _mm_storeu_ps(sum, acc);
+
+    return sum[0] + sum[1] + sum[2] + sum[3] + energy_generic(&i[k], &q[k], n - k);
+}
+
+__attribute__((target("sse2")))
+static void correlate_sse2(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        __m128 acc = _mm_setzero_ps();
+
+        for (size_t j = 0; j < count; j++)
+        {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps[j]), _mm_loadu_ps(&x[k] - delays[j])));
+        }
+        _mm_storeu_ps(&y[k], acc);
+    }
+
+    correlate_generic(&x[k], taps, delays, count, &y[k], n - k);
+}
+
+__attribute__((target("avx2")))
+static void slicer_avx2(const float *x, uint64_t *bits, size_t n)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    size_t w;
+
+    for (w = 0; 64*w + 64 <= n; w++)
+    {
+        uint64_t word = 0;
+
+        for (unsigned k = 0; k < 64; k += 8)
+        {
+            word |= (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(&x[64*w + k]), zero, _CMP_GE_OQ)) << k;
+        }
+        bits[w] = word;
+    }
+
+    if (64*w < n) slicer_generic(&x[64*w], &bits[w], n - 64*w);
+}
+
+__attribute__((target("avx2,fma")))
+static float energy_avx2(const float *i, const float *q, size_t n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        const __m256 vi = _mm256_loadu_ps(&i[k]);
+        const __m256 vq = _mm256_loadu_ps(&q[k]);
+        acc = _mm256_fmadd_ps(vq, vq, _mm256_fmadd_ps(vi, vi, acc));
+    }
+
+    const __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    float sum[4];
+    _mm_storeu_ps(sum, sum4);
+
+    return sum[0] + sum[1] + sum[2] + sum[3] + energy_generic(&i[k], &q[k], n - k);
+}
+
+__attribute__((target("avx2,fma")))
+static void correlate_avx2(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        __m256 acc = _mm256_setzero_ps();
+
+        for (size_t j = 0; j < count; j++)
+        {
+            acc = _mm256_fmadd_ps(_mm256_set1_ps(taps[j]), _mm256_loadu_ps(&x[k] - delays[j]), acc);
+        }
+        _mm256_storeu_ps(&y[k], acc);
+    }
+
+    correlate_generic(&x[k], taps, delays, count, &y[k], n - k);
+}
+
+__attribute__((target("avx2")))
+static void u8_to_iq_avx2(const uint8_t *src, float *i, float *q, size_t n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    const __m256 offset = _mm256_set1_ps(127.5f);
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)&src[2*k]);
+
+        _mm256_storeu_ps(&i[k], _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_and_si128(v, mask))), offset));
+        _mm256_storeu_ps(&q[k], _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_srli_epi16(v, 8))), offset));
+    }
+
+    u8_to_iq_generic(&src[2*k], &i[k], &q[k], n - k);
+}
+
+__attribute__((target("avx2")))
+static void mixer_avx2(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        const __m256 vi = _mm256_loadu_ps(&i[k]);
+        const __m256 vq = _mm256_loadu_ps(&q[k]);
+        const __m256 x = _mm256_loadu_ps(&cosine[k]);
+        const __m256 z = _mm256_loadu_ps(&sine[k]);
+        const __m256 ix = _mm256_mul_ps(vi, x);
+        const __m256 qx = _mm256_mul_ps(vq, x);
+        const __m256 iz = _mm256_mul_ps(vi, z);
+        const __m256 qz = _mm256_mul_ps(vq, z);
+
+        _mm256_storeu_ps(&i[k], _mm256_sub_ps(ix, qz));
+        _mm256_storeu_ps(&q[k], _mm256_add_ps(qx, iz));
+        _mm256_storeu_ps(&i_minus[k], _mm256_add_ps(ix, qz));
+        _mm256_storeu_ps(&q_minus[k], _mm256_sub_ps(qx, iz));
+    }
+
+    mixer_generic(&i[k], &q[k], &i_minus[k], &q_minus[k], &cosine[k], &sine[k], n - k);
+}
+
+__attribute__((target("avx2")))
+static void moving_average_avx2(const float *x, size_t length, size_t decimation, float *y, size_t n)
+{
+    if (length & (length - 1))
+    {
+        moving_average_generic(x, length, decimation, y, n);
+        return;
+    }
+
+    __attribute__((__aligned__(32))) int32_t sum[DSP_MOVING_AVERAGE_CHUNK * 16 + 64];
+    const size_t outputs_per_chunk = DSP_MOVING_AVERAGE_CHUNK * 16 / decimation;
+
+    if (outputs_per_chunk == 0)
+    {
+        moving_average_generic(x, length, decimation, y, n);
+        return;
+    }
+
+    while (n)
+    {
+        const size_t outputs = (n < outputs_per_chunk) ? n : outputs_per_chunk;
+        const size_t inputs = (outputs - 1) * decimation + length;
+        size_t k;
+
+        for (k = 0; k + 8 <= inputs; k += 8) _mm256_store_si256((__m256i *)&sum[k], _mm256_cvttps_epi32(_mm256_loadu_ps(&x[k])));
+        for (; k < inputs; k++) sum[k] = (int)x[k];
+        memset(&sum[inputs], 0, 32 * sizeof(sum[0]));
+
+        for (size_t w = 1; w < length; w *= 2)
+        {
+            for (k = 0; k + w < inputs; k += 8)
+            {
+                _mm256_storeu_si256((__m256i *)&sum[k], _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)&sum[k]),
+                                                                         _mm256_loadu_si256((const __m256i *)&sum[k + w])));
+            }
+        }
+
+        for (k = 0; k < outputs; k++) y[k] = (float)sum[k*decimation] / length;
+
+        x += outputs * decimation;
+        y += outputs;
+        n -= outputs;
+    }
+}
+
+__attribute__((target("avx2")))
+static void fir_avx2(const float *x, const float *b, size_t length, float *y, size_t n)
+{
+    size_t m;
+
+    for (m = 0; m + 16 <= n; m += 16)
+    {
+        const float *hist = &x[m + length - 1];
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+
+        for (size_t k = 0; k < length; k++, hist--)
+        {
+            const __m256 bk = _mm256_broadcast_ss(&b[k]);
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(bk, _mm256_loadu_ps(hist)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(bk, _mm256_loadu_ps(hist + 8)));
+        }
+
+        _mm256_storeu_ps(&y[m], acc0);
+        _mm256_storeu_ps(&y[m + 8], acc1);
+    }
+
+    fir_sse2(&x[m], b, length, &y[m], n - m);
+}
+
+/* The biquad recursion is bound by latency, fused multiply-add shortens it. */
+__attribute__((target("avx2,fma")))
+static void iir_avx2(const float *x, float *y, size_t n, const float *b, const float *a, float gain, float *hist, size_t sections)
+{
+    for (size_t m = 0; m < n; m++)
+    {
+        float sample = x[m];
+
+        for (size_t s = 0; s < sections; s++)
+        {
+            const float *as = a + 3*s;
+            const float *bs = b + 3*s;
+            float *h = hist + 3*s;
+
+            h[0] = sample - fmaf(as[1], h[1], as[2]*h[2]);
+            sample = fmaf(bs[0], h[0], fmaf(bs[1], h[1], bs[2]*h[2]));
+            h[2] = h[1];
+            h[1] = h[0];
+        }
+
+        y[m] = sample * gain;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256 atan2_avx2(__m256 im, __m256 re)
+{
+    const __m256 sign_mask = _mm256_set1_ps(-0.f);
+    const __m256 abs_re = _mm256_andnot_ps(sign_mask, re);
+    const __m256 abs_im = _mm256_andnot_ps(sign_mask, im);
+    const __m256 num = _mm256_min_ps(abs_re, abs_im);
+    const __m256 den = _mm256_max_ps(abs_re, abs_im);
+    const __m256 zero = _mm256_cmp_ps(den, _mm256_setzero_ps(), _CMP_EQ_OQ);
+    const __m256 t = _mm256_andnot_ps(zero, _mm256_div_ps(num, _mm256_blendv_ps(den, _mm256_set1_ps(1.f), zero)));
+    const __m256 t2 = _mm256_mul_ps(t, t);
+
+    __m256 p = _mm256_set1_ps(DSP_ATAN_A16);
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A14));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A12));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A10));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A8));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A6));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(DSP_ATAN_A2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t2), _mm256_set1_ps(1.f));
+
+    __m256 angle = _mm256_mul_ps(p, t);
+
+    angle = _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps((float)M_PI_2), angle), _mm256_cmp_ps(abs_im, abs_re, _CMP_GT_OQ));
+    angle = _mm256_blendv_ps(angle, _mm256_sub_ps(_mm256_set1_ps((float)M_PI), angle), _mm256_cmp_ps(re, _mm256_setzero_ps(), _CMP_LT_OQ));
+    angle = _mm256_or_ps(angle, _mm256_and_ps(im, sign_mask));
+
+    return _mm256_mul_ps(angle, _mm256_set1_ps((float)M_1_PI));
+}
+
+__attribute__((target("avx2")))
+static void discriminator_avx2(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        const __m256 vi = _mm256_loadu_ps(&i[k]);
+        const __m256 vq = _mm256_loadu_ps(&q[k]);
+        const __m256 vi_last = _mm256_loadu_ps(&i[k - 1]);
+        const __m256 vq_last = _mm256_loadu_ps(&q[k - 1]);
+        const __m256 re = _mm256_add_ps(_mm256_mul_ps(vi, vi_last), _mm256_mul_ps(vq, vq_last));
+        const __m256 im = _mm256_sub_ps(_mm256_mul_ps(vq, vi_last), _mm256_mul_ps(vi, vq_last));
+
+        _mm256_storeu_ps(&delta_phi[k], atan2_avx2(im, re));
+    }
+
+    discriminator_sse2(&i[k], &q[k], &delta_phi[k], n - k);
+}
+
+__attribute__((target("avx2")))
+static void discriminator_fast_avx2(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 8 <= n; k += 8)
+    {
+        const __m256 im = _mm256_sub_ps(_mm256_mul_ps(_mm256_loadu_ps(&i[k - 1]), _mm256_loadu_ps(&q[k])),
+                                        _mm256_mul_ps(_mm256_loadu_ps(&i[k]), _mm256_loadu_ps(&q[k - 1])));
+        _mm256_storeu_ps(&delta_phi[k], im);
+    }
+
+    discriminator_fast_generic(&i[k], &q[k], &delta_phi[k], n - k);
+}
+
+__attribute__((target("avx512f")))
+static void u8_to_iq_avx512(const uint8_t *src, float *i, float *q, size_t n)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    const __m512 offset = _mm512_set1_ps(127.5f);
+    size_t k;
+
+    for (k = 0; k + 16 <= n; k += 16)
+    {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)&src[2*k]);
+
+        _mm512_storeu_ps(&i[k], _mm512_sub_ps(_mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_and_si256(v, mask))), offset));
+        _mm512_storeu_ps(&q[k], _mm512_sub_ps(_mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_srli_epi16(v, 8))), offset));
+    }
+
+    u8_to_iq_avx2(&src[2*k], &i[k], &q[k], n - k);
+}
+
+__attribute__((target("avx512f")))
+static void mixer_avx512(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 16 <= n; k += 16)
+    {
+        const __m512 vi = _mm512_loadu_ps(&i[k]);
+        const __m512 vq = _mm512_loadu_ps(&q[k]);
+        const __m512 x = _mm512_loadu_ps(&cosine[k]);
+        const __m512 z = _mm512_loadu_ps(&sine[k]);
+        const __m512 ix = _mm512_mul_ps(vi, x);
+        const __m512 qx = _mm512_mul_ps(vq, x);
+        const __m512 iz = _mm512_mul_ps(vi, z);
+        const __m512 qz = _mm512_mul_ps(vq, z);
+
+        _mm512_storeu_ps(&i[k], _mm512_sub_ps(ix, qz));
+        _mm512_storeu_ps(&q[k], _mm512_add_ps(qx, iz));
+        _mm512_storeu_ps(&i_minus[k], _mm512_add_ps(ix, qz));
+        _mm512_storeu_ps(&q_minus[k], _mm512_sub_ps(qx, iz));
+    }
+
+    mixer_avx2(&i[k], &q[k], &i_minus[k], &q_minus[k], &cosine[k], &sine[k], n - k);
+}
+
+__attribute__((target("avx512f")))
+static void fir_avx512(const float *x, const float *b, size_t length, float *y, size_t n)
+{
+    size_t m;
+
+    for (m = 0; m + 32 <= n; m += 32)
+    {
+        const float *hist = &x[m + length - 1];
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+
+        for (size_t k = 0; k < length; k++, hist--)
+        {
+            const __m512 bk = _mm512_set1_ps(b[k]);
+            acc0 = _mm512_add_ps(acc0, _mm512_mul_ps(bk, _mm512_loadu_ps(hist)));
+            acc1 = _mm512_add_ps(acc1, _mm512_mul_ps(bk, _mm512_loadu_ps(hist + 16)));
+        }
+
+        _mm512_storeu_ps(&y[m], acc0);
+        _mm512_storeu_ps(&y[m + 16], acc1);
+    }
+
+    fir_avx2(&x[m], b, length, &y[m], n - m);
+}
+
+/* Checks 8 bit offsets per step: build the shifted windows with variable
+   shifts and compare them with the access code by the vector popcount.
+   errors <= DSP_SYNC_SEARCH_MAX_ERRORS like the generic kernel. */
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t sync_search_avx512(uint64_t history, uint64_t bits, unsigned n, uint32_t access_code, unsigned length, unsigned errors)
+{
+    const __m512i offsets = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m512i vbits = _mm512_set1_epi64(bits);
+    const __m512i vhistory = _mm512_set1_epi64(history);
+    const __m512i vcode = _mm512_set1_epi64(access_code);
+    const __m512i vmask = _mm512_set1_epi64((1ull << length) - 1);
+    const __m512i verrors = _mm512_set1_epi64(errors);
+    uint64_t found = 0;
+
+    for (unsigned k = 0; k < n; k += 8)
+    {
+        const __m512i shift = _mm512_add_epi64(offsets, _mm512_set1_epi64(k));
+        // Shifts by 64 and more give 0 here, other than in C.
+        const __m512i window = _mm512_or_si512(_mm512_srlv_epi64(vbits, shift),
+                                               _mm512_sllv_epi64(vhistory, _mm512_sub_epi64(_mm512_set1_epi64(n), shift)));
+        const __m512i distance = _mm512_popcnt_epi64(_mm512_xor_si512(_mm512_and_si512(window, vmask), vcode));
+
+        found |= (uint64_t)_mm512_cmple_epu64_mask(distance, verrors) << k;
+    }
+
+    return (n < 64) ? found & ((1ull << n) - 1) : found;
+}
+
+__attribute__((target("avx512f")))
+static void discriminator_fast_avx512(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 16 <= n; k += 16)
+    {
+        const __m512 im = _mm512_sub_ps(_mm512_mul_ps(_mm512_loadu_ps(&i[k - 1]), _mm512_loadu_ps(&q[k])),
+                                        _mm512_mul_ps(_mm512_loadu_ps(&i[k]), _mm512_loadu_ps(&q[k - 1])));
+        _mm512_storeu_ps(&delta_phi[k], im);
+    }
+
+    discriminator_fast_avx2(&i[k], &q[k], &delta_phi[k], n - k);
+}
+
+__attribute__((target("avx512f")))
+static void slicer_avx512(const float *x, uint64_t *bits, size_t n)
+{
+    const __m512 zero = _mm512_setzero_ps();
+    size_t w;
+
+    for (w = 0; 64*w + 64 <= n; w++)
+    {
+        uint64_t word = 0;
+
+        for (unsigned k = 0; k < 64; k += 16)
+        {
+            word |= (uint64_t)_mm512_cmp_ps_mask(_mm512_loadu_ps(&x[64*w + k]), zero, _CMP_GE_OQ) << k;
+        }
+        bits[w] = word;
+    }
+
+    if (64*w < n) slicer_generic(&x[64*w], &bits[w], n - 64*w);
+}
+
+__attribute__((target("avx512f")))
+static float energy_avx512(const float *i, const float *q, size_t n)
+{
+    __m512 acc = _mm512_setzero_ps();
+    size_t k;
+
+    for (k = 0; k + 16 <= n; k += 16)
+    {
+        const __m512 vi = _mm512_loadu_ps(&i[k]);
+        const __m512 vq = _mm512_loadu_ps(&q[k]);
+        acc = _mm512_fmadd_ps(vq, vq, _mm512_fmadd_ps(vi, vi, acc));
+    }
+
+    return _mm512_reduce_add_ps(acc) + energy_generic(&i[k], &q[k], n - k);
+}
+
+__attribute__((target("avx512f")))
+static void correlate_avx512(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 16 <= n; k += 16)
+    {
+        __m512 acc = _mm512_setzero_ps();
+
+        for (size_t j = 0; j < count; j++)
+        {
+            acc = _mm512_fmadd_ps(_mm512_set1_ps(taps[j]), _mm512_loadu_ps(&x[k] - delays[j]), acc);
+        }
+        _mm512_storeu_ps(&y[k], acc);
+    }
+
+    correlate_generic(&x[k], taps, delays, count, &y[k], n - k);
+}
+
+/* Folds 16 bytes per step by two carry-less multiplies, see CRC16_DNP_FOLD_X192.
+   The bytes are reversed, so the first bit of the block is the highest one. */
+__attribute__((target("pclmul,ssse3")))
+static uint16_t crc16_dnp_pclmul(uint16_t crc, const uint8_t *data, size_t datalen)
+{
+    if (datalen < 32) return crc16_dnp_slice8(crc, data, datalen);
+
+    const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i fold = _mm_set_epi64x(CRC16_DNP_FOLD_X192, CRC16_DNP_FOLD_X128);
+
+    __m128i acc = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), reverse);
+    acc = _mm_xor_si128(acc, _mm_set_epi64x((long long)((uint64_t)crc << 48), 0));
+    data += 16;
+    datalen -= 16;
+
+    while (datalen >= 16)
+    {
+        const __m128i next = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)data), reverse);
+        acc = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(acc, fold, 0x11), _mm_clmulepi64_si128(acc, fold, 0x00)), next);
+        data += 16;
+        datalen -= 16;
+    }
+
+    uint8_t folded[16];
+    _mm_storeu_si128((__m128i *)folded, _mm_shuffle_epi8(acc, reverse));
+
+    return crc16_dnp_slice8(crc16_dnp_slice8(0, folded, sizeof(folded)), data, datalen);
+}
+
+/* CBC decryption has no dependency between the blocks, so four of them are
+   kept in flight to hide the latency of AESDEC. */
+__attribute__((target("aes,sse2")))
+static void aes128_cbc_decrypt_aesni(const struct aes128_key *key, const uint8_t *iv, const uint8_t *src, uint8_t *dst, size_t blocks)
+{
+    __m128i k[AES128_ROUNDS + 1];
+    for (unsigned r = 0; r <= AES128_ROUNDS; r++) k[r] = _mm_loadu_si128((const __m128i *)key->dec[r]);
+
+    __m128i chain = _mm_loadu_si128((const __m128i *)iv);
+
+    for (; blocks >= 4; blocks -= 4, src += 4*AES128_BLOCK_SIZE, dst += 4*AES128_BLOCK_SIZE)
+    {
+        const __m128i c0 = _mm_loadu_si128((const __m128i *)&src[0]);
+        const __m128i c1 = _mm_loadu_si128((const __m128i *)&src[16]);
+        const __m128i c2 = _mm_loadu_si128((const __m128i *)&src[32]);
+        const __m128i c3 = _mm_loadu_si128((const __m128i *)&src[48]);
+
+        __m128i s0 = _mm_xor_si128(c0, k[0]), s1 = _mm_xor_si128(c1, k[0]);
+        __m128i s2 = _mm_xor_si128(c2, k[0]), s3 = _mm_xor_si128(c3, k[0]);
+
+        for (unsigned r = 1; r < AES128_ROUNDS; r++)
+        {
+            s0 = _mm_aesdec_si128(s0, k[r]);
+            s1 = _mm_aesdec_si128(s1, k[r]);
+            s2 = _mm_aesdec_si128(s2, k[r]);
+            s3 = _mm_aesdec_si128(s3, k[r]);
+        }
+
+        _mm_storeu_si128((__m128i *)&dst[0], _mm_xor_si128(_mm_aesdeclast_si128(s0, k[AES128_ROUNDS]), chain));
+        _mm_storeu_si128((__m128i *)&dst[16], _mm_xor_si128(_mm_aesdeclast_si128(s1, k[AES128_ROUNDS]), c0));
+        _mm_storeu_si128((__m128i *)&dst[32], _mm_xor_si128(_mm_aesdeclast_si128(s2, k[AES128_ROUNDS]), c1));
+        _mm_storeu_si128((__m128i *)&dst[48], _mm_xor_si128(_mm_aesdeclast_si128(s3, k[AES128_ROUNDS]), c2));
+        chain = c3;
+    }
+
+    for (; blocks; blocks--, src += AES128_BLOCK_SIZE, dst += AES128_BLOCK_SIZE)
+    {
+        const __m128i c = _mm_loadu_si128((const __m128i *)src);
+        __m128i s = _mm_xor_si128(c, k[0]);
+
+        for (unsigned r = 1; r < AES128_ROUNDS; r++) s = _mm_aesdec_si128(s, k[r]);
+
+        _mm_storeu_si128((__m128i *)dst, _mm_xor_si128(_mm_aesdeclast_si128(s, k[AES128_ROUNDS]), chain));
+        chain = c;
+    }
+}
+
+#endif /* DSP_X86 */
+
+
+/* ------------------------------------------------------------------------- */
+/* ARM implementations.                                                      */
+/* ------------------------------------------------------------------------- */
+
+#if DSP_NEON
+
+static void u8_to_iq_neon(const uint8_t *src, float *i, float *q, size_t n)
+{
+    const float32x4_t offset = vdupq_n_f32(127.5f);
+    size_t k;
+
+    for (k = 0; k + 16 <= n; k += 16)
+    {
+        const uint8x16x2_t v = vld2q_u8(&src[2*k]);
+
+        for (int c = 0; c < 2; c++)
+        {
+            float *dst = (c == 0) ? &i[k] : &q[k];
+            const uint16x8_t lo = vmovl_u8(vget_low_u8(v.val[c]));
+            const uint16x8_t hi = vmovl_u8(vget_high_u8(v.val[c]));
+
+            vst1q_f32(dst +  0, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), offset));
+            vst1q_f32(dst +  4, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), offset));
+            vst1q_f32(dst +  8, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), offset));
+            vst1q_f32(dst + 12, vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), offset));
+        }
+    }
+
+    u8_to_iq_generic(&src[2*k], &i[k], &q[k], n - k);
+}
+
+static void mixer_neon(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const float32x4_t vi = vld1q_f32(&i[k]);
+        const float32x4_t vq = vld1q_f32(&q[k]);
+        const float32x4_t x = vld1q_f32(&cosine[k]);
+        const float32x4_t z = vld1q_f32(&sine[k]);
+        const float32x4_t ix = vmulq_f32(vi, x);
+        const float32x4_t qx = vmulq_f32(vq, x);
+        const float32x4_t iz = vmulq_f32(vi, z);
+        const float32x4_t qz = vmulq_f32(vq, z);
+
+        vst1q_f32(&i[k], vsubq_f32(ix, qz));
+        vst1q_f32(&q[k], vaddq_f32(qx, iz));
+        vst1q_f32(&i_minus[k], vaddq_f32(ix, qz));
+        vst1q_f32(&q_minus[k], vsubq_f32(qx, iz));
+    }
+
+    mixer_generic(&i[k], &q[k], &i_minus[k], &q_minus[k], &cosine[k], &sine[k], n - k);
+}
+
+static void moving_average_neon(const float *x, size_t length, size_t decimation, float *y, size_t n)
+{
+    if (length & (length - 1))
+    {
+        moving_average_generic(x, length, decimation, y, n);
+        return;
+    }
+
+    __attribute__((__aligned__(16))) int32_t sum[DSP_MOVING_AVERAGE_CHUNK * 16 + 64];
+    const size_t outputs_per_chunk = DSP_MOVING_AVERAGE_CHUNK * 16 / decimation;
+
+    if (outputs_per_chunk == 0)
+    {
+        moving_average_generic(x, length, decimation, y, n);
+        return;
+    }
+
+    while (n)
+    {
+        const size_t outputs = (n < outputs_per_chunk) ? n : outputs_per_chunk;
+        const size_t inputs = (outputs - 1) * decimation + length;
+        size_t k;
+
+        for (k = 0; k + 4 <= inputs; k += 4) vst1q_s32(&sum[k], vcvtq_s32_f32(vld1q_f32(&x[k])));
+        for (; k < inputs; k++) sum[k] = (int)x[k];
+        memset(&sum[inputs], 0, 32 * sizeof(sum[0]));
+
+        for (size_t w = 1; w < length; w *= 2)
+        {
+            for (k = 0; k + w < inputs; k += 4) vst1q_s32(&sum[k], vaddq_s32(vld1q_s32(&sum[k]), vld1q_s32(&sum[k + w])));
+        }
+
+        for (k = 0; k < outputs; k++) y[k] = (float)sum[k*decimation] / length;
+
+        x += outputs * decimation;
+        y += outputs;
+        n -= outputs;
+    }
+}
+
+static void fir_neon(const float *x, const float *b, size_t length, float *y, size_t n)
+{
+    size_t m;
+
+    for (m = 0; m + 8 <= n; m += 8)
+    {
+        const float *hist = &x[m + length - 1];
+        float32x4_t acc0 = vdupq_n_f32(0.f);
+        float32x4_t acc1 = vdupq_n_f32(0.f);
+
+        for (size_t k = 0; k < length; k++, hist--)
+        {
+            const float32x4_t bk = vdupq_n_f32(b[k]);
+            acc0 = vaddq_f32(acc0, vmulq_f32(bk, vld1q_f32(hist)));
+            acc1 = vaddq_f32(acc1, vmulq_f32(bk, vld1q_f32(hist + 4)));
+        }
+
+        vst1q_f32(&y[m], acc0);
+        vst1q_f32(&y[m + 4], acc1);
+    }
+
+    fir_generic(&x[m], b, length, &y[m], n - m);
+}
+
+#if defined(__aarch64__)
+static inline float32x4_t atan2_neon(float32x4_t im, float32x4_t re)
+{
+    const float32x4_t abs_re = vabsq_f32(re);
+    const float32x4_t abs_im = vabsq_f32(im);
+    const float32x4_t num = vminq_f32(abs_re, abs_im);
+    const float32x4_t den = vmaxq_f32(abs_re, abs_im);
+    const uint32x4_t zero = vceqq_f32(den, vdupq_n_f32(0.f));
+    const float32x4_t t = vbslq_f32(zero, vdupq_n_f32(0.f), vdivq_f32(num, vbslq_f32(zero, vdupq_n_f32(1.f), den)));
+    const float32x4_t t2 = vmulq_f32(t, t);
+
+    float32x4_t p = vdupq_n_f32(DSP_ATAN_A16);
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A14));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A12));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A10));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A8));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A6));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A4));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(DSP_ATAN_A2));
+    p = vaddq_f32(vmulq_f32(p, t2), vdupq_n_f32(1.f));
+
+    float32x4_t angle = vmulq_f32(p, t);
+
+    angle = vbslq_f32(vcgtq_f32(abs_im, abs_re), vsubq_f32(vdupq_n_f32((float)M_PI_2), angle), angle);
+    angle = vbslq_f32(vcltq_f32(re, vdupq_n_f32(0.f)), vsubq_f32(vdupq_n_f32((float)M_PI), angle), angle);
+    angle = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(angle), vandq_u32(vreinterpretq_u32_f32(im), vdupq_n_u32(0x80000000u))));
+
+    return vmulq_f32(angle, vdupq_n_f32((float)M_1_PI));
+}
+
+static void discriminator_neon(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const float32x4_t vi = vld1q_f32(&i[k]);
+        const float32x4_t vq = vld1q_f32(&q[k]);
+        const float32x4_t vi_last = vld1q_f32(&i[k - 1]);
+        const float32x4_t vq_last = vld1q_f32(&q[k - 1]);
+        const float32x4_t re = vaddq_f32(vmulq_f32(vi, vi_last), vmulq_f32(vq, vq_last));
+        const float32x4_t im = vsubq_f32(vmulq_f32(vq, vi_last), vmulq_f32(vi, vq_last));
+
+        vst1q_f32(&delta_phi[k], atan2_neon(im, re));
+    }
+
+    discriminator_generic(&i[k], &q[k], &delta_phi[k], n - k);
+}
+#endif
+
+static void discriminator_fast_neon(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const float32x4_t im = vsubq_f32(vmulq_f32(vld1q_f32(&i[k - 1]), vld1q_f32(&q[k])),
+                                         vmulq_f32(vld1q_f32(&i[k]), vld1q_f32(&q[k - 1])));
+        vst1q_f32(&delta_phi[k], im);
+    }
+
+    discriminator_fast_generic(&i[k], &q[k], &delta_phi[k], n - k);
+}
+
+#if defined(__aarch64__)
+static void slicer_neon(const float *x, uint64_t *bits, size_t n)
+{
+    const uint32x4_t weights = {1u, 2u, 4u, 8u};
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    size_t w;
+
+    for (w = 0; 64*w + 64 <= n; w++)
+    {
+        uint64_t word = 0;
+
+        for (unsigned k = 0; k < 64; k += 4)
+        {
+            const uint32x4_t ge = vcgeq_f32(vld1q_f32(&x[64*w + k]), zero);
+            word |= (uint64_t)vaddvq_u32(vandq_u32(ge, weights)) << k;
+        }
+        bits[w] = word;
+    }
+
+    if (64*w < n) slicer_generic(&x[64*w], &bits[w], n - 64*w);
+}
+#endif
+
+static float energy_neon(const float *i, const float *q, size_t n)
+{
+    float32x4_t acc = vdupq_n_f32(0.f);
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        const float32x4_t vi = vld1q_f32(&i[k]);
+        const float32x4_t vq = vld1q_f32(&q[k]);
+        acc = vmlaq_f32(vmlaq_f32(acc, vi, vi), vq, vq);
+    }
+
+    float sum[4];
+    vst1q_f32(sum, acc);
+
+    return sum[0] + sum[1] + sum[2] + sum[3] + energy_generic(&i[k], &q[k], n - k);
+}
+
+static void correlate_neon(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n)
+{
+    size_t k;
+
+    for (k = 0; k + 4 <= n; k += 4)
+    {
+        float32x4_t acc = vdupq_n_f32(0.f);
+
+        for (size_t j = 0; j < count; j++)
+        {
+            acc = vmlaq_n_f32(acc, vld1q_f32(&x[k] - delays[j]), taps[j]);
+        }
+        vst1q_f32(&y[k], acc);
+    }
+
+    correlate_generic(&x[k], taps, delays, count, &y[k], n - k);
+}
+
+#if defined(__aarch64__) && DSP_ARMV8_CRYPTO
+static inline uint64_t crc16_dnp_load_be64(const uint8_t *data)
+{
+    uint64_t v;
+    memcpy(&v, data, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+/* The same folding as crc16_dnp_pclmul() on two 64-bit halves. */
+__attribute__((target("+crypto")))
+static uint16_t crc16_dnp_pmull(uint16_t crc, const uint8_t *data, size_t datalen)
+{
+    if (datalen < 32) return crc16_dnp_slice8(crc, data, datalen);
+
+    uint64_t hi = crc16_dnp_load_be64(&data[0]) ^ ((uint64_t)crc << 48);
+    uint64_t lo = crc16_dnp_load_be64(&data[8]);
+    data += 16;
+    datalen -= 16;
+
+    while (datalen >= 16)
+    {
+        const uint64x2_t product = veorq_u64(vreinterpretq_u64_p128(vmull_p64(hi, CRC16_DNP_FOLD_X192)),
+                                             vreinterpretq_u64_p128(vmull_p64(lo, CRC16_DNP_FOLD_X128)));
+        hi = vgetq_lane_u64(product, 1) ^ crc16_dnp_load_be64(&data[0]);
+        lo = vgetq_lane_u64(product, 0) ^ crc16_dnp_load_be64(&data[8]);
+        data += 16;
+        datalen -= 16;
+    }
+
+    uint8_t folded[16];
+    for (unsigned k = 0; k < 8; k++)
+    {
+        folded[k] = (uint8_t)(hi >> (56 - 8*k));
+        folded[8 + k] = (uint8_t)(lo >> (56 - 8*k));
+    }
+
+    return crc16_dnp_slice8(crc16_dnp_slice8(0, folded, sizeof(folded)), data, datalen);
+}
+
+/* AESD adds the round key before the inverse substitution, so the round keys
+   of the equivalent inverse cipher are used one round earlier than by AES-NI. */
+__attribute__((target("+crypto")))
+static void aes128_cbc_decrypt_armv8(const struct aes128_key *key, const uint8_t *iv, const uint8_t *src, uint8_t *dst, size_t blocks)
+{
+    uint8x16_t k[AES128_ROUNDS + 1];
+    for (unsigned r = 0; r <= AES128_ROUNDS; r++) k[r] = vld1q_u8(key->dec[r]);
+
+    uint8x16_t chain = vld1q_u8(iv);
+
+    for (; blocks; blocks--, src += AES128_BLOCK_SIZE, dst += AES128_BLOCK_SIZE)
+    {
+        const uint8x16_t c = vld1q_u8(src);
+        uint8x16_t s = c;
+
+        for (unsigned r = 0; r < AES128_ROUNDS - 1; r++) s = vaesimcq_u8(vaesdq_u8(s, k[r]));
+        s = veorq_u8(vaesdq_u8(s, k[AES128_ROUNDS - 1]), k[AES128_ROUNDS]);
+
+        vst1q_u8(dst, veorq_u8(s, chain));
+        chain = c;
+    }
+}
+#endif
+
+#endif /* DSP_NEON */
+
+
+/* ------------------------------------------------------------------------- */
+/* Registry.                                                                 */
+/* ------------------------------------------------------------------------- */
+
+static const struct dsp_kernel_impl DSP_U8_TO_IQ_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, u8_to_iq_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, u8_to_iq_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, u8_to_iq_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, u8_to_iq_avx512),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, u8_to_iq_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_MIXER_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, mixer_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, mixer_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, mixer_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, mixer_avx512),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, mixer_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_MOVING_AVERAGE_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, moving_average_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, moving_average_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, moving_average_avx2),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, moving_average_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_FIR_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, fir_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, fir_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, fir_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, fir_avx512),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, fir_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_IIR_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, iir_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, iir_avx2),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_DISCRIMINATOR_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, discriminator_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, discriminator_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, discriminator_avx2),
+#endif
+#if DSP_NEON && defined(__aarch64__)
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, discriminator_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_DISCRIMINATOR_FAST_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, discriminator_fast_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, discriminator_fast_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, discriminator_fast_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, discriminator_fast_avx512),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, discriminator_fast_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_CRC16_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, crc16_dnp_generic),
+    DSP_KERNEL_IMPL("slice8", 0, crc16_dnp_slice8),
+#if DSP_X86
+    DSP_KERNEL_IMPL("pclmul", DSP_CPU_PCLMUL, crc16_dnp_pclmul),
+#endif
+#if DSP_NEON && defined(__aarch64__) && DSP_ARMV8_CRYPTO
+    DSP_KERNEL_IMPL("pmull", DSP_CPU_PMULL, crc16_dnp_pmull),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_SYNC_SEARCH_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, sync_search_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512 | DSP_CPU_AVX512_VPOPCNTDQ, sync_search_avx512),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_SLICER_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, slicer_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, slicer_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, slicer_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, slicer_avx512),
+#endif
+#if DSP_NEON && defined(__aarch64__)
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, slicer_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_ENERGY_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, energy_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, energy_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, energy_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, energy_avx512),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, energy_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_CORRELATE_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, correlate_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("sse2", DSP_CPU_SSE2, correlate_sse2),
+    DSP_KERNEL_IMPL("avx2", DSP_CPU_AVX2, correlate_avx2),
+    DSP_KERNEL_IMPL("avx512", DSP_CPU_AVX512, correlate_avx512),
+#endif
+#if DSP_NEON
+    DSP_KERNEL_IMPL("neon", DSP_CPU_NEON, correlate_neon),
+#endif
+};
+
+static const struct dsp_kernel_impl DSP_AES128_CBC_IMPLS[] =
+{
+    DSP_KERNEL_IMPL("generic", 0, aes128_cbc_decrypt_generic),
+#if DSP_X86
+    DSP_KERNEL_IMPL("aesni", DSP_CPU_AES, aes128_cbc_decrypt_aesni),
+#endif
+#if DSP_NEON && defined(__aarch64__) && DSP_ARMV8_CRYPTO
+    DSP_KERNEL_IMPL("armv8", DSP_CPU_AES, aes128_cbc_decrypt_armv8),
+#endif
+};
+
+#define DSP_KERNEL(name, impls) { name, impls, sizeof(impls)/sizeof(impls[0]), &impls[0] }
+
+static struct dsp_kernel dsp_kernels[DSP_KERNEL_COUNT] =
+{
+    [DSP_KERNEL_U8_TO_IQ]            = DSP_KERNEL("u8_to_iq",           DSP_U8_TO_IQ_IMPLS),
+    [DSP_KERNEL_MIXER]               = DSP_KERNEL("mixer",              DSP_MIXER_IMPLS),
+    [DSP_KERNEL_MOVING_AVERAGE]      = DSP_KERNEL("moving_average",     DSP_MOVING_AVERAGE_IMPLS),
+    [DSP_KERNEL_FIR]                 = DSP_KERNEL("fir",                DSP_FIR_IMPLS),
+    [DSP_KERNEL_IIR]                 = DSP_KERNEL("iir",                DSP_IIR_IMPLS),
+    [DSP_KERNEL_DISCRIMINATOR]       = DSP_KERNEL("discriminator",      DSP_DISCRIMINATOR_IMPLS),
+    [DSP_KERNEL_DISCRIMINATOR_FAST]  = DSP_KERNEL("discriminator_fast", DSP_DISCRIMINATOR_FAST_IMPLS),
+    [DSP_KERNEL_CRC16]               = DSP_KERNEL("crc16",              DSP_CRC16_IMPLS),
+    [DSP_KERNEL_SYNC_SEARCH]         = DSP_KERNEL("sync_search",        DSP_SYNC_SEARCH_IMPLS),
+    [DSP_KERNEL_SLICER]              = DSP_KERNEL("slicer",             DSP_SLICER_IMPLS),
+    [DSP_KERNEL_ENERGY]              = DSP_KERNEL("energy",             DSP_ENERGY_IMPLS),
+    [DSP_KERNEL_CORRELATE]           = DSP_KERNEL("correlate",          DSP_CORRELATE_IMPLS),
+    [DSP_KERNEL_AES128_CBC]          = DSP_KERNEL("aes128_cbc",         DSP_AES128_CBC_IMPLS),
+};
+
+#undef DSP_KERNEL
+
+/* ISA names accepted by dsp_kernels_force() and the features each of them enables. */
+static const struct
+{
+    const char *isa;
+    unsigned features;
+} DSP_ISA_LEVELS[] =
+{
+    {"generic", 0},
+    {"sse2",    DSP_CPU_SSE2},
+    {"avx2",    DSP_CPU_SSE2 | DSP_CPU_AVX2 | DSP_CPU_PCLMUL | DSP_CPU_AES},
+    {"avx512",  DSP_CPU_SSE2 | DSP_CPU_AVX2 | DSP_CPU_AVX512 | DSP_CPU_AVX512_VPOPCNTDQ | DSP_CPU_PCLMUL | DSP_CPU_AES},
+    {"neon",    DSP_CPU_NEON | DSP_CPU_PMULL | DSP_CPU_AES},
+};
+
+static unsigned dsp_cpu_features = 0;
+
+static unsigned dsp_detect_cpu_features(void)
+{
+    unsigned features = 0;
+
+#if DSP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) features |= DSP_CPU_SSE2;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) features |= DSP_CPU_AVX2;
+    if ((features & DSP_CPU_AVX2) && __builtin_cpu_supports("avx512f")) features |= DSP_CPU_AVX512;
+    if ((features & DSP_CPU_AVX512) && __builtin_cpu_supports("avx512vpopcntdq")) features |= DSP_CPU_AVX512_VPOPCNTDQ;
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) features |= DSP_CPU_PCLMUL;
+    if (__builtin_cpu_supports("aes")) features |= DSP_CPU_AES;
+#endif
+
+#if DSP_NEON
+#if defined(__aarch64__)
+    features |= DSP_CPU_NEON; // Advanced SIMD is mandatory on ARMv8-A.
+#if defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_PMULL) features |= DSP_CPU_PMULL;
+    if (getauxval(AT_HWCAP) & HWCAP_AES) features |= DSP_CPU_AES;
+#endif
+#elif defined(__linux__)
+    if (getauxval(AT_HWCAP) & HWCAP_NEON) features |= DSP_CPU_NEON;
+#else
+    features |= DSP_CPU_NEON; // Compiled with NEON enabled, so we have to trust the compiler flags.
+#endif
+#endif
+
+    return features;
+}
+
+static void dsp_kernel_select(struct dsp_kernel *kernel, unsigned features)
+{
+    kernel->active = &kernel->impls[0];
+
+    for (size_t k = 1; k < kernel->count; k++)
+    {
+        if ((kernel->impls[k].features & features) == kernel->impls[k].features)
+        {
+            kernel->active = &kernel->impls[k];
+        }
+    }
+}
+
+/** @brief Pick the fastest implementation of every kernel the CPU can run. */
+static void dsp_kernels_init(void)
+{
+    dsp_cpu_features = dsp_detect_cpu_features();
+    crc16_dnp_init_tables();
+    aes128_init_tables();
+
+    for (size_t k = 0; k < DSP_KERNEL_COUNT; k++)
+    {
+        dsp_kernel_select(&dsp_kernels[k], dsp_cpu_features);
+    }
+}
+
+/** @brief Force kernel implementations, e.g. for benchmarking.
+ *
+ *  spec is either an ISA name ("generic", "sse2", "avx2", ...) which limits
+ *  all kernels to that instruction set, or "kernel=isa" which selects exactly
+ *  one implementation of one kernel.
+ *
+ *  @return 0 on success, -1 if the request cannot be fulfilled on this CPU.
+ */
+static int dsp_kernels_force(const char *spec)
+{
+    const char *eq = strchr(spec, '=');
+
+    if (eq == NULL)
+    {
+        for (size_t l = 0; l < sizeof(DSP_ISA_LEVELS)/sizeof(DSP_ISA_LEVELS[0]); l++)
+        {
+            if (strcmp(spec, DSP_ISA_LEVELS[l].isa) != 0) continue;
+
+            const unsigned required = DSP_ISA_LEVELS[l].features & ~DSP_CPU_OPTIONAL;
+            if ((required & dsp_cpu_features) != required) return -1;
+
+            for (size_t k = 0; k < DSP_KERNEL_COUNT; k++)
+            {
+                dsp_kernel_select(&dsp_kernels[k], DSP_ISA_LEVELS[l].features & dsp_cpu_features);
+            }
+            return 0;
+        }
+        return -1;
+    }
+
+    for (size_t k = 0; k < DSP_KERNEL_COUNT; k++)
+    {
+        struct dsp_kernel *kernel = &dsp_kernels[k];
+
+        if (strlen(kernel->name) != (size_t)(eq - spec) || strncmp(spec, kernel->name, eq - spec) != 0) continue;
+
+        for (size_t i = 0; i < kernel->count; i++)
+        {
+            if (strcmp(eq + 1, kernel->impls[i].isa) != 0) continue;
+
+            if ((kernel->impls[i].features & dsp_cpu_features) != kernel->impls[i].features) return -1;
+
+            kernel->active = &kernel->impls[i];
+            return 0;
+        }
+        return -1;
+    }
+
+    return -1;
+}
+
+static void dsp_kernels_print(FILE *stream)
+{
+    for (size_t k = 0; k < DSP_KERNEL_COUNT; k++)
+    {
+        const struct dsp_kernel *kernel = &dsp_kernels[k];
+
+        fprintf(stream, "%-20s %-8s (", kernel->name, kernel->active->isa);
+        for (size_t i = 0; i < kernel->count; i++)
+        {
+            fprintf(stream, "%s%s", i ? "," : "", kernel->impls[i].isa);
+        }
+        fprintf(stream, ")\n");
+    }
+}
+
+
+/* ------------------------------------------------------------------------- */
+/* Calling the active implementations.                                       */
+/* ------------------------------------------------------------------------- */
+
+static inline void dsp_u8_to_iq(const uint8_t *src, float *i, float *q, size_t n)
+{
+    ((dsp_u8_to_iq_fn)dsp_kernels[DSP_KERNEL_U8_TO_IQ].active->fn)(src, i, q, n);
+}
+
+static inline void dsp_mixer(float *i, float *q, float *i_minus, float *q_minus, const float *cosine, const float *sine, size_t n)
+{
+    ((dsp_mixer_fn)dsp_kernels[DSP_KERNEL_MIXER].active->fn)(i, q, i_minus, q_minus, cosine, sine, n);
+}
+
+static inline void dsp_moving_average(const float *x, size_t length, size_t decimation, float *y, size_t n)
+{
+    ((dsp_moving_average_fn)dsp_kernels[DSP_KERNEL_MOVING_AVERAGE].active->fn)(x, length, decimation, y, n);
+}
+
+static inline void dsp_fir(const float *x, const float *b, size_t length, float *y, size_t n)
+{
+    ((dsp_fir_fn)dsp_kernels[DSP_KERNEL_FIR].active->fn)(x, b, length, y, n);
+}
+
+static inline void dsp_iir(const float *x, float *y, size_t n, const float *b, const float *a, float gain, float *hist, size_t sections)
+{
+    ((dsp_iir_fn)dsp_kernels[DSP_KERNEL_IIR].active->fn)(x, y, n, b, a, gain, hist, sections);
+}
+
+static inline void dsp_discriminator(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    ((dsp_discriminator_fn)dsp_kernels[DSP_KERNEL_DISCRIMINATOR].active->fn)(i, q, delta_phi, n);
+}
+
+static inline void dsp_discriminator_fast(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    ((dsp_discriminator_fn)dsp_kernels[DSP_KERNEL_DISCRIMINATOR_FAST].active->fn)(i, q, delta_phi, n);
+}
+
+static inline uint16_t dsp_crc16(uint16_t crc, const uint8_t *data, size_t datalen)
+{
+    return ((dsp_crc16_fn)dsp_kernels[DSP_KERNEL_CRC16].active->fn)(crc, data, datalen);
+}
+
+static inline void dsp_aes128_cbc_decrypt(const struct aes128_key *key, const uint8_t *iv, const uint8_t *src, uint8_t *dst, size_t blocks)
+{
+    ((dsp_aes128_cbc_fn)dsp_kernels[DSP_KERNEL_AES128_CBC].active->fn)(key, iv, src, dst, blocks);
+}
+
+static inline uint64_t dsp_sync_search(uint64_t history, uint64_t bits, unsigned n, uint32_t access_code, unsigned length, unsigned errors)
+{
+    if (errors > DSP_SYNC_SEARCH_MAX_ERRORS) errors = DSP_SYNC_SEARCH_MAX_ERRORS; // the same limit for every kernel
+    return ((dsp_sync_search_fn)dsp_kernels[DSP_KERNEL_SYNC_SEARCH].active->fn)(history, bits, n, access_code, length, errors);
+}
+
+static inline void dsp_slicer(const float *x, uint64_t *bits, size_t n)
+{
+    ((dsp_slicer_fn)dsp_kernels[DSP_KERNEL_SLICER].active->fn)(x, bits, n);
+}
+
+static inline float dsp_energy(const float *i, const float *q, size_t n)
+{
+    return ((dsp_energy_fn)dsp_kernels[DSP_KERNEL_ENERGY].active->fn)(i, q, n);
+}
+
+static inline void dsp_correlate(const float *x, const float *taps, const unsigned *delays, size_t count, float *y, size_t n)
+{
+    ((dsp_correlate_fn)dsp_kernels[DSP_KERNEL_CORRELATE].active->fn)(x, taps, delays, count, y, n);
+}
+
+#endif /* DSP_KERNELS_H */
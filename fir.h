@@ -32,7 +32,9 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include <fixedptc/fixedptc.h>
+#include "dsp_kernels.h"
 
 typedef struct
 {
@@ -129,5 +131,23 @@ fixedpt firfp(fixedpt sample, FIRFP_FILTER *filter)
     return sample;
 }
 
+typedef struct
+{
+    const size_t length;
+    const float *const b;
+
+    float *hist; // length-1 past samples followed by room for DSP_BLOCK_SIZE new ones
+} FIRF_BLOCK_FILTER;
+
+void firf_block(const float *x, float *y, size_t n, FIRF_BLOCK_FILTER *filter);
+
+/* Filters n <= DSP_BLOCK_SIZE samples at once. x and y may be the same buffer. */
+void firf_block(const float *x, float *y, size_t n, FIRF_BLOCK_FILTER *filter)
+{
+    memcpy(&filter->hist[filter->length-1], x, n * sizeof(x[0]));
+    dsp_fir(filter->hist, filter->b, filter->length, y, n);
+    memmove(filter->hist, &filter->hist[n], (filter->length-1) * sizeof(x[0]));
+}
+
 #endif /* FIR_H */
 
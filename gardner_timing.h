@@ -0,0 +1,153 @@
+#ifndef GARDNER_TIMING_H
+#define GARDNER_TIMING_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Symbol timing recovery by an interpolating Gardner loop. The demodulated
+ * signal is taken at a low rate (2...4 samples per symbol); a cubic Farrow
+ * interpolator computes the signal at the symbol instants and halfway between
+ * them, and the Gardner timing error detector
+ *
+ *     e = y(k-1/2) * (y(k) - y(k-1))
+ *
+ * drives a proportional-integral loop which corrects the timing phase and the
+ * symbol period. The timing is resolved to a fraction of a sample, so no high
+ * oversampling and no band-pass for the clock are necessary.
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+struct gardner_timing
+{
+    unsigned decimation; // input samples per loop sample
+    unsigned phase;      // input samples to skip before the next loop sample
+
+    float omega;         // symbol period in loop samples
+    float omega_nominal;
+    float omega_min, omega_max;
+    float kp, ki;        // loop gains for the timing phase and the symbol period
+
+    float x[4];          // last 4 loop samples, the newest one in x[3]
+    float t;             // position of the next strobe in loop samples after x[1]
+    int midpoint;        // next strobe is the one between two symbols
+    float y_prev, y_mid; // last symbol strobe and the strobe after it
+    float power;         // average symbol power, normalizes the timing error
+};
+
+/** @brief Set up the loop.
+ *
+ *  @param samples_per_symbol nominal symbol period in input samples
+ *  @param decimation only every decimation-th input sample is used by the loop
+ *  @param tolerance maximal relative deviation of the symbol rate, e.g. 0.12f
+ */
+static void gardner_timing_init(struct gardner_timing *g, float samples_per_symbol, unsigned decimation, float tolerance)
+{
+    memset(g, 0, sizeof(*g));
+
+    g->decimation = decimation;
+    g->omega_nominal = samples_per_symbol / decimation;
+    g->omega = g->omega_nominal;
+    g->omega_min = g->omega_nominal * (1.f - tolerance);
+    g->omega_max = g->omega_nominal * (1.f + tolerance);
+    g->kp = 0.05f;   // Found by experiment. A larger ki lets the symbol
+    g->ki = 0.0002f; // period wander off while there is only noise.
+    g->t = 1.f;
+    g->power = 1e-6f;
+}
+
+/* Cubic Lagrange interpolation between x[1] (mu = 0) and x[2] (mu = 1) in Farrow structure. */
+static inline float gardner_timing_interpolate(const float *x, float mu)
+{
+    const float c3 = (x[3] - x[0]) * (1.f/6.f) + (x[1] - x[2]) * 0.5f;
+    const float c2 = (x[0] + x[2]) * 0.5f - x[1];
+    const float c1 = x[2] - x[0] * (1.f/3.f) - x[1] * 0.5f - x[3] * (1.f/6.f);
+
+    return ((c3*mu + c2)*mu + c1)*mu + x[1];
+}
+
+/** @brief Run the loop over n input samples.
+ *
+ *  symbols[m] gets the signal at the m-th symbol instant found, at[m] the
+ *  index of the input sample the symbol has been decided at. Both have to
+ *  hold n / (decimation * omega_min) + 1 entries.
+ *
+ *  @return Number of symbols found.
+ */
+static size_t gardner_timing_process(struct gardner_timing *g, const float *x, size_t n, float *symbols, size_t *at)
+{
+    size_t m = 0;
+    size_t k;
+
+    for (k = g->phase; k < n; k += g->decimation)
+    {
+        g->x[0] = g->x[1];
+        g->x[1] = g->x[2];
+        g->x[2] = g->x[3];
+        g->x[3] = x[k];
+        g->t -= 1.f;
+
+        while (g->t < 1.f)
+        {
+            const float mu = (g->t < 0.f) ? 0.f : g->t;
+            const float y = gardner_timing_interpolate(g->x, mu);
+
+            g->t += 0.5f * g->omega;
+
+            if (g->midpoint)
+            {
+                g->y_mid = y;
+                g->midpoint = 0;
+                continue;
+            }
+
+            // Positive error: the strobes are late.
+            g->power += 0.05f * (y*y - g->power);
+            float e = g->y_mid * (y - g->y_prev) / (2.f * g->power);
+            if (e > 1.f) e = 1.f;
+            else if (e < -1.f) e = -1.f;
+
+            g->omega -= g->ki * e * g->omega_nominal;
+            if (g->omega < g->omega_min) g->omega = g->omega_min;
+            else if (g->omega > g->omega_max) g->omega = g->omega_max;
+            g->t -= g->kp * e * g->omega;
+
+            g->y_prev = y;
+            g->midpoint = 1;
+
+            symbols[m] = y;
+            at[m] = k;
+            m++;
+        }
+    }
+
+    g->phase = k - n;
+
+    return m;
+}
+
+#endif /* GARDNER_TIMING_H */
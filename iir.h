@@ -32,6 +32,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "dsp_kernels.h"
 
 typedef struct
 {
@@ -76,5 +77,13 @@ float iirf(float sample, IIRF_FILTER *filter)
     return sample;
 }
 
+void iirf_block(const float *x, float *y, size_t n, IIRF_FILTER *filter);
+
+/* Filters n samples at once. x and y may be the same buffer. */
+void iirf_block(const float *x, float *y, size_t n, IIRF_FILTER *filter)
+{
+    dsp_iir(x, y, n, filter->b, filter->a, filter->gain, filter->hist, filter->sections);
+}
+
 #endif /* IIR_H */
 
@@ -0,0 +1,457 @@
+#ifndef MBUS_RECORDS_H
+#define MBUS_RECORDS_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Parser of the M-Bus data records (DIF, DIFEs, VIF, VIFEs and the data) in
+ * the application layer of a datagram. The records point into the datagram;
+ * nothing is copied. The primary VIFs and the most common ones of the
+ * extension tables 0xFB and 0xFD are looked up in tables giving the quantity,
+ * its unit and the power of ten to scale the value with. Combinable VIFEs
+ * are skipped.
+ *
+ * A record is printed as name[_max|_min|_err][@storage][#tariff][/subunit]=value
+ * with the value scaled to the unit, e.g. "volume@1=123.456m3". Records of
+ * unknown VIFs are named after the code, e.g. "fd_3A".
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "telegram_writer.h"
+
+#define MBUS_RECORD_MAX_EXTENSIONS 10u
+#define MBUS_RECORD_FILTER_MAX 16u
+#define MBUS_VIF_TABLE_FB 0x100u // added to a VIFE of the first extension table
+#define MBUS_VIF_TABLE_FD 0x200u // added to a VIFE of the second extension table
+
+enum mbus_function { MBUS_INSTANT, MBUS_MAXIMUM, MBUS_MINIMUM, MBUS_ERROR_STATE };
+
+enum mbus_coding { MBUS_NO_DATA, MBUS_INTEGER, MBUS_BCD, MBUS_REAL, MBUS_VARIABLE };
+
+enum mbus_kind
+{
+    MBUS_NUMBER,
+    MBUS_DURATION, // the two lowest bits of the VIF select s, min, h or d
+    MBUS_DATE,     // type G
+    MBUS_DATE_TIME // type F
+};
+
+struct mbus_vif
+{
+    const char *name; // NULL for an unknown code
+    const char *unit;
+    int8_t exponent;
+    uint8_t kind;
+};
+
+struct mbus_record
+{
+    uint8_t dif;
+    enum mbus_function function;
+    uint64_t storage;
+    unsigned tariff;
+    unsigned subunit;
+    unsigned vif;          // without extension bit, plus MBUS_VIF_TABLE_* for the extension tables
+    struct mbus_vif type;
+    enum mbus_coding coding;
+    const uint8_t *data;   // the value as sent, least significant byte first
+    size_t length;
+    int negative;          // BCD of variable length with a negative sign
+};
+
+/* Records to print: quantity names (or "all"), each with a storage number or -1 for any. */
+struct mbus_record_filter
+{
+    const char *names[MBUS_RECORD_FILTER_MAX];
+    int64_t storages[MBUS_RECORD_FILTER_MAX];
+    size_t count;
+};
+
+/* Ranges of codes sharing a quantity; the exponent counts up from the first code of a range. */
+static const struct
+{
+    uint16_t first, last;
+    struct mbus_vif vif;
+} MBUS_VIF_RANGES[] =
+{
+    {0x00, 0x07, {"energy", "Wh", -3, MBUS_NUMBER}},
+    {0x08, 0x0F, {"energy", "J", 0, MBUS_NUMBER}},
+    {0x10, 0x17, {"volume", "m3", -6, MBUS_NUMBER}},
+    {0x18, 0x1F, {"mass", "kg", -3, MBUS_NUMBER}},
+    {0x20, 0x23, {"on_time", "s", 0, MBUS_DURATION}},
+    {0x24, 0x27, {"operating_time", "s", 0, MBUS_DURATION}},
+    {0x28, 0x2F, {"power", "W", -3, MBUS_NUMBER}},
+    {0x30, 0x37, {"power", "J/h", 0, MBUS_NUMBER}},
+    {0x38, 0x3F, {"volume_flow", "m3/h", -6, MBUS_NUMBER}},
+    {0x40, 0x47, {"volume_flow", "m3/min", -7, MBUS_NUMBER}},
+    {0x48, 0x4F, {"volume_flow", "m3/s", -9, MBUS_NUMBER}},
+    {0x50, 0x57, {"mass_flow", "kg/h", -3, MBUS_NUMBER}},
+    {0x58, 0x5B, {"flow_temperature", "C", -3, MBUS_NUMBER}},
+    {0x5C, 0x5F, {"return_temperature", "C", -3, MBUS_NUMBER}},
+    {0x60, 0x63, {"temperature_difference", "K", -3, MBUS_NUMBER}},
+    {0x64, 0x67, {"external_temperature", "C", -3, MBUS_NUMBER}},
+    {0x68, 0x6B, {"pressure", "bar", -3, MBUS_NUMBER}},
+    {0x6C, 0x6C, {"date", "", 0, MBUS_DATE}},
+    {0x6D, 0x6D, {"date_time", "", 0, MBUS_DATE_TIME}},
+    {0x6E, 0x6E, {"hca_units", "", 0, MBUS_NUMBER}},
+    {0x70, 0x73, {"averaging_duration", "s", 0, MBUS_DURATION}},
+    {0x74, 0x77, {"actuality_duration", "s", 0, MBUS_DURATION}},
+    {0x78, 0x78, {"fabrication_no", "", 0, MBUS_NUMBER}},
+    {0x79, 0x79, {"enhanced_id", "", 0, MBUS_NUMBER}},
+    {0x7A, 0x7A, {"bus_address", "", 0, MBUS_NUMBER}},
+    {0x7C, 0x7C, {"plain_text", "", 0, MBUS_NUMBER}},
+    {0x7E, 0x7E, {"any", "", 0, MBUS_NUMBER}},
+    {0x7F, 0x7F, {"manufacturer", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FB + 0x00, MBUS_VIF_TABLE_FB + 0x01, {"energy", "Wh", 5, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FB + 0x08, MBUS_VIF_TABLE_FB + 0x09, {"energy", "J", 8, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FB + 0x10, MBUS_VIF_TABLE_FB + 0x11, {"volume", "m3", 2, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FB + 0x18, MBUS_VIF_TABLE_FB + 0x19, {"mass", "kg", 5, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FB + 0x28, MBUS_VIF_TABLE_FB + 0x29, {"power", "W", 5, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FB + 0x30, MBUS_VIF_TABLE_FB + 0x31, {"power", "J/h", 8, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x08, MBUS_VIF_TABLE_FD + 0x08, {"access_no", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x09, MBUS_VIF_TABLE_FD + 0x09, {"medium", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x0A, MBUS_VIF_TABLE_FD + 0x0A, {"manufacturer", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x0B, MBUS_VIF_TABLE_FD + 0x0B, {"parameter_set", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x0C, MBUS_VIF_TABLE_FD + 0x0C, {"model_version", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x0D, MBUS_VIF_TABLE_FD + 0x0D, {"hardware_version", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x0E, MBUS_VIF_TABLE_FD + 0x0E, {"firmware_version", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x0F, MBUS_VIF_TABLE_FD + 0x0F, {"software_version", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x10, MBUS_VIF_TABLE_FD + 0x10, {"customer_location", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x11, MBUS_VIF_TABLE_FD + 0x11, {"customer", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x16, MBUS_VIF_TABLE_FD + 0x16, {"password", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x17, MBUS_VIF_TABLE_FD + 0x17, {"error_flags", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x1A, MBUS_VIF_TABLE_FD + 0x1A, {"digital_output", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x1B, MBUS_VIF_TABLE_FD + 0x1B, {"digital_input", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x3A, MBUS_VIF_TABLE_FD + 0x3A, {"dimensionless", "", 0, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x40, MBUS_VIF_TABLE_FD + 0x4F, {"voltage", "V", -9, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x50, MBUS_VIF_TABLE_FD + 0x5F, {"current", "A", -12, MBUS_NUMBER}},
+    {MBUS_VIF_TABLE_FD + 0x74, MBUS_VIF_TABLE_FD + 0x74, {"battery_lifetime", "d", 0, MBUS_NUMBER}},
+};
+
+/* Indexed by mbus_record.vif. */
+static struct mbus_vif MBUS_VIF_TABLE[3*0x80];
+
+static void mbus_records_init_tables(void)
+{
+    for (size_t k = 0; k < sizeof(MBUS_VIF_RANGES)/sizeof(MBUS_VIF_RANGES[0]); k++)
+    {
+        for (unsigned code = MBUS_VIF_RANGES[k].first; code <= MBUS_VIF_RANGES[k].last; code++)
+        {
+            const unsigned index = (code & 0x7Fu) + 0x80u*(code >> 8);
+
+            MBUS_VIF_TABLE[index] = MBUS_VIF_RANGES[k].vif;
+            MBUS_VIF_TABLE[index].exponent += (int8_t)(code - MBUS_VIF_RANGES[k].first);
+        }
+    }
+}
+
+/* Data length by the data field of the DIF, the variable length excluded. */
+static const uint8_t MBUS_DATA_LENGTH[16] = { 0, 1, 2, 3, 4, 4, 6, 8, 0, 1, 2, 3, 4, 0, 6, 0 };
+static const uint8_t MBUS_DATA_CODING[16] =
+{
+    MBUS_NO_DATA, MBUS_INTEGER, MBUS_INTEGER, MBUS_INTEGER, MBUS_INTEGER, MBUS_REAL, MBUS_INTEGER, MBUS_INTEGER,
+    MBUS_NO_DATA, MBUS_BCD, MBUS_BCD, MBUS_BCD, MBUS_BCD, MBUS_VARIABLE, MBUS_BCD, MBUS_NO_DATA,
+};
+
+/** @brief Parse the record at *pos and advance *pos behind it.
+ *  @return 1 if a record was parsed, 0 at the end of the records, -1 if the data is malformed.
+ */
+static int mbus_record_next(struct mbus_record *r, const uint8_t *data, size_t length, size_t *pos)
+{
+    size_t p = *pos;
+
+    while (p < length && data[p] == 0x2F) p++; // idle filler
+
+    if (p >= length || (data[p] & 0x0Fu) == 0x0Fu)
+    {   // Manufacturer specific data or "more records follow" end the records.
+        *pos = length;
+        return 0;
+    }
+
+    r->dif = data[p++];
+    r->function = (enum mbus_function)((r->dif >> 4) & 3u);
+    r->storage = (r->dif >> 6) & 1u;
+    r->tariff = 0;
+    r->subunit = 0;
+
+    for (unsigned k = 0, extension = r->dif & 0x80u; extension; k++)
+    {
+        if (k == MBUS_RECORD_MAX_EXTENSIONS || p >= length) return -1;
+
+        const uint8_t dife = data[p++];
+        r->storage |= (uint64_t)(dife & 0x0Fu) << (1 + 4*k);
+        r->tariff |= ((dife >> 4) & 3u) << (2*k);
+        r->subunit |= ((dife >> 6) & 1u) << k;
+        extension = dife & 0x80u;
+    }
+
+    if (p >= length) return -1;
+
+    uint8_t vif = data[p++];
+    r->vif = vif & 0x7Fu;
+
+    if ((vif == 0xFB || vif == 0xFD) && p < length)
+    {
+        r->vif = (data[p] & 0x7Fu) + (vif == 0xFB ? MBUS_VIF_TABLE_FB : MBUS_VIF_TABLE_FD);
+        vif = data[p++];
+    }
+
+    for (unsigned k = 0; vif & 0x80u; k++)
+    {
+        if (k == MBUS_RECORD_MAX_EXTENSIONS || p >= length) return -1;
+        vif = data[p++];
+    }
+
+    if (r->vif == 0x7C)
+    {   // The unit is given as text behind the VIFEs.
+        if (p >= length || p + 1 + data[p] > length) return -1;
+        p += 1 + data[p];
+    }
+
+    r->type = MBUS_VIF_TABLE[(r->vif & 0x7Fu) + 0x80u*(r->vif >> 8)];
+    r->coding = (enum mbus_coding)MBUS_DATA_CODING[r->dif & 0x0Fu];
+    r->length = MBUS_DATA_LENGTH[r->dif & 0x0Fu];
+    r->negative = 0;
+
+    if (r->coding == MBUS_VARIABLE)
+    {
+        if (p >= length) return -1;
+
+        const uint8_t lvar = data[p++];
+        if (lvar < 0xC0)
+        {   // text
+            r->length = lvar;
+        }
+        else if (lvar < 0xE0)
+        {   // BCD of 2*(lvar & 0x0F) digits, 0xD0... negative
+            if ((lvar & 0x0Fu) > 9) return -1;
+            r->length = lvar & 0x0Fu;
+            r->coding = MBUS_BCD;
+            r->negative = lvar >= 0xD0;
+        }
+        else if (lvar < 0xF0)
+        {   // binary number, kept as raw bytes if longer than 64 bits
+            r->length = lvar - 0xE0u;
+            if (r->length <= 8) r->coding = MBUS_INTEGER;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+
+    if (p + r->length > length) return -1;
+
+    r->data = &data[p];
+    *pos = p + r->length;
+    return 1;
+}
+
+/** @brief The value of an integer or BCD record, not scaled.
+ *  @return 0 on success, -1 if a BCD digit is invalid.
+ */
+static int mbus_record_integer(const struct mbus_record *r, int64_t *value)
+{
+    uint64_t v = 0;
+
+    if (r->coding == MBUS_INTEGER)
+    {
+        for (size_t k = r->length; k > 0; k--) v = (v << 8) | r->data[k - 1];
+        if (r->length > 0 && r->length < 8 && (r->data[r->length - 1] & 0x80u)) v |= ~0ull << (8*r->length);
+
+        *value = (int64_t)v;
+        return 0;
+    }
+
+    int negative = 0;
+
+    for (size_t k = r->length; k > 0; k--)
+    {
+        const unsigned high = r->data[k - 1] >> 4, low = r->data[k - 1] & 0x0Fu;
+
+        if (k == r->length && high == 0x0F) negative = 1;
+        else if (high > 9) return -1;
+        else v = 10*v + high;
+
+        if (low > 9) return -1;
+        v = 10*v + low;
+    }
+
+    *value = (negative || r->negative) ? -(int64_t)v : (int64_t)v;
+    return 0;
+}
+
+/** @brief Parse a comma separated list like "volume@0,flow_temperature"; spec is modified and referenced.
+ *  @return 0 on success, -1 if the list is malformed or too long.
+ */
+static int mbus_record_filter_parse(struct mbus_record_filter *filter, char *spec)
+{
+    filter->count = 0;
+
+    for (char *name = strtok(spec, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        char *at = strchr(name, '@');
+        char *end;
+
+        if (filter->count == MBUS_RECORD_FILTER_MAX) return -1;
+
+        filter->storages[filter->count] = -1;
+        if (at != NULL)
+        {
+            *at = '\0';
+            filter->storages[filter->count] = (int64_t)strtoull(at + 1, &end, 10);
+            if (end == at + 1 || *end != '\0') return -1;
+        }
+        filter->names[filter->count++] = name;
+    }
+
+    return filter->count > 0 ? 0 : -1;
+}
+
+static int mbus_record_filter_matches(const struct mbus_record_filter *filter, const struct mbus_record *r)
+{
+    for (size_t k = 0; k < filter->count; k++)
+    {
+        if (strcmp(filter->names[k], "all") == 0) return 1;
+        if (r->type.name != NULL && strcmp(filter->names[k], r->type.name) == 0 &&
+            (filter->storages[k] < 0 || (uint64_t)filter->storages[k] == r->storage)) return 1;
+    }
+    return 0;
+}
+
+/* Prints value * 10^exponent without rounding. */
+static void mbus_print_scaled(struct telegram_line *line, int64_t value, int exponent)
+{
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    char digits[48];
+    int n = snprintf(digits, sizeof(digits), "%llu", (unsigned long long)magnitude);
+
+    if (value < 0) telegram_line_putc(line, '-');
+
+    if (exponent >= 0)
+    {
+        telegram_line_puts(line, digits);
+        for (int k = 0; k < exponent && magnitude != 0; k++) telegram_line_putc(line, '0');
+        return;
+    }
+
+    const int point = n + exponent; // digits in front of the decimal point
+    if (point <= 0)
+    {
+        telegram_line_puts(line, "0.");
+        for (int k = point; k < 0; k++) telegram_line_putc(line, '0');
+        telegram_line_puts(line, digits);
+    }
+    else
+    {
+        telegram_line_printf(line, "%.*s.%s", point, digits, &digits[point]);
+    }
+}
+
+static void mbus_record_print_value(struct telegram_line *line, const struct mbus_record *r)
+{
+    static const int32_t DURATION_SECONDS[4] = { 1, 60, 3600, 86400 };
+    const uint8_t *d = r->data;
+    int64_t value;
+
+    if (r->type.kind == MBUS_DATE && r->coding == MBUS_INTEGER && r->length == 2)
+    {
+        const unsigned year = ((d[0] & 0xE0u) >> 5) | ((d[1] & 0xF0u) >> 1);
+        telegram_line_printf(line, "%04u-%02u-%02u", year + (year < 81 ? 2000 : 1900), d[1] & 0x0Fu, d[0] & 0x1Fu);
+    }
+    else if (r->type.kind == MBUS_DATE_TIME && r->coding == MBUS_INTEGER && r->length == 4)
+    {
+        const unsigned year = ((d[2] & 0xE0u) >> 5) | ((d[3] & 0xF0u) >> 1);
+        telegram_line_printf(line, "%04u-%02u-%02uT%02u:%02u", year + (year < 81 ? 2000 : 1900), d[3] & 0x0Fu, d[2] & 0x1Fu, d[1] & 0x1Fu, d[0] & 0x3Fu);
+    }
+    else if (r->coding == MBUS_REAL && r->length == 4)
+    {
+        float f;
+        memcpy(&f, d, sizeof(f));
+        telegram_line_printf(line, "%g", (double)f * pow(10., r->type.exponent));
+    }
+    else if ((r->coding == MBUS_INTEGER || r->coding == MBUS_BCD) && mbus_record_integer(r, &value) == 0)
+    {
+        if (r->type.kind == MBUS_DURATION) value *= DURATION_SECONDS[r->vif & 3u];
+        mbus_print_scaled(line, value, r->type.name ? r->type.exponent : 0);
+    }
+    else if (r->coding == MBUS_VARIABLE)
+    {   // Text is sent last character first.
+        for (size_t k = r->length; k > 0; k--)
+        {
+            const int c = d[k - 1];
+            telegram_line_putc(line, (c >= 0x21 && c < 0x7F && c != ';' && c != ',') ? c : '_');
+        }
+        return;
+    }
+    else
+    {   // Invalid BCD digits or an unexpected length for a date, printed as sent.
+        telegram_line_puts(line, "0x");
+        for (size_t k = r->length; k > 0; k--) telegram_line_hex(line, &d[k - 1], 1);
+        return;
+    }
+
+    if (r->type.name) telegram_line_puts(line, r->type.unit);
+}
+
+/** @brief Print the records passing the filter, separated by commas; a "?" marks malformed data. */
+static void mbus_records_print(struct telegram_line *line, const uint8_t *data, size_t length, const struct mbus_record_filter *filter)
+{
+    static const char *const FUNCTION_SUFFIX[4] = { "", "_max", "_min", "_err" };
+    struct mbus_record r;
+    size_t pos = 0;
+    int result, first = 1;
+
+    while ((result = mbus_record_next(&r, data, length, &pos)) == 1)
+    {
+        if (r.coding == MBUS_NO_DATA) continue;
+
+        if (!mbus_record_filter_matches(filter, &r)) continue;
+
+        telegram_line_puts(line, first ? "" : ",");
+        first = 0;
+
+        if (r.type.name) telegram_line_puts(line, r.type.name);
+        else telegram_line_printf(line, "%s_%02X", r.vif >= MBUS_VIF_TABLE_FD ? "fd" : r.vif >= MBUS_VIF_TABLE_FB ? "fb" : "vif", r.vif & 0x7Fu);
+
+        telegram_line_puts(line, FUNCTION_SUFFIX[r.function]);
+        if (r.storage) telegram_line_printf(line, "@%llu", (unsigned long long)r.storage);
+        if (r.tariff) telegram_line_printf(line, "#%u", r.tariff);
+        if (r.subunit) telegram_line_printf(line, "/%u", r.subunit);
+        telegram_line_putc(line, '=');
+
+        mbus_record_print_value(line, &r);
+    }
+
+    if (result < 0) telegram_line_printf(line, "%s?", first ? "" : ",");
+}
+
+#endif /* MBUS_RECORDS_H */
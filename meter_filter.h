@@ -0,0 +1,253 @@
+#ifndef METER_FILTER_H
+#define METER_FILTER_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Allowlist and denylist of meters. A meter is given by its manufacturer and
+ * ident number, the bytes 2...7 of a datagram. The decoders check a datagram
+ * as soon as these fields are received and drop an unwanted one right away.
+ *
+ * A list file holds one meter per line: the ident number as printed in the
+ * output (8 hex digits), optionally preceded by the 3 letter manufacturer
+ * code; empty lines and lines starting with '#' are ignored:
+ *
+ *   # water meters of house 12
+ *   KAM 12345678
+ *   00112233
+ *
+ * The lists are kept in open addressing hash sets and may be reloaded at any
+ * time from another thread.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#define METER_FILTER_HEADER_LENGTH 8u // L, C, M and the ident number of A
+#define METER_ANY_MANUFACTURER 0xFFFFu
+#define METER_SET_USED (1ull << 63)
+
+struct meter_set
+{
+    uint64_t *keys; // 0 is an empty slot
+    size_t mask;    // number of slots - 1
+    size_t count;
+};
+
+static inline uint64_t meter_key(uint16_t manufacturer, uint32_t ident)
+{
+    return METER_SET_USED | ((uint64_t)manufacturer << 32) | ident;
+}
+
+static inline size_t meter_set_slot(const struct meter_set *set, uint64_t key)
+{
+    return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & set->mask;
+}
+
+static int meter_set_contains(const struct meter_set *set, uint16_t manufacturer, uint32_t ident)
+{
+    const uint64_t key = meter_key(manufacturer, ident);
+
+    for (size_t k = meter_set_slot(set, key); set->keys[k] != 0; k = (k + 1) & set->mask)
+    {
+        if (set->keys[k] == key) return 1;
+    }
+    return 0;
+}
+
+static void meter_set_insert(struct meter_set *set, uint64_t key)
+{
+    size_t k;
+
+    for (k = meter_set_slot(set, key); set->keys[k] != 0; k = (k + 1) & set->mask)
+    {
+        if (set->keys[k] == key) return;
+    }
+    set->keys[k] = key;
+    set->count++;
+}
+
+static void meter_set_free(struct meter_set *set)
+{
+    free(set->keys);
+    set->keys = NULL;
+    set->mask = 0;
+    set->count = 0;
+}
+
+/* Manufacturer code as sent over the air: three letters of 5 bits each. */
+static int meter_parse_manufacturer(const char *s, uint16_t *manufacturer)
+{
+    if (strlen(s) != 3) return -1;
+
+    unsigned code = 0;
+    for (unsigned k = 0; k < 3; k++)
+    {
+        const int c = toupper((unsigned char)s[k]);
+        if (c < 'A' || c > 'Z') return -1;
+        code = (code << 5) | (unsigned)(c - 'A' + 1);
+    }
+
+    *manufacturer = (uint16_t)code;
+    return 0;
+}
+
+static int meter_parse_ident(const char *s, uint32_t *ident)
+{
+    char *end;
+
+    if (strlen(s) != 8) return -1;
+
+    const unsigned long value = strtoul(s, &end, 16);
+    if (*end != '\0') return -1;
+
+    *ident = (uint32_t)value;
+    return 0;
+}
+
+/** @brief Load a list file into a new set.
+ *  @return 0 on success, -1 if the file cannot be read or has a bad line.
+ */
+static int meter_set_load(struct meter_set *set, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+    size_t lines = 0, capacity = 16;
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot open meter list \"%s\"!\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) lines++;
+    while (capacity < 2*lines) capacity *= 2;
+    rewind(file);
+
+    set->keys = calloc(capacity, sizeof(set->keys[0]));
+    set->mask = capacity - 1;
+    set->count = 0;
+
+    if (set->keys == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: out of memory loading meter list \"%s\"!\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    for (size_t number = 1; fgets(line, sizeof(line), file) != NULL; number++)
+    {
+        char first[16], second[16];
+        uint16_t manufacturer = METER_ANY_MANUFACTURER;
+        uint32_t ident;
+        const int fields = sscanf(line, "%15s %15s", first, second);
+
+        if (fields <= 0 || first[0] == '#') continue;
+
+        if ((fields == 1 && meter_parse_ident(first, &ident) == 0) ||
+            (fields == 2 && meter_parse_manufacturer(first, &manufacturer) == 0 && meter_parse_ident(second, &ident) == 0))
+        {
+            meter_set_insert(set, meter_key(manufacturer, ident));
+            continue;
+        }
+
+        fprintf(stderr, "rtl_wmbus: bad meter in \"%s\", line %zu: %s", path, number, line);
+        fclose(file);
+        meter_set_free(set);
+        return -1;
+    }
+
+    fclose(file);
+    return 0;
+}
+
+
+struct meter_filter
+{
+    const char *allow_path; // NULL if no allowlist is given
+    const char *deny_path;  // NULL if no denylist is given
+    struct meter_set allow;
+    struct meter_set deny;
+    pthread_mutex_t lock;   // held while the sets are looked up or replaced
+};
+
+static struct meter_filter meter_filter = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/** @brief (Re)load the lists; the old ones are kept if one of the files cannot be loaded.
+ *  @return 0 on success, -1 otherwise.
+ */
+static int meter_filter_load(struct meter_filter *filter)
+{
+    struct meter_set allow = {0}, deny = {0};
+
+    if (filter->allow_path && meter_set_load(&allow, filter->allow_path) != 0) return -1;
+    if (filter->deny_path && meter_set_load(&deny, filter->deny_path) != 0)
+    {
+        meter_set_free(&allow);
+        return -1;
+    }
+
+    pthread_mutex_lock(&filter->lock);
+    meter_set_free(&filter->allow);
+    meter_set_free(&filter->deny);
+    filter->allow = allow;
+    filter->deny = deny;
+    pthread_mutex_unlock(&filter->lock);
+
+    fprintf(stderr, "rtl_wmbus: %zu meters allowed, %zu meters denied\n", allow.count, deny.count);
+    return 0;
+}
+
+static int meter_filter_enabled(const struct meter_filter *filter)
+{
+    return filter->allow_path != NULL || filter->deny_path != NULL;
+}
+
+/** @brief Check the header of a datagram, at least METER_FILTER_HEADER_LENGTH bytes. */
+static int meter_filter_wanted(struct meter_filter *filter, const uint8_t *header)
+{
+    if (!meter_filter_enabled(filter)) return 1;
+
+    const uint16_t manufacturer = (uint16_t)(header[2] | (header[3] << 8));
+    const uint32_t ident = (uint32_t)header[4] | ((uint32_t)header[5] << 8) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+    int wanted = 1;
+
+    pthread_mutex_lock(&filter->lock);
+    if (filter->allow_path && !meter_set_contains(&filter->allow, manufacturer, ident) &&
+                              !meter_set_contains(&filter->allow, METER_ANY_MANUFACTURER, ident)) wanted = 0;
+    if (filter->deny_path && (meter_set_contains(&filter->deny, manufacturer, ident) ||
+                              meter_set_contains(&filter->deny, METER_ANY_MANUFACTURER, ident))) wanted = 0;
+    pthread_mutex_unlock(&filter->lock);
+
+    return wanted;
+}
+
+#endif /* METER_FILTER_H */
@@ -0,0 +1,215 @@
+#ifndef METER_LIMIT_H
+#define METER_LIMIT_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Per meter rate limiting. Many meters send the same readings every few
+ * seconds. A table of all meters seen keeps a hash of the last printed
+ * payload and the time it was printed, so a datagram can be suppressed if
+ * its payload has not changed, or if the meter was printed less than an
+ * interval ago. Only datagrams with a valid CRC are limited; the others
+ * don't identify a meter reliably.
+ *
+ * The payload is found by wmbus_frame_parse(): the CI field, the status and
+ * configuration of the transport layer header and the application data are
+ * compared. The extended link layer and the access numbers count up with
+ * every datagram and are left out, so they don't make every datagram a
+ * change. Payloads in security mode 5 are compared after decryption; without
+ * a key (-k) the ciphertext differs every time because the access number is
+ * part of the IV, so "change" cannot suppress such datagrams.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "telegram.h"
+#include "meter_filter.h"
+#include "wmbus_frame.h"
+
+struct meter_limit_entry
+{
+    uint64_t key;     // meter_key(), 0 for an empty slot
+    uint64_t payload; // hash of the last printed payload
+    uint64_t last;    // sample time the meter was last printed
+    unsigned printed;
+    unsigned suppressed;
+};
+
+struct meter_limit
+{
+    int change_only;  // print a meter only if its payload has changed
+    uint64_t interval; // in samples; print a meter at most once per interval, 0 for no limit
+    struct meter_limit_entry *entries;
+    size_t mask;      // number of slots - 1
+    size_t count;     // meters seen
+    uint64_t printed;
+    uint64_t suppressed;
+    pthread_mutex_t lock; // the statistics may be printed by another thread
+};
+
+static struct meter_limit meter_limit = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static void meter_limit_init(struct meter_limit *m, int change_only, uint64_t interval)
+{
+    m->change_only = change_only;
+    m->interval = interval;
+    m->mask = 255;
+    m->count = 0;
+    m->entries = calloc(m->mask + 1, sizeof(m->entries[0]));
+
+    if (m->entries == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: out of memory!\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t meter_limit_hash(uint64_t h, const uint8_t *data, size_t n)
+{
+    for (size_t k = 0; k < n; k++) h = (h ^ data[k]) * 0x100000001B3ull;
+    return h;
+}
+
+static uint64_t meter_limit_payload_hash(const struct telegram *t)
+{
+    const uint64_t h = 0xCBF29CE484222325ull;
+    struct wmbus_frame f;
+
+    if (wmbus_frame_parse(&f, t->data, t->length) != 0) return meter_limit_hash(h, &t->data[10], t->length - 10);
+
+    const uint8_t header[] = { (uint8_t)f.ci, (uint8_t)f.tpl, f.status, (uint8_t)f.config, (uint8_t)(f.config >> 8), (uint8_t)f.decryption };
+
+    return meter_limit_hash(meter_limit_hash(h, header, f.tpl == WMBUS_TPL_NONE ? 2 : sizeof(header)), f.payload, f.payload_length);
+}
+
+static struct meter_limit_entry *meter_limit_find(struct meter_limit *m, uint64_t key)
+{
+    size_t k = meter_set_slot(&(struct meter_set){ .mask = m->mask }, key);
+
+    while (m->entries[k].key != 0 && m->entries[k].key != key) k = (k + 1) & m->mask;
+
+    return &m->entries[k];
+}
+
+static void meter_limit_grow(struct meter_limit *m)
+{
+    struct meter_limit_entry *old = m->entries;
+    const size_t slots = m->mask + 1;
+
+    m->mask = 2*slots - 1;
+    m->entries = calloc(2*slots, sizeof(m->entries[0]));
+
+    if (m->entries == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: out of memory!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t k = 0; k < slots; k++)
+    {
+        if (old[k].key != 0) *meter_limit_find(m, old[k].key) = old[k];
+    }
+    free(old);
+}
+
+/** @return 1 if the datagram is to be printed. */
+static int meter_limit_pass(struct meter_limit *m, const struct telegram *t, uint64_t now)
+{
+    if (!t->crc_ok || t->length < WMBUS_DLL_LENGTH) return 1; // the payload hash starts after the DLL header
+
+    const uint64_t key = meter_key((uint16_t)(t->data[2] | (t->data[3] << 8)),
+                                   (uint32_t)t->data[4] | ((uint32_t)t->data[5] << 8) | ((uint32_t)t->data[6] << 16) | ((uint32_t)t->data[7] << 24));
+    const uint64_t payload = m->change_only ? meter_limit_payload_hash(t) : 0;
+    int pass = 1;
+
+    pthread_mutex_lock(&m->lock);
+
+    if (2*(m->count + 1) > m->mask + 1) meter_limit_grow(m);
+
+    struct meter_limit_entry *e = meter_limit_find(m, key);
+
+    if (e->key == 0)
+    {
+        e->key = key;
+        m->count++;
+    }
+    else if ((m->change_only && payload == e->payload) || (m->interval && now - e->last < m->interval))
+    {
+        pass = 0;
+    }
+
+    if (pass)
+    {
+        e->payload = payload;
+        e->last = now;
+        e->printed++;
+        m->printed++;
+    }
+    else
+    {
+        e->suppressed++;
+        m->suppressed++;
+    }
+
+    pthread_mutex_unlock(&m->lock);
+    return pass;
+}
+
+/* Installed as telegram_sink. */
+static void meter_limit_output(const struct telegram *t)
+{
+    if (meter_limit_pass(&meter_limit, t, telegram_sample(t))) telegram_emit(t);
+}
+
+/* Prints the totals and, if verbose, the counts of every meter. */
+static void meter_limit_print_statistics(struct meter_limit *m, FILE *stream, int verbose)
+{
+    pthread_mutex_lock(&m->lock);
+
+    if (verbose)
+    {
+        for (size_t k = 0; k <= m->mask; k++)
+        {
+            const struct meter_limit_entry *e = &m->entries[k];
+            if (e->key == 0) continue;
+
+            const unsigned manufacturer = (unsigned)(e->key >> 32) & 0xFFFFu;
+            fprintf(stream, "rtl_wmbus: meter %c%c%c %08X: %u printed, %u suppressed\n",
+                    '@' + ((manufacturer >> 10) & 0x1F), '@' + ((manufacturer >> 5) & 0x1F), '@' + (manufacturer & 0x1F),
+                    (unsigned)(e->key & 0xFFFFFFFFu), e->printed, e->suppressed);
+        }
+    }
+
+    fprintf(stream, "rtl_wmbus: %llu datagrams printed, %llu suppressed, %zu meters\n",
+            (unsigned long long)m->printed, (unsigned long long)m->suppressed, m->count);
+
+    pthread_mutex_unlock(&m->lock);
+}
+
+#endif /* METER_LIMIT_H */
@@ -32,6 +32,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
+#include "dsp_kernels.h"
 
 typedef struct
 {
@@ -53,6 +55,38 @@ float mavgi(int sample, MAVGI_FILTER *filter)
     return (float)filter->sum / filter->length;
 }
 
+typedef struct
+{
+    size_t i; // samples passed since the last output
+    float *hist; // length-1 past samples followed by room for DSP_BLOCK_SIZE new ones
+
+    const size_t length;
+} MAVGI_BLOCK_FILTER;
+
+size_t mavgi_decimate(const float *x, size_t n, size_t decimation, float *y, MAVGI_BLOCK_FILTER *filter);
+
+/* Filters n <= DSP_BLOCK_SIZE samples and keeps every decimation-th output
+   only. Gives the same outputs as mavgi() called for every sample and the
+   result taken after each decimation-th call. Returns the number of outputs. */
+size_t mavgi_decimate(const float *x, size_t n, size_t decimation, float *y, MAVGI_BLOCK_FILTER *filter)
+{
+    const size_t first = decimation - 1 - filter->i;
+    size_t outputs = 0;
+
+    memcpy(&filter->hist[filter->length-1], x, n * sizeof(x[0]));
+
+    if (first < n)
+    {
+        outputs = (n - 1 - first) / decimation + 1;
+        dsp_moving_average(&filter->hist[first], filter->length, decimation, y, outputs);
+    }
+
+    filter->i = (filter->i + n) % decimation;
+    memmove(filter->hist, &filter->hist[n], (filter->length-1) * sizeof(x[0]));
+
+    return outputs;
+}
+
 #if 0
 static int test_mavgi(void)
 {
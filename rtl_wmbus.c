@@ -23,6 +23,10 @@
  * SUCH DAMAGE.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // sendmmsg()
+#endif
+
 #include <getopt.h>
 #include <stdint.h>
 #include <limits.h>
@@ -33,6 +37,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <fixedptc/fixedptc.h>
 
 #if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
@@ -50,6 +55,15 @@
 #include "rtl_wmbus_util.h"
 #include "t1_c1_packet_decoder.h"
 #include "s1_packet_decoder.h"
+#include "sync_detector.h"
+#include "gardner_timing.h"
+#include "sync_correlator.h"
+#include "squelch.h"
+#include "burst_queue.h"
+#include "telegram_dedup.h"
+#include "meter_limit.h"
+#include "telegram_queue.h"
+#include "wmbus_frame.h"
 
 #if WINDOWS_BUILD == 1
 #define CHECK_FLOW 0
@@ -67,6 +81,9 @@ static inline void STOP_ALARM(void)  {}
 #include <signal.h>
 #include <unistd.h>
 #include "net_support.h"
+#include "telegram_store.h"
+#include "telegram_socket.h"
+#include "telegram_ring.h"
 
 static inline void START_ALARM(void) { alarm(2); }
 static inline void STOP_ALARM(void)  { alarm(0); }
@@ -76,6 +93,22 @@ static void sig_alarm_handler(int signo)
     fprintf(stderr, "rtl_wmbus: exiting since incoming data stopped flowing!\n");
     exit(EXIT_FAILURE);
 }
+
+static volatile sig_atomic_t meter_filter_reload_requested = 0;
+
+static void sig_hup_handler(int signo)
+{
+    (void)signo;
+    meter_filter_reload_requested = 1;
+}
+
+static volatile sig_atomic_t statistics_requested = 0;
+
+static void sig_usr1_handler(int signo)
+{
+    (void)signo;
+    statistics_requested = 1;
+}
 #endif
 
 #ifndef TIME2_ALGORITHM_ENABLED
@@ -86,6 +119,14 @@ static void sig_alarm_handler(int signo)
 #define RUN_LENGTH_ALGORITHM_ENABLED 1
 #endif
 
+#ifndef GARDNER_ALGORITHM_ENABLED
+#define GARDNER_ALGORITHM_ENABLED 1
+#endif
+
+#if !defined(MATCHED_FILTER_ALGORITHM_ENABLED)
+#define MATCHED_FILTER_ALGORITHM_ENABLED 1
+#endif
+
 #ifndef T1_C1_DC_OFFSET_ALPHA
 #define T1_C1_DC_OFFSET_ALPHA 0.999f
 #endif
@@ -95,63 +136,52 @@ static void sig_alarm_handler(int signo)
 #endif
 
 static const uint32_t ACCESS_CODE_T1_C1 = 0x543d;
-static const uint32_t ACCESS_CODE_T1_C1_BITMASK = 0xFFFFu;
-static const unsigned ACCESS_CODE_T1_C1_ERRORS = 0u; // 0 if no errors allowed
+static const unsigned ACCESS_CODE_T1_C1_BITS = 16u;
+static const unsigned ACCESS_CODE_T1_C1_ERRORS = 0u; // 0 if no errors allowed; default of option -e
 
 static const uint32_t ACCESS_CODE_S1 = 0x547696;
-static const uint32_t ACCESS_CODE_S1_BITMASK = 0xFFFFFFu;
-static const unsigned ACCESS_CODE_S1_ERRORS = 0u; // 0 if no errors allowed
+static const unsigned ACCESS_CODE_S1_BITS = 24u;
+static const unsigned ACCESS_CODE_S1_ERRORS = 0u; // 0 if no errors allowed; default of option -e
 
 
-/* deglitch_filter_t1_c1 has been calculated by a Python script as follows.
-   The filter is counting "1" among 7 bits and saying "1" if count("1") >= 3 else "0".
+/* The deglitch filters work on 64 samples at once. raw holds the raw bits,
+   the oldest one in bit 0; hist holds the 64 raw bits before them, the newest
+   one in bit 63. Bit k of the result is the filtered bit k of raw. */
+#define DEGLITCH_SHIFTED(raw, hist, s) (((raw) << (s)) | ((hist) >> (64 - (s))))
+
+/* The T1/C1 filter is counting "1" among the last 6 bits and saying "1" if count("1") >= 3 else "0".
    Notice here count("1") >= 3. (More intuitive in that case would be count("1") >= 3.5.)
    That forces the filter to put more "1" than "0" on the output, because RTL-SDR streams
    more "0" than "1" - i don't know why RTL-SDR do this.
-x = 'static const uint8_t deglitch_filter_t1_c1[128] = {'
-mod8 = 8
-
-for i in range(2**7):
-    s = '{0:07b};'.format(i)
-    val = '1' if bin(i).count("1") >= 3 else '0'
-    print(s[0] + ";" + s[1] + ";" + s[2] + ";" + s[3] + ";" + s[4] + ";" + s[5] + ";" + s[6] + ";;%d;;%s" % (bin(i).count("1"), val))
-
-    if i % 8 == 0: x += '\n\t'
-    x += val + ','
-
-x += '};\n'
-
-print(x)
-*/
-static const uint8_t deglitch_filter_t1_c1[128] =
-{
-    0,0,0,0,0,0,0,1,
-    0,0,0,1,0,1,1,1,
-    0,0,0,1,0,1,1,1,
-    0,1,1,1,1,1,1,1,
-    0,0,0,1,0,1,1,1,
-    0,1,1,1,1,1,1,1,
-    0,1,1,1,1,1,1,1,
-    1,1,1,1,1,1,1,1,
-    0,0,0,1,0,1,1,1,
-    0,1,1,1,1,1,1,1,
-    0,1,1,1,1,1,1,1,
-    1,1,1,1,1,1,1,1,
-    0,1,1,1,1,1,1,1,
-    1,1,1,1,1,1,1,1,
-    1,1,1,1,1,1,1,1,
-    1,1,1,1,1,1,1,1
-};
+   Two full adders count the ones of three bits each: count = s1 + s2 + 2*(c1 + c2). */
+static inline uint64_t deglitch_filter_t1_c1(uint64_t raw, uint64_t hist)
+{
+    const uint64_t x0 = raw;
+    const uint64_t x1 = DEGLITCH_SHIFTED(raw, hist, 1);
+    const uint64_t x2 = DEGLITCH_SHIFTED(raw, hist, 2);
+    const uint64_t x3 = DEGLITCH_SHIFTED(raw, hist, 3);
+    const uint64_t x4 = DEGLITCH_SHIFTED(raw, hist, 4);
+    const uint64_t x5 = DEGLITCH_SHIFTED(raw, hist, 5);
+
+    const uint64_t s1 = x0 ^ x1 ^ x2, c1 = (x0 & x1) | (x2 & (x0 ^ x1));
+    const uint64_t s2 = x3 ^ x4 ^ x5, c2 = (x3 & x4) | (x5 & (x3 ^ x4));
+
+    return (c1 & c2) | ((c1 | c2) & (s1 | s2));
+}
 
 /* 1) Force the filter to put more ones than zeros on the output.
    2) Zeros surrounded by ones are ones and vice versa.
-*/
-static const uint8_t deglitch_filter_s1[16] = {
-   // 0000 0001 0010 0011 0100 0101 0110 0111
-         0,   1,   0,   1,   0,   1,   1,   1,
-    // 1000 1001 1010 1011 1100 1101 1110 1111
-         0,   1,   1,   1,   1,   1,   1,   1
-};
+   Looks at the last 4 bits: the newest one or the majority of the three before. */
+static inline uint64_t deglitch_filter_s1(uint64_t raw, uint64_t hist)
+{
+    const uint64_t x1 = DEGLITCH_SHIFTED(raw, hist, 1);
+    const uint64_t x2 = DEGLITCH_SHIFTED(raw, hist, 2);
+    const uint64_t x3 = DEGLITCH_SHIFTED(raw, hist, 3);
+
+    return raw | (x1 & x2) | (x1 & x3) | (x2 & x3);
+}
+
+#undef DEGLITCH_SHIFTED
 
 
 //static FILE *demod_out = NULL;
@@ -162,36 +192,36 @@ static FILE *demod_out2_s1 = NULL;
 //static FILE *rawbits_out = NULL;
 
 
-static inline float moving_average_t1_c1(float sample, size_t i_or_q)
+static inline size_t moving_average_t1_c1(const float *x, size_t n, size_t decimation, float *y, size_t i_or_q)
 {
 #define COEFFS 8
-    static int i_hist[COEFFS];
-    static int q_hist[COEFFS];
+    static float i_hist[COEFFS-1 + DSP_BLOCK_SIZE];
+    static float q_hist[COEFFS-1 + DSP_BLOCK_SIZE];
 
-    static MAVGI_FILTER filter[2] =                                         // i/q
+    static MAVGI_BLOCK_FILTER filter[2] =                                   // i/q
     {
         {.length = COEFFS, .hist = i_hist}, //  0
         {.length = COEFFS, .hist = q_hist}  //  1
     };
 #undef COEFFS
 
-    return mavgi(sample, &filter[i_or_q]);
+    return mavgi_decimate(x, n, decimation, y, &filter[i_or_q]);
 }
 
-static inline float moving_average_s1(float sample, size_t i_or_q)
+static inline size_t moving_average_s1(const float *x, size_t n, size_t decimation, float *y, size_t i_or_q)
 {
 #define COEFFS 16
-    static int i_hist[COEFFS];
-    static int q_hist[COEFFS];
+    static float i_hist[COEFFS-1 + DSP_BLOCK_SIZE];
+    static float q_hist[COEFFS-1 + DSP_BLOCK_SIZE];
 
-    static MAVGI_FILTER filter[2] =                                         // i/q
+    static MAVGI_BLOCK_FILTER filter[2] =                                   // i/q
     {
         {.length = COEFFS, .hist = i_hist}, //  0
         {.length = COEFFS, .hist = q_hist}  //  1
     };
 #undef COEFFS
 
-    return mavgi(sample, &filter[i_or_q]);
+    return mavgi_decimate(x, n, decimation, y, &filter[i_or_q]);
 }
 
 static inline float lp_fir_butter_1600kHz_160kHz_200kHz_t1_c1(float sample, size_t i_or_q)
@@ -332,63 +362,97 @@ static inline float lp_ppffp_butter_1600kHz_160kHz_200kHz(float sample, size_t i
     return fixedpt_tofloat(ppffp(fixedpt_fromint(sample), &filter[i_or_q]));
 }
 
+/* Filter histories and clock recovery state of a signal chain. They are kept
+   in struct receiver_work instead of the filter functions, so that a chain can
+   be started afresh: the burst decoder runs every burst through several chains. */
+struct demodulator_t1_c1
+{
+    float lp_hist[11-1 + DSP_BLOCK_SIZE]; // lp_fir_butter_800kHz_100kHz_160kHz
+    float bp_hist[3*3];                   // bp_iir_cheb1_800kHz_90kHz_98kHz_102kHz_110kHz
+    float dc_x_old, dc_y_old;
+    float eq_b[9], eq_hist[9];            // equalizer_t1_c1
+    size_t eq_i;
+    int equalize;                         // set by the burst decoder for a pass with the equalizer
+    float rssi;
+    int16_t old_clock;
+    unsigned clock_lock;
+};
+
+struct demodulator_s1
+{
+    float lp_hist[46-1 + DSP_BLOCK_SIZE]; // lp_fir_butter_800kHz_32kHz_36kHz
+    float bp_hist[3*3];                   // bp_iir_cheb1_800kHz_22kHz_30kHz_34kHz_42kHz
+    float dc_x_old, dc_y_old;
+    float eq_b[19], eq_hist[19];          // equalizer_s1
+    size_t eq_i;
+    int equalize;                         // set by the burst decoder for a pass with the equalizer
+    float rssi;
+    int16_t old_clock;
+    unsigned clock_lock;
+};
+
+static void demodulator_t1_c1_reset(struct demodulator_t1_c1 *demod)
+{
+    memset(demod, 0, sizeof(*demod));
+    demod->eq_b[sizeof(demod->eq_b)/sizeof(demod->eq_b[0])/2 + 1] = 1.f;
+    demod->old_clock = INT16_MIN;
+}
+
+static void demodulator_s1_reset(struct demodulator_s1 *demod)
+{
+    memset(demod, 0, sizeof(*demod));
+    demod->eq_b[sizeof(demod->eq_b)/sizeof(demod->eq_b[0])/2 + 1] = 1.f;
+    demod->old_clock = INT16_MIN;
+}
 
-static inline float bp_iir_cheb1_800kHz_90kHz_98kHz_102kHz_110kHz(float sample)
+static inline void bp_iir_cheb1_800kHz_90kHz_98kHz_102kHz_110kHz(const float *x, float *y, size_t n, float *hist)
 {
 #define GAIN 1.874981046e-06
 #define SECTIONS 3
     static const float b[3*SECTIONS] = {1, 1.999994649, 0.9999946492, 1, -1.99999482, 0.9999948196, 1, 1.703868036e-07, -1.000010531, };
     static const float a[3*SECTIONS] = {1, -1.387139203, 0.9921518712, 1, -1.403492665, 0.9845934971, 1, -1.430055639, 0.9923856172, };
-    static float hist[3*SECTIONS] = {};
-
-    static IIRF_FILTER filter = {.sections = SECTIONS, .b = b, .a = a, .gain = GAIN, .hist = hist};
+    IIRF_FILTER filter = {.sections = SECTIONS, .b = b, .a = a, .gain = GAIN, .hist = hist};
 #undef SECTIONS
 #undef GAIN
 
-    return iirf(sample, &filter);
+    iirf_block(x, y, n, &filter);
 }
 
-static inline float bp_iir_cheb1_800kHz_22kHz_30kHz_34kHz_42kHz(float sample)
+static inline void bp_iir_cheb1_800kHz_22kHz_30kHz_34kHz_42kHz(const float *x, float *y, size_t n, float *hist)
 {
 #define GAIN 1.874981046e-06
 #define SECTIONS 3
     static const float b[3*SECTIONS] = {1, 1.999994187, 0.9999941867, 1, -1.999994026,0.9999940262, 1, -1.605750097e-07, -1.000011787, };
     static const float a[3*SECTIONS] = {1, -1.92151475, 0.9918135499, 1, -1.922481015,0.984593497, 1, -1.937432099, 0.9927241336, };
-    static float hist[3*SECTIONS] = {};
-
-    static IIRF_FILTER filter = {.sections = SECTIONS, .b = b, .a = a, .gain = GAIN, .hist = hist};
+    IIRF_FILTER filter = {.sections = SECTIONS, .b = b, .a = a, .gain = GAIN, .hist = hist};
 
 #undef SECTIONS
 #undef GAIN
 
-    return iirf(sample, &filter);
+    iirf_block(x, y, n, &filter);
 }
 
 
 
-static inline float lp_fir_butter_800kHz_100kHz_160kHz(float sample)
+static inline void lp_fir_butter_800kHz_100kHz_160kHz(const float *x, float *y, size_t n, float *hist)
 {
 #define COEFFS 11
     static float b[COEFFS] = {-0.00456638213, -0.002571450348, 0.02689425925, 0.1141330398, 0.2264456422, 0.2793297826, 0.2264456422, 0.1141330398, 0.02689425925, -0.002571450348, -0.00456638213, };
-    static float hist[COEFFS];
-
-    static FIRF_FILTER filter = {.length = COEFFS, .b = b, .hist = hist};
+    FIRF_BLOCK_FILTER filter = {.length = COEFFS, .b = b, .hist = hist};
 #undef COEFFS
 
-    return firf(sample, &filter);
+    firf_block(x, y, n, &filter);
 }
 
-static inline float lp_fir_butter_800kHz_32kHz_36kHz(float sample)
+static inline void lp_fir_butter_800kHz_32kHz_36kHz(const float *x, float *y, size_t n, float *hist)
 {
 #define COEFFS 46
     static float b[COEFFS] = {-0.000649081282, -0.0009491938209, -0.001361601657, -0.001910785234, -0.002570133495, -0.003251218426, -0.003801634695, -0.004012672882, -0.003636803575, -0.002413585945, -0.0001013597693, 0.003488892085, 0.008461671287, 0.01481127545, 0.02240598045, 0.03098477999, 0.0401679839, 0.04948137286, 0.05839197924, 0.06635211627, 0.07284719662, 0.07744230649, 0.07982251613, 0.07982251613, 0.07744230649, 0.07284719662, 0.06635211627, 0.05839197924, 0.04948137286, 0.0401679839, 0.03098477999, 0.02240598045, 0.01481127545, 0.008461671287, 0.003488892085, -0.0001013597693, -0.002413585945, -0.003636803575, -0.004012672882, -0.003801634695, -0.003251218426, -0.002570133495, -0.001910785234, -0.001361601657, -0.0009491938209, -0.000649081282, };
 
-    static float hist[COEFFS];
-
-    static FIRF_FILTER filter = {.length = COEFFS, .b = b, .hist = hist};
+    FIRF_BLOCK_FILTER filter = {.length = COEFFS, .b = b, .hist = hist};
 #undef COEFFS
 
-    return firf(sample, &filter);
+    firf_block(x, y, n, &filter);
 }
 
 /* https://liquidsdr.org/blog/lms-equalizer/ */
@@ -430,16 +494,12 @@ static inline void equalizer_complex_t1_c1(float *i, float *q)
     *q = cimagf(r);
 }
 
-static inline float equalizer_t1_c1(const float sample, const float d)
+static inline float equalizer_t1_c1(const float sample, const float d, struct demodulator_t1_c1 *demod)
 {
     static const float mu = 0.05f;
 
 #define COEFFS 9
-    static float b[COEFFS] = { [COEFFS/2 + 1] = 1.f, };
-
-    static float hist[COEFFS];
-
-    static FIRF_FILTER filter = {.length = COEFFS, .b = b, .hist = hist};
+    FIRF_FILTER filter = {.length = COEFFS, .b = demod->eq_b, .i = demod->eq_i, .hist = demod->eq_hist};
 #undef COEFFS
 
     const float r = firf(sample, &filter);
@@ -448,19 +508,16 @@ static inline float equalizer_t1_c1(const float sample, const float d)
     const float mu_e = mu * e;
     firf_lms(mu_e, &filter);
 
+    demod->eq_i = filter.i;
     return r;
 }
 
-static inline float equalizer_s1(const float sample, const float d)
+static inline float equalizer_s1(const float sample, const float d, struct demodulator_s1 *demod)
 {
     static const float mu = 0.05f;
 
 #define COEFFS 19
-    static float b[COEFFS] = { [COEFFS/2 + 1] = 1.f, };
-
-    static float hist[COEFFS];
-
-    static FIRF_FILTER filter = {.length = COEFFS, .b = b, .hist = hist};
+    FIRF_FILTER filter = {.length = COEFFS, .b = demod->eq_b, .i = demod->eq_i, .hist = demod->eq_hist};
 #undef COEFFS
 
     const float r = firf(sample, &filter);
@@ -469,148 +526,224 @@ static inline float equalizer_s1(const float sample, const float d)
     const float mu_e = mu * e;
     firf_lms(mu_e, &filter);
 
+    demod->eq_i = filter.i;
     return r;
 }
 
-static float rssi_filter_t1_c1(float sample)
+/* Decision directed: every sample is pulled towards the bit it is sliced to. */
+static void equalize_t1_c1(float *delta_phi, size_t n, struct demodulator_t1_c1 *demod)
 {
-    static float old_sample;
+    for (size_t k = 0; k < n; k++) delta_phi[k] = equalizer_t1_c1(delta_phi[k], (delta_phi[k] >= 0.f) ? 1.f : -1.f, demod);
+}
+
+static void equalize_s1(float *delta_phi, size_t n, struct demodulator_s1 *demod)
+{
+    for (size_t k = 0; k < n; k++) delta_phi[k] = equalizer_s1(delta_phi[k], (delta_phi[k] >= 0.f) ? 1.f : -1.f, demod);
+}
 
+static float rssi_filter_t1_c1(float sample, float *old_sample)
+{
 #define ALPHA 0.6789f
-    old_sample = ALPHA*sample + (1.0f - ALPHA)*old_sample;
+    *old_sample = ALPHA*sample + (1.0f - ALPHA)*(*old_sample);
 #undef ALPHA
 
-    return old_sample;
+    return *old_sample;
 }
 
-static float rssi_filter_s1(float sample)
+static float rssi_filter_s1(float sample, float *old_sample)
 {
-    static float old_sample;
-
 #define ALPHA 0.6789f
-    old_sample = ALPHA*sample + (1.0f - ALPHA)*old_sample;
+    *old_sample = ALPHA*sample + (1.0f - ALPHA)*(*old_sample);
 #undef ALPHA
 
-    return old_sample;
+    return *old_sample;
 }
 
-static float s1_remove_dc_offset_demod(float x)
+static float s1_remove_dc_offset_demod(float x, float *x_old, float *y_old)
 {
-  static float x_old, y_old;
+  *y_old = (1.f + S1_DC_OFFSET_ALPHA)/2.f * (x - *x_old) + S1_DC_OFFSET_ALPHA * (*y_old);
+  *x_old = x;
 
-  y_old = (1.f + S1_DC_OFFSET_ALPHA)/2.f * (x - x_old) + S1_DC_OFFSET_ALPHA * y_old;
-  x_old = x;
-
-  return y_old;
+  return *y_old;
 }
 
-static float t1_c1_remove_dc_offset_demod(float x)
+static float t1_c1_remove_dc_offset_demod(float x, float *x_old, float *y_old)
 {
-  static float x_old, y_old;
-
-  y_old = (1.f + T1_C1_DC_OFFSET_ALPHA)/2.f * (x - x_old) + T1_C1_DC_OFFSET_ALPHA * y_old;
-  x_old = x;
+  *y_old = (1.f + T1_C1_DC_OFFSET_ALPHA)/2.f * (x - *x_old) + T1_C1_DC_OFFSET_ALPHA * (*y_old);
+  *x_old = x;
 
-  return y_old;
+  return *y_old;
 }
 
-static inline float polar_discriminator_t1_c1(float i, float q)
+/* i[-1], q[-1] have to hold the last sample of the previous block. */
+static inline void polar_discriminator_t1_c1(const float *i, const float *q, float *delta_phi, size_t n)
 {
-    static float complex s_last;
-    const float complex s = i + q * _Complex_I;
-    const float complex y = s * conjf(s_last);
-
-#if 1
-    const float delta_phi = atan2_libm(y);
-#elif 0
-    const float delta_phi = atan2_approximation(y);
-#else
-    const float delta_phi = atan2_approximation2(y);
-#endif
+    dsp_discriminator(i, q, delta_phi, n);
+}
 
-    s_last = s;
+static inline void polar_discriminator_t1_c1_inaccurate(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    // We are going to use only complex part of the phase difference
+    // so avoid unnecesary computation of real part.
+    dsp_discriminator_fast(i, q, delta_phi, n);
+}
 
-    return delta_phi;
+static inline void polar_discriminator_s1(const float *i, const float *q, float *delta_phi, size_t n)
+{
+    dsp_discriminator(i, q, delta_phi, n);
 }
 
-static inline float polar_discriminator_t1_c1_inaccurate(float i, float q)
+static inline void polar_discriminator_s1_inaccurate(const float *i, const float *q, float *delta_phi, size_t n)
 {
     // We are going to use only complex part of the phase difference
-    // so avoid unnecesary computation of real part. The math behind:
-    // cargf = atan (delta_phi_imag / delta_phi_real) / pi;
-    // In the formula only the sign is of interest - we compute delta_phi_imag only.
+    // so avoid unnecesary computation of real part.
+    dsp_discriminator_fast(i, q, delta_phi, n);
+}
 
-    static float i_last, q_last;
+/* Hands the bits collected by the sync detector over to the packet decoder. */
+/* Every algorithm has a pool of decoders to receive datagrams overlapping in time: a
+   sync word found while all other decoders are busy starts the next free one. */
+#define DECODER_POOL_SLOTS 4u
+static unsigned opts_decoder_slots = 1;
 
-    const float delta_phi_imag = i_last*q - i*q_last;
+static void reset_t1_c1_packet_decoders(struct t1_c1_packet_decoder_work *decoder)
+{
+    for (unsigned s = 0; s < DECODER_POOL_SLOTS; s++) reset_t1_c1_packet_decoder(&decoder[s]);
+}
 
-    i_last = i;
-    q_last = q;
+/* Feeds the bits [*pos, to) of the sync detector to a decoder receiving a datagram. */
+static void t1_c1_sync_feed(const struct sync_detector *sync, unsigned *pos, unsigned to, struct t1_c1_packet_decoder_work *decoder, const char *tag)
+{
+    while (*pos < to && in_rx_t1_c1_packet_decoder(decoder))
+    {
+        const unsigned n = to - *pos;
+        const uint64_t mask = (n < 64) ? (1ull << n) - 1 : ~0ull;
 
-    return delta_phi_imag;
+        *pos += t1_c1_packet_decoder_bits((sync->bits >> (sync->count - to)) & mask, n, &sync->rssi[*pos], decoder, tag);
+    }
+    *pos = to;
 }
 
-static inline float polar_discriminator_s1(float i, float q)
+static void t1_c1_sync_flush(struct sync_detector *sync, struct t1_c1_packet_decoder_work *decoder, const char *tag)
 {
-    static float complex s_last;
-    const float complex s = i + q * _Complex_I;
-    const float complex y = s * conjf(s_last);
+    uint64_t found = sync_detector_search(sync);
+    unsigned pos[DECODER_POOL_SLOTS] = {0}; // next bit to feed to every decoder
 
-#if 1
-    const float delta_phi = atan2_libm(y);
-#elif 0
-    const float delta_phi = atan2_approximation(y);
-#else
-    const float delta_phi = atan2_approximation2(y);
-#endif
+    while (found)
+    {   // The oldest sync word first.
+        const unsigned highest = 63 - __builtin_clzll(found);
+        const unsigned i = sync->count - 1 - highest;
+        unsigned busy = 0, slot = opts_decoder_slots;
 
-    s_last = s;
+        found &= ~(1ull << highest);
 
-    return delta_phi;
-}
+        for (unsigned s = 0; s < opts_decoder_slots; s++)
+        {
+            t1_c1_sync_feed(sync, &pos[s], i, &decoder[s], tag);
 
-static inline float polar_discriminator_s1_inaccurate(float i, float q)
-{
-    // We are going to use only complex part of the phase difference
-    // so avoid unnecesary computation of real part. The math behind:
-    // cargf = atan (delta_phi_imag / delta_phi_real) / pi;
-    // In the formula only the sign is of interest - we compute delta_phi_imag only.
+            if (in_rx_t1_c1_packet_decoder(&decoder[s])) busy++;
+            else if (slot == opts_decoder_slots) slot = s;
+        }
 
-    static float i_last, q_last;
-    const float delta_phi_imag = i_last*q - i*q_last;
+        if (slot == opts_decoder_slots)
+        {   // No decoder free: a stronger datagram takes over the weakest one. A single decoder keeps its datagram.
+            if (opts_decoder_slots < 2) continue;
 
-    i_last = i;
-    q_last = q;
+            slot = 0;
+            for (unsigned s = 1; s < opts_decoder_slots; s++)
+            {
+                if (decoder[s].packet_rssi < decoder[slot].packet_rssi) slot = s;
+            }
+            if (sync->rssi[i] <= decoder[slot].packet_rssi) continue;
 
-    return delta_phi_imag;
-}
+            reset_t1_c1_packet_decoder(&decoder[slot]);
+            busy--;
+        }
 
-/** @brief Sparse Ones runs in time proportional to the number
- *         of 1 bits.
- *
- *   From: http://gurmeet.net/puzzles/fast-bit-counting-routines
- */
-static inline unsigned count_set_bits_sparse_one(uint32_t n)
-{
-    unsigned count = 0;
+        // packet detected; mark the bit similar to "Access Code"-Block in GNU Radio
+        t1_c1_packet_decoder(1u<<PACKET_PREAMBLE_DETECTED_SHIFT, sync->rssi[i], &decoder[slot], tag);
+        pos[slot] = i + 1;
 
-    while (n)
+        // A sync word found while receiving other datagrams is mostly a part of one of them.
+        if (busy) decoder[slot].crc.abort = 1;
+    }
+
+    for (unsigned s = 0; s < opts_decoder_slots; s++)
     {
-        count++;
-        n &= (n - 1) ; // set rightmost 1 bit in n to 0
+        t1_c1_sync_feed(sync, &pos[s], sync->count, &decoder[s], tag);
     }
 
-    return count;
+    sync_detector_consumed(sync);
 }
 
+static void reset_s1_packet_decoders(struct s1_packet_decoder_work *decoder)
+{
+    for (unsigned s = 0; s < DECODER_POOL_SLOTS; s++) reset_s1_packet_decoder(&decoder[s]);
+}
 
-static inline unsigned count_set_bits(uint32_t n)
+/* Feeds the chips [*pos, to) of the sync detector to a decoder receiving a datagram. */
+static void s1_sync_feed(const struct sync_detector *sync, unsigned *pos, unsigned to, struct s1_packet_decoder_work *decoder, const char *tag)
 {
-#if defined(__i386__) || defined(__arm__)
-    return __builtin_popcount(n);
-#else
-    return count_set_bits_sparse_one(n);
-#endif
+    while (*pos < to && in_rx_s1_packet_decoder(decoder))
+    {
+        const unsigned n = to - *pos;
+        const uint64_t mask = (n < 64) ? (1ull << n) - 1 : ~0ull;
+
+        *pos += s1_packet_decoder_chips((sync->bits >> (sync->count - to)) & mask, n, &sync->rssi[*pos], decoder, tag);
+    }
+    *pos = to;
+}
+
+static void s1_sync_flush(struct sync_detector *sync, struct s1_packet_decoder_work *decoder, const char *tag)
+{
+    uint64_t found = sync_detector_search(sync);
+    unsigned pos[DECODER_POOL_SLOTS] = {0}; // next chip to feed to every decoder
+
+    while (found)
+    {   // The oldest sync word first.
+        const unsigned highest = 63 - __builtin_clzll(found);
+        const unsigned i = sync->count - 1 - highest;
+        unsigned busy = 0, slot = opts_decoder_slots;
+
+        found &= ~(1ull << highest);
+
+        for (unsigned s = 0; s < opts_decoder_slots; s++)
+        {
+            s1_sync_feed(sync, &pos[s], i, &decoder[s], tag);
+
+            if (in_rx_s1_packet_decoder(&decoder[s])) busy++;
+            else if (slot == opts_decoder_slots) slot = s;
+        }
+
+        if (slot == opts_decoder_slots)
+        {   // No decoder free: a stronger datagram takes over the weakest one. A single decoder keeps its datagram.
+            if (opts_decoder_slots < 2) continue;
+
+            slot = 0;
+            for (unsigned s = 1; s < opts_decoder_slots; s++)
+            {
+                if (decoder[s].packet_rssi < decoder[slot].packet_rssi) slot = s;
+            }
+            if (sync->rssi[i] <= decoder[slot].packet_rssi) continue;
+
+            reset_s1_packet_decoder(&decoder[slot]);
+            busy--;
+        }
+
+        // packet detected; mark the bit similar to "Access Code"-Block in GNU Radio
+        s1_packet_decoder(1u<<PACKET_PREAMBLE_DETECTED_SHIFT, sync->rssi[i], &decoder[slot], tag);
+        pos[slot] = i + 1;
+
+        // A sync word found while receiving other datagrams is mostly a part of one of them.
+        if (busy) decoder[slot].crc.abort = 1;
+    }
+
+    for (unsigned s = 0; s < opts_decoder_slots; s++)
+    {
+        s1_sync_feed(sync, &pos[s], sync->count, &decoder[s], tag);
+    }
+
+    sync_detector_consumed(sync);
 }
 
 
@@ -618,87 +751,119 @@ struct runlength_algorithm_s1
 {
     int run_length;
     unsigned state;
-    uint32_t raw_bitstream;
-    uint32_t bitstream;
+    uint64_t raw_bitstream; // last 64 raw bits, the newest one in bit 63
+    struct sync_detector sync;
     int samples_per_bit[2];
-    struct s1_packet_decoder_work decoder;
+    struct s1_packet_decoder_work decoder[DECODER_POOL_SLOTS];
 };
 
 
+static void runlength_algorithm_flush_s1(struct runlength_algorithm_s1 *algo)
+{
+    s1_sync_flush(&algo->sync, algo->decoder, "rla;");
+}
+
 static void runlength_algorithm_reset_s1(struct runlength_algorithm_s1 *algo)
 {
+    runlength_algorithm_flush_s1(algo);
+
     algo->run_length = 0;
     algo->state = 0u;
     algo->raw_bitstream = 0;
-    algo->bitstream = 0;
+    sync_detector_reset(&algo->sync);
     algo->samples_per_bit[0] = 24; // Data rate is 32768 bps which gives us approx. 24 samples
     algo->samples_per_bit[1] = 24; // at a sample rate of 800kHz (800kHz / 32768bps = 24.41 ~= 24 samples).
-    reset_s1_packet_decoder(&algo->decoder);
+    reset_s1_packet_decoders(algo->decoder);
 }
 
 
-static void runlength_algorithm_s1(unsigned raw_bit, unsigned rssi, struct runlength_algorithm_s1 *algo)
+/* Called at an edge of the deglitched signal, algo->run_length holds the
+   length of the run just finished. Returns 1 if the state machine has been reset. */
+static int runlength_algorithm_edge_s1(unsigned state, unsigned rssi, struct runlength_algorithm_s1 *algo)
 {
-    algo->raw_bitstream = (algo->raw_bitstream << 1) | raw_bit;
-
-    const unsigned state = deglitch_filter_s1[algo->raw_bitstream & 0xFu];
+    // Get the current bit length expressed in samples as an
+    // average of two preceeding symbols.
+    const int samples_per_bit = (algo->samples_per_bit[0] + algo->samples_per_bit[1]) / 2;
 
-    // Edge detector.
-    if (algo->state == state)
+    // Reset the state machine if the current bit length (in samples)
+    // is less than 0.5 or more than 1.5 of the ideal symbol length.
+    if (samples_per_bit <= 24/2 || samples_per_bit >= (24+24/2))
     {
-        algo->run_length++;
+        runlength_algorithm_reset_s1(algo);
+        algo->state = state;
+        algo->run_length = 1;
+        return 1;
     }
-    else
+
+    // Reset the state machine if the sequence of ones (or zeros)
+    // is less than 0.5 symbol length that we assume.
+    const int half_bit_length = samples_per_bit/2;
+    const int run_length = algo->run_length;
+    if (run_length <= half_bit_length)
     {
-        // Get the current bit length expressed in samples as an
-        // average of two preceeding symbols.
-        const int samples_per_bit = (algo->samples_per_bit[0] + algo->samples_per_bit[1]) / 2;
+        runlength_algorithm_reset_s1(algo);
+        algo->state = state;
+        algo->run_length = 1;
+        return 1;
+    }
 
-        // Reset the state machine if the current bit length (in samples)
-        // is less than 0.5 or more than 1.5 of the ideal symbol length.
-        if (samples_per_bit <= 24/2 || samples_per_bit >= (24+24/2))
-        {
-            runlength_algorithm_reset_s1(algo);
-            algo->state = state;
-            algo->run_length = 1;
-            return;
-        }
+    int num_of_bits_rx;
+    for (num_of_bits_rx = 0; algo->run_length > half_bit_length; num_of_bits_rx++)
+    {
+        algo->run_length -= samples_per_bit;
 
-        // Reset the state machine if the sequence of ones (or zeros)
-        // is less than 0.5 symbol length that we assume.
-        const int half_bit_length = samples_per_bit/2;
-        const int run_length = algo->run_length;
-        if (run_length <= half_bit_length)
-        {
-            runlength_algorithm_reset_s1(algo);
-            algo->state = state;
-            algo->run_length = 1;
-            return;
-        }
+        if (sync_detector_push(&algo->sync, algo->state, rssi)) runlength_algorithm_flush_s1(algo);
+    }
 
-        int num_of_bits_rx;
-        for (num_of_bits_rx = 0; algo->run_length > half_bit_length; num_of_bits_rx++)
-        {
-            algo->run_length -= samples_per_bit;
+    //fprintf(stdout, "%u, %d, bits: %d, 0: %u, 1: %u\n", algo->state, run_length, num_of_bits_rx, algo->samples_per_bit[0], algo->samples_per_bit[1]);
 
-            unsigned bit = algo->state;
+    algo->samples_per_bit[algo->state] = run_length / num_of_bits_rx;
+    algo->state = state;
+    algo->run_length = 1;
+    return 0;
+}
 
-            algo->bitstream = (algo->bitstream << 1) | bit;
 
-            if (count_set_bits((algo->bitstream & ACCESS_CODE_S1_BITMASK) ^ ACCESS_CODE_S1) <= ACCESS_CODE_S1_ERRORS)
-            {
-                bit |= (1u<<PACKET_PREAMBLE_DETECTED_SHIFT); // packet detected; mark the bit similar to "Access Code"-Block in GNU Radio
-            }
+/* The run length algorithm takes the sliced signal as 64 bit words, n <= 64
+   samples with the first one in bit 0, and rssi[k] belonging to bit k. The
+   deglitch filter is applied to the whole word at once and only the edges of
+   the deglitched signal are visited, so long runs cost nearly nothing. */
+static void runlength_algorithm_s1(uint64_t raw, unsigned n, const float *rssi, struct runlength_algorithm_s1 *algo)
+{
+    const uint64_t valid = (n < 64) ? (1ull << n) - 1 : ~0ull;
+    uint64_t hist = algo->raw_bitstream;
+    uint64_t deglitched = deglitch_filter_s1(raw, hist);
+    uint64_t edges = (deglitched ^ ((deglitched << 1) | algo->state)) & valid;
+    unsigned last = 0;
 
-            s1_packet_decoder(bit, rssi, &algo->decoder, "rla;");
-        }
+    while (edges)
+    {
+        const unsigned k = __builtin_ctzll(edges);
+        const unsigned state = (deglitched >> k) & 1u;
 
-        //fprintf(stdout, "%u, %d, bits: %d, 0: %u, 1: %u\n", algo->state, run_length, num_of_bits_rx, algo->samples_per_bit[0], algo->samples_per_bit[1]);
+        algo->run_length += k - last;
+        last = k + 1;
 
-        algo->samples_per_bit[algo->state] = run_length / num_of_bits_rx;
-        algo->state = state;
-        algo->run_length = 1;
+        if (runlength_algorithm_edge_s1(state, rssi[k], algo))
+        {
+            // The reset has cleared the raw bit history up to and including
+            // bit k: deglitch the rest of the word once more.
+            const uint64_t next = (k < 63) ? 1ull << (k + 1) : 0;
+            const uint64_t later = (k < 63) ? ~0ull << (k + 1) : 0;
+
+            raw &= later;
+            hist = 0;
+            deglitched = deglitch_filter_s1(raw, hist);
+            edges = (deglitched ^ (((deglitched << 1) & ~next) | (state ? next : 0))) & later & valid;
+        }
+        else
+        {
+            edges &= edges - 1;
+        }
     }
+
+    algo->run_length += n - last;
+    algo->raw_bitstream = (n < 64) ? (hist >> n) | (raw << (64 - n)) : raw;
 }
 
 
@@ -708,205 +873,649 @@ struct runlength_algorithm_t1_c1
     int bit_length;
     int cum_run_length_error;
     unsigned state;
-    uint32_t raw_bitstream;
-    uint32_t bitstream;
-    struct t1_c1_packet_decoder_work decoder;
+    uint64_t raw_bitstream; // last 64 raw bits, the newest one in bit 63
+    struct sync_detector sync;
+    struct t1_c1_packet_decoder_work decoder[DECODER_POOL_SLOTS];
 };
 
 
+static void runlength_algorithm_flush_t1_c1(struct runlength_algorithm_t1_c1 *algo)
+{
+    t1_c1_sync_flush(&algo->sync, algo->decoder, "rla;");
+}
+
 static void runlength_algorithm_reset_t1_c1(struct runlength_algorithm_t1_c1 *algo)
 {
+    runlength_algorithm_flush_t1_c1(algo);
+
     algo->run_length = 0;
     algo->bit_length = 8 * 256;
     algo->cum_run_length_error = 0;
     algo->state = 0u;
     algo->raw_bitstream = 0;
-    algo->bitstream = 0;
-    reset_t1_c1_packet_decoder(&algo->decoder);
+    sync_detector_reset(&algo->sync);
+    reset_t1_c1_packet_decoders(algo->decoder);
 }
 
 
-static void runlength_algorithm_t1_c1(unsigned raw_bit, unsigned rssi, struct runlength_algorithm_t1_c1 *algo)
+/* Called at an edge of the deglitched signal, algo->run_length holds the
+   length of the run just finished. Returns 1 if the state machine has been reset. */
+static int runlength_algorithm_edge_t1_c1(unsigned state, unsigned rssi, struct runlength_algorithm_t1_c1 *algo)
 {
-    algo->raw_bitstream = (algo->raw_bitstream << 1) | raw_bit;
+    if (algo->run_length < 5)
+    {
+        runlength_algorithm_reset_t1_c1(algo);
+        algo->state = state;
+        algo->run_length = 1;
+        return 1;
+    }
+
+    //const int unscaled_run_length = algo->run_length;
 
-    const unsigned state = deglitch_filter_t1_c1[algo->raw_bitstream & 0x3Fu];
+    algo->run_length *= 256; // resolution scaling up for fixed point calculation
 
-    // Edge detector.
-    if (algo->state == state)
+    const int half_bit_length = algo->bit_length / 2;
+
+    if (algo->run_length <= half_bit_length)
     {
-        algo->run_length++;
+        runlength_algorithm_reset_t1_c1(algo);
+        algo->state = state;
+        algo->run_length = 1;
+        return 1;
     }
-    else
-    {
-        if (algo->run_length < 5)
-        {
-            runlength_algorithm_reset_t1_c1(algo);
-            algo->state = state;
-            algo->run_length = 1;
-            return;
-        }
 
-        //const int unscaled_run_length = algo->run_length;
+    int num_of_bits_rx;
+    for (num_of_bits_rx = 0; algo->run_length > half_bit_length; num_of_bits_rx++)
+    {
+        algo->run_length -= algo->bit_length;
 
-        algo->run_length *= 256; // resolution scaling up for fixed point calculation
+        if (sync_detector_push(&algo->sync, algo->state, rssi)) runlength_algorithm_flush_t1_c1(algo);
+    }
 
-        const int half_bit_length = algo->bit_length / 2;
+    #if 0
+    const int bit_error_length = algo->run_length / num_of_bits_rx;
+    if (in_rx_t1_c1_packet_decoder(&algo->decoder[0]))
+    {
+        fprintf(stdout, "rl = %d, num_of_bits_rx = %d, bit_length = %d, old_bit_error_length = %d, new_bit_error_length = %d\n",
+                unscaled_run_length, num_of_bits_rx, algo->bit_length, algo->bit_error_length, bit_error_length);
+    }
+    #endif
 
-        if (algo->run_length <= half_bit_length)
-        {
-            runlength_algorithm_reset_t1_c1(algo);
-            algo->state = state;
-            algo->run_length = 1;
-            return;
-        }
+    // Some kind of PI controller is implemented below: u[n] = u[n-1] + Kp * e[n] + Ki * sum(e[0..n]).
+    // Kp and Ki were found by experiment; e[n] := algo->run_length; u[[n] is the new bit length; u[n-1] is the last known bit length
+    algo->cum_run_length_error += algo->run_length; // sum(e[0..n])
+    #define PI_KP  32
+    #define PI_KI  16
+    //algo->bit_length += (algo->run_length / PI_KP + algo->cum_run_length_error / PI_KI) / num_of_bits_rx;
+    algo->bit_length += (algo->run_length + algo->cum_run_length_error / PI_KI) / (PI_KP * num_of_bits_rx);
+    #undef PI_KI
+    #undef PI_KP
+
+    algo->state = state;
+    algo->run_length = 1;
+    return 0;
+}
 
-        int num_of_bits_rx;
-        for (num_of_bits_rx = 0; algo->run_length > half_bit_length; num_of_bits_rx++)
-        {
-            algo->run_length -= algo->bit_length;
 
-            unsigned bit = algo->state;
+/* Same as runlength_algorithm_s1(). */
+static void runlength_algorithm_t1_c1(uint64_t raw, unsigned n, const float *rssi, struct runlength_algorithm_t1_c1 *algo)
+{
+    const uint64_t valid = (n < 64) ? (1ull << n) - 1 : ~0ull;
+    uint64_t hist = algo->raw_bitstream;
+    uint64_t deglitched = deglitch_filter_t1_c1(raw, hist);
+    uint64_t edges = (deglitched ^ ((deglitched << 1) | algo->state)) & valid;
+    unsigned last = 0;
 
-            algo->bitstream = (algo->bitstream << 1) | bit;
+    while (edges)
+    {
+        const unsigned k = __builtin_ctzll(edges);
+        const unsigned state = (deglitched >> k) & 1u;
 
-            if (count_set_bits((algo->bitstream & ACCESS_CODE_T1_C1_BITMASK) ^ ACCESS_CODE_T1_C1) <= ACCESS_CODE_T1_C1_ERRORS)
-            {
-                bit |= (1u<<PACKET_PREAMBLE_DETECTED_SHIFT); // packet detected; mark the bit similar to "Access Code"-Block in GNU Radio
-            }
+        algo->run_length += k - last;
+        last = k + 1;
 
-            t1_c1_packet_decoder(bit, rssi, &algo->decoder, "rla;");
+        if (runlength_algorithm_edge_t1_c1(state, rssi[k], algo))
+        {
+            // The reset has cleared the raw bit history up to and including
+            // bit k: deglitch the rest of the word once more.
+            const uint64_t next = (k < 63) ? 1ull << (k + 1) : 0;
+            const uint64_t later = (k < 63) ? ~0ull << (k + 1) : 0;
+
+            raw &= later;
+            hist = 0;
+            deglitched = deglitch_filter_t1_c1(raw, hist);
+            edges = (deglitched ^ (((deglitched << 1) & ~next) | (state ? next : 0))) & later & valid;
         }
-
-        #if 0
-        const int bit_error_length = algo->run_length / num_of_bits_rx;
-        if (in_rx_t1_c1_packet_decoder(&algo->decoder))
+        else
         {
-            fprintf(stdout, "rl = %d, num_of_bits_rx = %d, bit_length = %d, old_bit_error_length = %d, new_bit_error_length = %d\n",
-                    unscaled_run_length, num_of_bits_rx, algo->bit_length, algo->bit_error_length, bit_error_length);
+            edges &= edges - 1;
         }
-        #endif
-
-        // Some kind of PI controller is implemented below: u[n] = u[n-1] + Kp * e[n] + Ki * sum(e[0..n]).
-        // Kp and Ki were found by experiment; e[n] := algo->run_length; u[[n] is the new bit length; u[n-1] is the last known bit length
-        algo->cum_run_length_error += algo->run_length; // sum(e[0..n])
-        #define PI_KP  32
-        #define PI_KI  16
-        //algo->bit_length += (algo->run_length / PI_KP + algo->cum_run_length_error / PI_KI) / num_of_bits_rx;
-        algo->bit_length += (algo->run_length + algo->cum_run_length_error / PI_KI) / (PI_KP * num_of_bits_rx);
-        #undef PI_KI
-        #undef PI_KP
-
-        algo->state = state;
-        algo->run_length = 1;
     }
+
+    algo->run_length += n - last;
+    algo->raw_bitstream = (n < 64) ? (hist >> n) | (raw << (64 - n)) : raw;
 }
 
 
 struct time2_algorithm_t1_c1
 {
-    uint32_t bitstream;
-    struct t1_c1_packet_decoder_work t1_c1_decoder;
+    unsigned clock_lock_threshold; // clock bits after the clock edge to sample the data bit at
+    struct sync_detector sync;
+    struct t1_c1_packet_decoder_work t1_c1_decoder[DECODER_POOL_SLOTS];
 };
 
 static void time2_algorithm_t1_c1_reset(struct time2_algorithm_t1_c1 *algo)
 {
-    algo->bitstream = 0;
-    reset_t1_c1_packet_decoder(&algo->t1_c1_decoder);
+    sync_detector_reset(&algo->sync);
+    reset_t1_c1_packet_decoders(algo->t1_c1_decoder);
 }
 
-static void time2_algorithm_t1_c1(unsigned bit, unsigned rssi, struct time2_algorithm_t1_c1 *algo)
+static void time2_algorithm_t1_c1_flush(struct time2_algorithm_t1_c1 *algo)
 {
-    algo->bitstream = (algo->bitstream << 1) | bit;
-
-    if (count_set_bits((algo->bitstream & ACCESS_CODE_T1_C1_BITMASK) ^ ACCESS_CODE_T1_C1) <= ACCESS_CODE_T1_C1_ERRORS)
-    {
-        bit |= (1u<<PACKET_PREAMBLE_DETECTED_SHIFT); // packet detected; mark the bit similar to "Access Code"-Block in GNU Radio
-    }
+    t1_c1_sync_flush(&algo->sync, algo->t1_c1_decoder, "t2a;");
+}
 
-    t1_c1_packet_decoder(bit, rssi, &algo->t1_c1_decoder, "t2a;");
+static void time2_algorithm_t1_c1(unsigned bit, unsigned rssi, struct time2_algorithm_t1_c1 *algo)
+{
+    if (sync_detector_push(&algo->sync, bit >> PACKET_DATABIT_SHIFT, rssi)) time2_algorithm_t1_c1_flush(algo);
 }
 
 struct time2_algorithm_s1
 {
-    uint32_t bitstream;
-    struct s1_packet_decoder_work s1_decoder;
+    unsigned clock_lock_threshold; // clock bits after the clock edge to sample the data bit at
+    struct sync_detector sync;
+    struct s1_packet_decoder_work s1_decoder[DECODER_POOL_SLOTS];
 };
 
 static void time2_algorithm_s1_reset(struct time2_algorithm_s1 *algo)
 {
-    algo->bitstream = 0;
-    reset_s1_packet_decoder(&algo->s1_decoder);
+    sync_detector_reset(&algo->sync);
+    reset_s1_packet_decoders(algo->s1_decoder);
+}
+
+static void time2_algorithm_s1_flush(struct time2_algorithm_s1 *algo)
+{
+    s1_sync_flush(&algo->sync, algo->s1_decoder, "t2a;");
 }
 
 static void time2_algorithm_s1(unsigned bit, unsigned rssi, struct time2_algorithm_s1 *algo)
 {
-    algo->bitstream = (algo->bitstream << 1) | bit;
+    if (sync_detector_push(&algo->sync, bit >> PACKET_DATABIT_SHIFT, rssi)) time2_algorithm_s1_flush(algo);
+}
 
-    if (count_set_bits((algo->bitstream & ACCESS_CODE_S1_BITMASK) ^ ACCESS_CODE_S1) <= ACCESS_CODE_S1_ERRORS)
-    {
-        bit |= (1u<<PACKET_PREAMBLE_DETECTED_SHIFT); // packet detected; mark the bit similar to "Access Code"-Block in GNU Radio
-    }
 
-    s1_packet_decoder(bit, rssi, &algo->s1_decoder, "t2a;");
+/* The Gardner algorithm takes the post-filtered signal at 4 samples per symbol:
+   T1/C1 is sent at 100 kchip/s, S1 at 32.768 kchip/s, the sample rate is 800kHz. */
+#define GARDNER_SAMPLES_PER_SYMBOL_T1_C1 (800e3f/100e3f)
+#define GARDNER_DECIMATION_T1_C1 2u
+#define GARDNER_SAMPLES_PER_SYMBOL_S1 (800e3f/32768.f)
+#define GARDNER_DECIMATION_S1 6u
+#define GARDNER_CHIP_RATE_TOLERANCE 0.12f // T1 allows +-12% chip rate deviation, the others less.
+
+struct gardner_algorithm_t1_c1
+{
+    struct gardner_timing timing;
+    struct sync_detector sync;
+    struct t1_c1_packet_decoder_work t1_c1_decoder[DECODER_POOL_SLOTS];
+};
+
+static void gardner_algorithm_t1_c1_reset(struct gardner_algorithm_t1_c1 *algo)
+{
+    gardner_timing_init(&algo->timing, GARDNER_SAMPLES_PER_SYMBOL_T1_C1, GARDNER_DECIMATION_T1_C1, GARDNER_CHIP_RATE_TOLERANCE);
+    sync_detector_reset(&algo->sync);
+    reset_t1_c1_packet_decoders(algo->t1_c1_decoder);
 }
 
+static void gardner_algorithm_t1_c1_flush(struct gardner_algorithm_t1_c1 *algo)
+{
+    t1_c1_sync_flush(&algo->sync, algo->t1_c1_decoder, "gta;");
+}
 
-static int opts_run_length_algorithm_enabled = 1;
-static int opts_time2_algorithm_enabled = TIME2_ALGORITHM_ENABLED;
-static unsigned opts_decimation_rate = 2u;
-static int opts_s1_t1_c1_simultaneously = 0;
-static int opts_accurate_atan = 1;
-static int opts_remove_dc_offset = 0;
-int opts_show_used_algorithm = 0;
-static int opts_t1_c1_processing_enabled = 1;
-static int opts_s1_processing_enabled = 1;
-static int opts_check_flow = 0;
-static const unsigned opts_CLOCK_LOCK_THRESHOLD_T1_C1 = 2; // Is not implemented as option yet.
-static const unsigned opts_CLOCK_LOCK_THRESHOLD_S1 = 2; // Is not implemented as option yet.
+static void gardner_algorithm_t1_c1(const float *delta_phi, const float *rssi, size_t n, struct gardner_algorithm_t1_c1 *algo)
+{
+    float symbols[DSP_BLOCK_SIZE];
+    size_t at[DSP_BLOCK_SIZE];
 
+    const size_t count = gardner_timing_process(&algo->timing, delta_phi, n, symbols, at);
 
-static void print_usage(const char *program_name)
+    for (size_t m = 0; m < count; m++)
+    {
+        if (sync_detector_push(&algo->sync, symbols[m] >= 0, rssi[at[m]])) gardner_algorithm_t1_c1_flush(algo);
+    }
+}
+
+struct gardner_algorithm_s1
 {
-    fprintf(stdout, "rtl_wmbus: " VERSION "\n\n");
-    fprintf(stdout, "Usage %s:\n", program_name);
-    fprintf(stdout, "\t-o remove DC offset\n");
-    fprintf(stdout, "\t-a accelerate (use an inaccurate atan version)\n");
-    fprintf(stdout, "\t-r 0 to disable run length algorithm\n");
-    fprintf(stdout, "\t-t 0 to disable time2 algorithm\n");
-    fprintf(stdout, "\t-d 2 set decimation rate to 2 (defaults to 2 if omitted)\n");
-    fprintf(stdout, "\t-v show used algorithm in the output\n");
-    fprintf(stdout, "\t-V show version\n");
-    fprintf(stdout, "\t-s receive S1 and T1/C1 datagrams simultaneously. rtl_sdr _MUST_ be set to 868.625MHz (-f 868.625M)\n");
-    fprintf(stdout, "\t-p [T,S] to disable processing T1/C1 or S1 mode\n");
-    fprintf(stdout, "\t-f exit if flow of incoming data stops\n");
-    fprintf(stdout, "\t-h print this help\n");
+    struct gardner_timing timing;
+    struct sync_detector sync;
+    struct s1_packet_decoder_work s1_decoder[DECODER_POOL_SLOTS];
+};
+
+static void gardner_algorithm_s1_reset(struct gardner_algorithm_s1 *algo)
+{
+    gardner_timing_init(&algo->timing, GARDNER_SAMPLES_PER_SYMBOL_S1, GARDNER_DECIMATION_S1, GARDNER_CHIP_RATE_TOLERANCE);
+    sync_detector_reset(&algo->sync);
+    reset_s1_packet_decoders(algo->s1_decoder);
 }
 
-static void print_version(void)
+static void gardner_algorithm_s1_flush(struct gardner_algorithm_s1 *algo)
 {
-    fprintf(stdout, "rtl_wmbus: " VERSION "\n");
-    fprintf(stdout, COMMIT "\n");
+    s1_sync_flush(&algo->sync, algo->s1_decoder, "gta;");
 }
 
-static void process_options(int argc, char *argv[])
+static void gardner_algorithm_s1(const float *delta_phi, const float *rssi, size_t n, struct gardner_algorithm_s1 *algo)
 {
-    int option;
+    float symbols[DSP_BLOCK_SIZE];
+    size_t at[DSP_BLOCK_SIZE];
+
+    const size_t count = gardner_timing_process(&algo->timing, delta_phi, n, symbols, at);
 
-    while ((option = getopt(argc, argv, "ofad:p:r:vVst:")) != -1)
+    for (size_t m = 0; m < count; m++)
     {
-        switch (option)
-        {
-        case 'o':
-          opts_remove_dc_offset = 1;
-          break;
-        case 'f':
-            opts_check_flow = 1;
-#if CHECK_FLOW == 0
-            fprintf(stderr, "rtl_wmbus: Warning! You supplied the option -f but this build of rtl_wmbus cannot check flow of incoming data!\n");
-#endif
-            break;
-        case 'a':
+        if (sync_detector_push(&algo->sync, symbols[m] >= 0, rssi[at[m]])) gardner_algorithm_s1_flush(algo);
+    }
+}
+
+
+/* The matched filter algorithm finds the sync word by correlating the
+   post-filtered signal with the end of the preamble and the access code.
+   Starting at the timing of the correlation peak, the chips are sampled
+   in their middle; zero crossings of the signal pull the sampling back
+   to the middle if the chip rate is off. The signal is sliced at its mean
+   over the sync word, which removes the frequency offset of the sender. */
+#define MATCHED_FILTER_PATTERN_T1_C1 0x5555543dull // 16 preamble chips and the access code
+#define MATCHED_FILTER_PATTERN_S1 0x55547696ull    // 8 preamble chips and the access code
+#define MATCHED_FILTER_PATTERN_CHIPS 32u
+#define MATCHED_FILTER_SAMPLES_PER_CHIP_T1_C1 (800e3f/100e3f)
+#define MATCHED_FILTER_SAMPLES_PER_CHIP_S1 (800e3f/32768.f)
+#define MATCHED_FILTER_THRESHOLD 0.7f // minimal normalized correlation; found by experiment
+#define MATCHED_FILTER_MAX_PEAKS 16u
+#define MATCHED_FILTER_PHASE_GAIN 0.2f
+#define MATCHED_FILTER_PERIOD_GAIN 0.01f
+
+struct chip_sampler
+{
+    int active;
+    float next;   // position of the next chip sample in the current block
+    float period; // in samples
+    float period_nominal;
+    float level;  // slicing level
+    float last;   // last sample of the previous block
+};
+
+static void chip_sampler_start(struct chip_sampler *cs, size_t at, float level)
+{
+    cs->active = 1;
+    cs->next = (float)at;
+    cs->period = cs->period_nominal;
+    cs->level = level;
+}
+
+/** @brief Follow the signal for one sample.
+ *  @return 1 if the k-th sample is the middle of a chip, which is put into chip.
+ */
+static inline int chip_sampler_step(struct chip_sampler *cs, const float *x, size_t k, unsigned *chip)
+{
+    const float prev = ((k > 0) ? x[k - 1] : cs->last) - cs->level;
+    const float curr = x[k] - cs->level;
+
+    if ((prev < 0.f) != (curr < 0.f))
+    {   // Zero crossing; it is expected halfway between two chip samples.
+        const float error = ((float)k - 1.f + prev / (prev - curr)) - (cs->next - 0.5f * cs->period);
+
+        if (fabsf(error) < 0.5f * cs->period)
+        {
+            cs->next += MATCHED_FILTER_PHASE_GAIN * error;
+            cs->period += MATCHED_FILTER_PERIOD_GAIN * error;
+            cs->period = fminf(fmaxf(cs->period, cs->period_nominal * (1.f - GARDNER_CHIP_RATE_TOLERANCE)),
+                               cs->period_nominal * (1.f + GARDNER_CHIP_RATE_TOLERANCE));
+        }
+    }
+
+    if ((float)k + 0.5f < cs->next) return 0;
+
+    *chip = (curr >= 0.f);
+    cs->next += cs->period;
+    return 1;
+}
+
+static void chip_sampler_end_block(struct chip_sampler *cs, const float *x, size_t n)
+{
+    cs->next -= (float)n;
+    cs->last = x[n - 1];
+}
+
+/* Tags the datagram with the frequency offset and the SNR of the demodulated signal over the sync word. */
+static void matched_filter_tag(char *tag, size_t size, const struct sync_correlator_peak *peak)
+{
+    snprintf(tag, size, "mfa/%+.1fkHz/%.0fdB;", peak->level * 400.f, 10.f * log10f(peak->snr));
+}
+
+struct matched_filter_algorithm_t1_c1
+{
+    struct sync_correlator correlator;
+    struct chip_sampler sampler;
+    float correlation; // of the sync word of the datagram being received
+    char tag[32];
+    struct t1_c1_packet_decoder_work t1_c1_decoder;
+};
+
+static void matched_filter_algorithm_t1_c1_reset(struct matched_filter_algorithm_t1_c1 *algo)
+{
+    sync_correlator_reset(&algo->correlator);
+    algo->sampler.active = 0;
+    algo->sampler.last = 0.f;
+    reset_t1_c1_packet_decoder(&algo->t1_c1_decoder);
+}
+
+static void matched_filter_algorithm_t1_c1(const float *delta_phi, const float *rssi, size_t n, struct matched_filter_algorithm_t1_c1 *algo)
+{
+    struct sync_correlator_peak peaks[MATCHED_FILTER_MAX_PEAKS];
+    const size_t count = sync_correlator_process(&algo->correlator, delta_phi, n, peaks, MATCHED_FILTER_MAX_PEAKS);
+    size_t p = 0;
+
+    for (size_t k = 0; k < n; k++)
+    {
+        if (p < count && peaks[p].at == k)
+        {   // A stronger sync word takes over the datagram being received; it may have been a false alarm.
+            if (!in_rx_t1_c1_packet_decoder(&algo->t1_c1_decoder) || peaks[p].correlation > algo->correlation)
+            {
+                algo->correlation = peaks[p].correlation;
+                matched_filter_tag(algo->tag, sizeof(algo->tag), &peaks[p]);
+                reset_t1_c1_packet_decoder(&algo->t1_c1_decoder);
+                t1_c1_packet_decoder(1u<<PACKET_PREAMBLE_DETECTED_SHIFT, rssi[k], &algo->t1_c1_decoder, algo->tag);
+                chip_sampler_start(&algo->sampler, k, peaks[p].level);
+            }
+            p++;
+        }
+
+        unsigned chip;
+        if (algo->sampler.active && chip_sampler_step(&algo->sampler, delta_phi, k, &chip))
+        {
+            t1_c1_packet_decoder(chip << PACKET_DATABIT_SHIFT, rssi[k], &algo->t1_c1_decoder, algo->tag);
+            algo->sampler.active = in_rx_t1_c1_packet_decoder(&algo->t1_c1_decoder);
+        }
+    }
+
+    chip_sampler_end_block(&algo->sampler, delta_phi, n);
+}
+
+struct matched_filter_algorithm_s1
+{
+    struct sync_correlator correlator;
+    struct chip_sampler sampler;
+    float correlation; // of the sync word of the datagram being received
+    char tag[32];
+    struct s1_packet_decoder_work s1_decoder;
+};
+
+static void matched_filter_algorithm_s1_reset(struct matched_filter_algorithm_s1 *algo)
+{
+    sync_correlator_reset(&algo->correlator);
+    algo->sampler.active = 0;
+    algo->sampler.last = 0.f;
+    reset_s1_packet_decoder(&algo->s1_decoder);
+}
+
+static void matched_filter_algorithm_s1(const float *delta_phi, const float *rssi, size_t n, struct matched_filter_algorithm_s1 *algo)
+{
+    struct sync_correlator_peak peaks[MATCHED_FILTER_MAX_PEAKS];
+    const size_t count = sync_correlator_process(&algo->correlator, delta_phi, n, peaks, MATCHED_FILTER_MAX_PEAKS);
+    size_t p = 0;
+
+    for (size_t k = 0; k < n; k++)
+    {
+        if (p < count && peaks[p].at == k)
+        {   // A stronger sync word takes over the datagram being received; it may have been a false alarm.
+            if (!in_rx_s1_packet_decoder(&algo->s1_decoder) || peaks[p].correlation > algo->correlation)
+            {
+                algo->correlation = peaks[p].correlation;
+                matched_filter_tag(algo->tag, sizeof(algo->tag), &peaks[p]);
+                reset_s1_packet_decoder(&algo->s1_decoder);
+                s1_packet_decoder(1u<<PACKET_PREAMBLE_DETECTED_SHIFT, rssi[k], &algo->s1_decoder, algo->tag);
+                chip_sampler_start(&algo->sampler, k, peaks[p].level);
+            }
+            p++;
+        }
+
+        unsigned chip;
+        if (algo->sampler.active && chip_sampler_step(&algo->sampler, delta_phi, k, &chip))
+        {
+            s1_packet_decoder(chip << PACKET_DATABIT_SHIFT, rssi[k], &algo->s1_decoder, algo->tag);
+            algo->sampler.active = in_rx_s1_packet_decoder(&algo->s1_decoder);
+        }
+    }
+
+    chip_sampler_end_block(&algo->sampler, delta_phi, n);
+}
+
+
+static int opts_run_length_algorithm_enabled = 1;
+static int opts_time2_algorithm_enabled = TIME2_ALGORITHM_ENABLED;
+static int opts_gardner_algorithm_enabled = 0;
+static int opts_matched_filter_algorithm_enabled = 0;
+static float opts_squelch_threshold_db = 0.f; // 0 disables the squelch
+static unsigned opts_decimation_rate = 2u;
+static int opts_s1_t1_c1_simultaneously = 0;
+static int opts_accurate_atan = 1;
+static int opts_remove_dc_offset = 0;
+int opts_show_used_algorithm = 0;
+int opts_crc_abort = 0;
+static int opts_t1_c1_processing_enabled = 1;
+static int opts_s1_processing_enabled = 1;
+static int opts_check_flow = 0;
+static int opts_show_version = 0;
+static int opts_crc_benchmark = 0;
+static unsigned opts_access_code_errors_t1_c1 = ACCESS_CODE_T1_C1_ERRORS;
+static unsigned opts_access_code_errors_s1 = ACCESS_CODE_S1_ERRORS;
+static int opts_burst_mode = 0;
+static unsigned opts_dedup_window_ms = 0; // 0 disables the duplicate suppression
+static int opts_dedup_merge = 0;
+static int opts_limit_change = 0;      // print a meter only if its payload has changed
+static unsigned opts_limit_interval_s = 0; // print a meter at most once per interval, 0 disables
+static int opts_parse_headers = 0;
+static const char *opts_key_file = NULL;
+static const char *opts_store_dir = NULL;
+static const char *opts_ring_path = NULL;
+static unsigned opts_ring_slots = 0; // 0 for TELEGRAM_RING_DEFAULT_SLOTS
+static int opts_output_queue = 0; // write the output in a thread of its own
+#define BURST_SQUELCH_THRESHOLD_DB 6.f // used in burst mode if -q is not given
+static const unsigned opts_CLOCK_LOCK_THRESHOLD_T1_C1 = 2; // Is not implemented as option yet.
+static const unsigned opts_CLOCK_LOCK_THRESHOLD_S1 = 2; // Is not implemented as option yet.
+
+
+static void print_usage(const char *program_name)
+{
+    fprintf(stdout, "rtl_wmbus: " VERSION "\n\n");
+    fprintf(stdout, "Usage %s:\n", program_name);
+    fprintf(stdout, "\t-o remove DC offset\n");
+    fprintf(stdout, "\t-a accelerate (use an inaccurate atan version)\n");
+    fprintf(stdout, "\t-r 0 to disable run length algorithm\n");
+    fprintf(stdout, "\t-t 0 to disable time2 algorithm\n");
+    fprintf(stdout, "\t-g 1 to enable Gardner timing recovery algorithm\n");
+    fprintf(stdout, "\t-m 1 to enable matched filter sync word detection algorithm\n");
+    fprintf(stdout, "\t-d 2 set decimation rate to 2 (defaults to 2 if omitted)\n");
+    fprintf(stdout, "\t-v show used algorithm in the output\n");
+    fprintf(stdout, "\t-V show version and the selected DSP kernels\n");
+    fprintf(stdout, "\t-b benchmark the CRC and AES implementations and exit\n");
+    fprintf(stdout, "\t-s receive S1 and T1/C1 datagrams simultaneously. rtl_sdr _MUST_ be set to 868.625MHz (-f 868.625M)\n");
+    fprintf(stdout, "\t-p [T,S] to disable processing T1/C1 or S1 mode\n");
+    fprintf(stdout, "\t-f exit if flow of incoming data stops\n");
+    fprintf(stdout, "\t-B burst mode: buffer busy stretches of the channels and decode them with all algorithms in a worker thread;\n");
+    fprintf(stdout, "\t   from a pipe a burst is dropped if the worker falls behind, from a file it waits (statistics on SIGUSR1 and at exit)\n");
+    fprintf(stdout, "\t-c 1 drop a datagram as soon as one of its blocks fails the CRC check; datagrams with CRC errors are not printed then\n");
+    fprintf(stdout, "\t-n 2 receive up to 2 datagrams overlapping in time per algorithm (1...%u, defaults to 1)\n", DECODER_POOL_SLOTS);
+    fprintf(stdout, "\t-A file receive only the meters listed in file (reloaded on SIGHUP)\n");
+    fprintf(stdout, "\t-D file ignore the meters listed in file (reloaded on SIGHUP)\n");
+    fprintf(stdout, "\t-u 200 print a datagram only once if it is decoded again within 200 ms (0 disables, the default)\n");
+    fprintf(stdout, "\t-M with -u: hold datagrams back for the window and print them with the tags of all algorithms and the best rssi\n");
+    fprintf(stdout, "\t-L change print a meter only if its payload has changed since it was last printed\n");
+    fprintf(stdout, "\t-L 60 print a meter at most once per 60 s; -L change,60 combines both (statistics on SIGUSR1 and at exit)\n");
+    fprintf(stdout, "\t-P append the fields of the link and transport layer headers and the application data to each datagram\n");
+    fprintf(stdout, "\t-k file like -P, and decrypt security mode 5 payloads with the keys in file\n");
+    fprintf(stdout, "\t-R all like -P, and append the data records as name@storage=value; -R volume@0,flow_temperature selects records\n");
+    fprintf(stdout, "\t-S dir also append the datagrams to the store in dir; %s query dir ident [from [to]] prints those of a meter\n", program_name);
+    fprintf(stdout, "\t-W /dev/shm/rtl_wmbus also publish the datagrams in a shared memory ring of 4096 binary records (see telegram_ring.h);\n");
+    fprintf(stdout, "\t   -W /dev/shm/rtl_wmbus,65536 sets the size; %s follow /dev/shm/rtl_wmbus prints the datagrams published there\n", program_name);
+    fprintf(stdout, "\t-U udp:239.0.0.1:5000 also send each datagram to that UDP address or, with -U unix:path, Unix datagram socket; may be repeated\n");
+    fprintf(stdout, "\t-O bin write length prefixed binary records as described in telegram_binary.h instead of text lines (-P, -R and -v do not apply)\n");
+    fprintf(stdout, "\t-F 100ms write the output at most every 100 ms; -F 10 every 10 datagrams, -F 10,100ms whichever comes first (defaults to every datagram)\n");
+    fprintf(stdout, "\t-Q drop-oldest write the output in a thread of its own through a queue of %u datagrams; if it is full, drop the oldest,\n", TELEGRAM_QUEUE_DEFAULT_RECORDS);
+    fprintf(stdout, "\t   -Q drop-newest the new datagram or -Q block wait for the writer; -Q block,4096 sets the size (statistics on SIGUSR1 and at exit)\n");
+    fprintf(stdout, "\t-q 6 skip demodulation while the channel is less than 6 dB above its noise floor (0 disables, the default)\n");
+    fprintf(stdout, "\t-e 1 accept up to 1 wrong bit in the access code (0...%u, defaults to 0)\n", SYNC_DETECTOR_MAX_ERRORS);
+    fprintf(stdout, "\t-K [generic,sse2,avx2,avx512,neon] limit DSP kernels to that instruction set, or\n");
+    fprintf(stdout, "\t-K kernel=isa force one DSP kernel implementation (see -V), may be repeated\n");
+    fprintf(stdout, "\t-h print this help\n");
+}
+
+static void print_version(void)
+{
+    fprintf(stdout, "rtl_wmbus: " VERSION "\n");
+    fprintf(stdout, COMMIT "\n");
+    fprintf(stdout, "\nDSP kernels:\n");
+    dsp_kernels_print(stdout);
+}
+
+/* Appends the CRC fields to random telegram data: blocks of 10 and 16 bytes
+   for frame type A, of 126 bytes for frame type B. */
+static unsigned crc_benchmark_telegram(uint8_t *packet, unsigned data_length, unsigned b_frame_type)
+{
+    unsigned length = 0;
+
+    for (unsigned block = 0; data_length; block++)
+    {
+        const unsigned size = b_frame_type ? 126 : (block == 0 ? 10 : 16);
+        const unsigned n = (data_length < size) ? data_length : size;
+
+        for (unsigned k = 0; k < n; k++) packet[length + k] = (uint8_t)rand();
+        length += n;
+        data_length -= n;
+
+        const uint16_t crc = calc_crc_wmbus(&packet[length - n], n);
+        packet[length++] = crc >> 8;
+        packet[length++] = crc & 0xFFu;
+    }
+
+    return length;
+}
+
+/* Validates 64 frame type A and B telegrams with every CRC implementation the CPU supports. */
+static void run_crc_benchmark(void)
+{
+    enum { TELEGRAMS = 64, ROUNDS = 20000 };
+    static uint8_t packets[TELEGRAMS][290];
+    unsigned lengths[TELEGRAMS];
+    size_t bytes = 0;
+
+    for (unsigned t = 0; t < TELEGRAMS; t++)
+    {   // Odd telegrams are of frame type B.
+        lengths[t] = crc_benchmark_telegram(packets[t], (t & 1u) ? 253 : 10 + 16*(t % 8) + 7, t & 1u);
+        bytes += lengths[t];
+    }
+
+    const struct dsp_kernel *kernel = &dsp_kernels[DSP_KERNEL_CRC16];
+
+    for (size_t i = 0; i < kernel->count; i++)
+    {
+        char spec[64];
+        snprintf(spec, sizeof(spec), "%s=%s", kernel->name, kernel->impls[i].isa);
+        if (dsp_kernels_force(spec) != 0) continue;
+
+        unsigned failed = 0;
+        const clock_t start = clock();
+        for (unsigned r = 0; r < ROUNDS; r++)
+        {
+            for (unsigned t = 0; t < TELEGRAMS; t++)
+            {
+                const bool crc_ok = (t & 1u) ? check_calc_crc_wmbus_b_frame_type(packets[t], lengths[t])
+                                             : check_calc_crc_wmbus(packets[t], lengths[t]);
+                failed += !crc_ok;
+            }
+        }
+        const double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        fprintf(stdout, "%-10s %-8s %8.1f MB/s%s\n", kernel->name, kernel->impls[i].isa,
+                seconds > 0 ? (double)bytes * ROUNDS / seconds / 1e6 : 0., failed ? " CRC MISMATCH!" : "");
+    }
+}
+
+/* Decrypts payloads of typical mode 5 datagrams (5 blocks) with every AES implementation. */
+static void run_aes_benchmark(void)
+{
+    enum { TELEGRAMS = 64, BLOCKS = 5, ROUNDS = 20000 };
+    static uint8_t encrypted[TELEGRAMS][BLOCKS*AES128_BLOCK_SIZE], expected[TELEGRAMS][BLOCKS*AES128_BLOCK_SIZE], plain[BLOCKS*AES128_BLOCK_SIZE];
+    uint8_t secret[AES128_BLOCK_SIZE], iv[AES128_BLOCK_SIZE];
+    struct aes128_key key;
+    uint32_t seed = 0x12345678u;
+
+    for (unsigned k = 0; k < AES128_BLOCK_SIZE; k++) secret[k] = (uint8_t)k, iv[k] = (uint8_t)(0xA0 + k);
+    aes128_key_expand(&key, secret);
+
+    for (unsigned t = 0; t < TELEGRAMS; t++)
+    {
+        for (unsigned k = 0; k < sizeof(encrypted[t]); k++) encrypted[t][k] = (uint8_t)((seed = seed*1103515245u + 12345u) >> 24);
+        aes128_cbc_decrypt_generic(&key, iv, encrypted[t], expected[t], BLOCKS);
+    }
+
+    const struct dsp_kernel *kernel = &dsp_kernels[DSP_KERNEL_AES128_CBC];
+
+    for (size_t i = 0; i < kernel->count; i++)
+    {
+        char spec[64];
+        snprintf(spec, sizeof(spec), "%s=%s", kernel->name, kernel->impls[i].isa);
+        if (dsp_kernels_force(spec) != 0) continue;
+
+        const unsigned rounds = i == 0 ? ROUNDS/10 : ROUNDS; // the generic one is slow
+        unsigned failed = 0;
+        const clock_t start = clock();
+        for (unsigned r = 0; r < rounds; r++)
+        {
+            for (unsigned t = 0; t < TELEGRAMS; t++)
+            {
+                dsp_aes128_cbc_decrypt(&key, iv, encrypted[t], plain, BLOCKS);
+                failed += memcmp(plain, expected[t], sizeof(plain)) != 0;
+            }
+        }
+        const double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        fprintf(stdout, "%-10s %-8s %8.1f MB/s %10.0f datagrams/s%s\n", kernel->name, kernel->impls[i].isa,
+                seconds > 0 ? (double)sizeof(plain) * TELEGRAMS * rounds / seconds / 1e6 : 0.,
+                seconds > 0 ? (double)TELEGRAMS * rounds / seconds : 0., failed ? " AES MISMATCH!" : "");
+    }
+}
+
+/* Parses a whole decimal number; returns -1 on anything else. */
+static int parse_unsigned(const char *s, unsigned *value)
+{
+    char *end;
+
+    errno = 0;
+    const unsigned long v = strtoul(s, &end, 10);
+    if (end == s || *end != '\0' || s[0] == '-' || errno != 0 || v > UINT_MAX) return -1;
+
+    *value = (unsigned)v;
+    return 0;
+}
+
+static void process_options(int argc, char *argv[])
+{
+    int option;
+
+    while ((option = getopt(argc, argv, "ofad:p:r:vVbst:g:m:K:e:q:c:n:A:D:u:ML:Pk:R:S:U:W:O:F:Q:B")) != -1)
+    {
+        switch (option)
+        {
+        case 'o':
+          opts_remove_dc_offset = 1;
+          break;
+        case 'f':
+            opts_check_flow = 1;
+#if CHECK_FLOW == 0
+            fprintf(stderr, "rtl_wmbus: Warning! You supplied the option -f but this build of rtl_wmbus cannot check flow of incoming data!\n");
+#endif
+            break;
+        case 'a':
             opts_accurate_atan = 0;
             break;
         case 'p':
@@ -946,273 +1555,1357 @@ static void process_options(int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
             break;
+        case 'g':
+            if (strcmp(optarg, "0") == 0 || strcmp(optarg, "1") == 0)
+            {
+                opts_gardner_algorithm_enabled = (optarg[0] == '1');
+            }
+            else
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'm':
+            if (strcmp(optarg, "0") == 0 || strcmp(optarg, "1") == 0)
+            {
+                opts_matched_filter_algorithm_enabled = (optarg[0] == '1');
+            }
+            else
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
         case 'd':
-            opts_decimation_rate = strtoul(optarg, NULL, 10);
+            if (parse_unsigned(optarg, &opts_decimation_rate) != 0 || opts_decimation_rate == 0)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
             break;
         case 's':
             opts_s1_t1_c1_simultaneously = 1;
             break;
+        case 'e':
+            if (parse_unsigned(optarg, &opts_access_code_errors_t1_c1) != 0 || opts_access_code_errors_t1_c1 > SYNC_DETECTOR_MAX_ERRORS)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            opts_access_code_errors_s1 = opts_access_code_errors_t1_c1;
+            break;
+        case 'c':
+            if (strcmp(optarg, "0") == 0 || strcmp(optarg, "1") == 0)
+            {
+                opts_crc_abort = (optarg[0] == '1');
+            }
+            else
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'n':
+            if (parse_unsigned(optarg, &opts_decoder_slots) != 0 || opts_decoder_slots < 1 || opts_decoder_slots > DECODER_POOL_SLOTS)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'A':
+            meter_filter.allow_path = optarg;
+            break;
+        case 'D':
+            meter_filter.deny_path = optarg;
+            break;
+        case 'u':
+            if (parse_unsigned(optarg, &opts_dedup_window_ms) != 0)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'M':
+            opts_dedup_merge = 1;
+            break;
+        case 'L':
+            for (char *policy = strtok(optarg, ","); policy != NULL; policy = strtok(NULL, ","))
+            {
+                if (strcmp(policy, "change") == 0)
+                {
+                    opts_limit_change = 1;
+                }
+                else if (parse_unsigned(policy, &opts_limit_interval_s) != 0 || opts_limit_interval_s == 0)
+                {
+                    fprintf(stderr, "rtl_wmbus: -L expects \"change\", a number of seconds or both separated by a comma\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            break;
+        case 'P':
+            opts_parse_headers = 1;
+            break;
+        case 'k':
+            opts_key_file = optarg;
+            opts_parse_headers = 1;
+            break;
+        case 'S':
+#if WINDOWS_BUILD == 0
+            opts_store_dir = optarg;
+#else
+            fprintf(stderr, "rtl_wmbus: this build of rtl_wmbus cannot store datagrams!\n");
+            exit(EXIT_FAILURE);
+#endif
+            break;
+        case 'U':
+#if WINDOWS_BUILD == 0
+            if (telegram_socket_add(&telegram_socket, optarg) != 0) exit(EXIT_FAILURE);
+#else
+            fprintf(stderr, "rtl_wmbus: this build of rtl_wmbus cannot send datagrams to sockets!\n");
+            exit(EXIT_FAILURE);
+#endif
+            break;
+        case 'W':
+#if WINDOWS_BUILD == 0
+            {
+                char *comma = strchr(optarg, ',');
+                if (comma != NULL)
+                {
+                    *comma = '\0';
+                    if (parse_unsigned(&comma[1], &opts_ring_slots) != 0 || opts_ring_slots < 2 || opts_ring_slots > (1u << 24) || (opts_ring_slots & (opts_ring_slots - 1)))
+                    {
+                        fprintf(stderr, "rtl_wmbus: -W expects a path, optionally followed by a comma and a power of two number of records\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                opts_ring_path = optarg;
+            }
+#else
+            fprintf(stderr, "rtl_wmbus: this build of rtl_wmbus cannot publish datagrams in shared memory!\n");
+            exit(EXIT_FAILURE);
+#endif
+            break;
+        case 'O':
+            if (strcmp(optarg, "bin") == 0)
+            {
+                telegram_render = telegram_render_binary;
+            }
+            else if (strcmp(optarg, "text") != 0)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'F':
+            if (telegram_writer_parse_policy(&telegram_writer, optarg) != 0)
+            {
+                fprintf(stderr, "rtl_wmbus: -F expects a number of lines, a time like 100ms or both separated by a comma\n");
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'Q':
+            if (telegram_queue_parse(&telegram_queue, optarg) != 0)
+            {
+                fprintf(stderr, "rtl_wmbus: -Q expects drop-oldest, drop-newest or block, optionally followed by a comma and the number of datagrams\n");
+                exit(EXIT_FAILURE);
+            }
+            opts_output_queue = 1;
+            break;
+        case 'R':
+            if (mbus_record_filter_parse(&wmbus_frame_records, optarg) != 0)
+            {
+                fprintf(stderr, "rtl_wmbus: -R expects \"all\" or up to %u quantity names like volume@0,flow_temperature\n", MBUS_RECORD_FILTER_MAX);
+                exit(EXIT_FAILURE);
+            }
+            opts_parse_headers = 1;
+            break;
+        case 'q':
+            {
+                char *end;
+                opts_squelch_threshold_db = strtof(optarg, &end);
+                if (end == optarg || *end != '\0' || !(opts_squelch_threshold_db >= 0.f)) opts_squelch_threshold_db = -1.f;
+            }
+            if (opts_squelch_threshold_db < 0.f)
+            {
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'B':
+            opts_burst_mode = 1;
+            break;
         case 'v':
             opts_show_used_algorithm = 1;
             break;
         case 'V':
-            print_version();
-            exit(EXIT_SUCCESS);
+            opts_show_version = 1;
+            break;
+        case 'b':
+            opts_crc_benchmark = 1;
+            break;
+        case 'K':
+            if (dsp_kernels_force(optarg) != 0)
+            {
+                fprintf(stderr, "rtl_wmbus: DSP kernel \"%s\" is unknown or not supported by this CPU!\n", optarg);
+                exit(EXIT_FAILURE);
+            }
             break;
         default:
             print_usage(argv[0]);
             exit(EXIT_FAILURE);
         }
     }
+
+    if (opts_show_version)
+    {
+        print_version();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (opts_crc_benchmark)
+    {
+        run_crc_benchmark();
+        run_aes_benchmark();
+        exit(EXIT_SUCCESS);
+    }
+
+    if (opts_burst_mode && opts_squelch_threshold_db == 0.f)
+    {
+        opts_squelch_threshold_db = BURST_SQUELCH_THRESHOLD_DB;
+    }
+}
+
+static float *LUT_FREQUENCY_TRANSLATION_PLUS_COSINE = NULL;
+static float *LUT_FREQUENCY_TRANSLATION_PLUS_SINE = NULL;
+static size_t LUT_FREQUENCY_TRANSLATION_PERIOD = 0;
+#define FREQ_STEP_KHZ (25)
+#define FREQ_SHIFT_KHZ (325)
+
+/* fs_kHz is the sample rate in kHz.
+   The tables hold the rotation for consecutive samples, not for consecutive
+   frequency steps: the whole period of the sequence plus one block, so the
+   mixer can read a block from any position without wrapping around. */
+static void setup_lookup_tables_for_frequency_translation(int fs_kHz)
+{
+    const int ft_kHz = FREQ_STEP_KHZ;
+    const size_t n_max = fs_kHz/ft_kHz;
+    const size_t n_step = FREQ_SHIFT_KHZ/FREQ_STEP_KHZ;
+
+    size_t a = n_max, b = n_step;
+    while (b) { const size_t t = a % b; a = b; b = t; }
+    LUT_FREQUENCY_TRANSLATION_PERIOD = n_max / a;
+
+    const size_t lut_size = LUT_FREQUENCY_TRANSLATION_PERIOD + DSP_BLOCK_SIZE;
+
+    free(LUT_FREQUENCY_TRANSLATION_PLUS_COSINE);
+    LUT_FREQUENCY_TRANSLATION_PLUS_COSINE = malloc(lut_size *sizeof(LUT_FREQUENCY_TRANSLATION_PLUS_COSINE[0]));
+    if (!LUT_FREQUENCY_TRANSLATION_PLUS_COSINE) exit(EXIT_FAILURE);
+
+    free(LUT_FREQUENCY_TRANSLATION_PLUS_SINE);
+    LUT_FREQUENCY_TRANSLATION_PLUS_SINE = malloc(lut_size *sizeof(LUT_FREQUENCY_TRANSLATION_PLUS_SINE[0]));
+    if (!LUT_FREQUENCY_TRANSLATION_PLUS_SINE) exit(EXIT_FAILURE);
+
+    for (size_t k = 0, n = 0; k < lut_size; k++)
+    {
+        const double phi = (2. * M_PI * (ft_kHz * n)) / fs_kHz;
+        LUT_FREQUENCY_TRANSLATION_PLUS_COSINE[k] = cosf(phi);
+        LUT_FREQUENCY_TRANSLATION_PLUS_SINE[k] = -sinf(phi); // Minus sinf!
+
+        n += n_step;
+        if (n >= n_max) n -= n_max;
+    }
+}
+
+/* Positive frequencies shift: ft = +325kHz the signal will shift from 868.625M right to 868.95M.
+   Negative frequencies shift: ft = -325kHz the signal will shift from 868.625M right to 868.3M.
+   (iplus, qplus) are shifted in place, (iminus, qminus) get the negative shift of the same input. */
+static void shift_freq_plus_minus325(float *iplus, float *qplus, float *iminus, float *qminus, size_t n)
+{
+    static size_t phase = 0;
+
+    dsp_mixer(iplus, qplus, iminus, qminus,
+              &LUT_FREQUENCY_TRANSLATION_PLUS_COSINE[phase], &LUT_FREQUENCY_TRANSLATION_PLUS_SINE[phase], n);
+
+    phase = (phase + n) % LUT_FREQUENCY_TRANSLATION_PERIOD;
+}
+
+/* The signal chains below are written once as always inlined templates taking
+   the program options as parameters. They are instantiated for every option
+   combination, so the compiler drops all option checks from the per-sample
+   loop. The matching instance is picked once at startup. */
+#define SIGNAL_CHAIN_TEMPLATE static inline __attribute__((always_inline))
+
+/* i_t1_c1[-1], q_t1_c1[-1] have to hold the last sample of the previous block. */
+SIGNAL_CHAIN_TEMPLATE void t1_c1_signal_chain(const float *i_t1_c1, const float *q_t1_c1, size_t n,
+                                              struct demodulator_t1_c1 *demod,
+                                              struct time2_algorithm_t1_c1 *t2_algo_t1_c1,
+                                              struct runlength_algorithm_t1_c1 *rl_algo_t1_c1,
+                                              struct gardner_algorithm_t1_c1 *ga_algo_t1_c1,
+                                              struct matched_filter_algorithm_t1_c1 *mf_algo_t1_c1,
+                                              const int accurate_atan,
+                                              const int remove_dc_offset,
+                                              const int run_length_algorithm_enabled,
+                                              const int time2_algorithm_enabled,
+                                              const int gardner_algorithm_enabled,
+                                              const int matched_filter_algorithm_enabled)
+{
+    float delta_phi_t1_c1[DSP_BLOCK_SIZE];
+    float clock_t1_c1[DSP_BLOCK_SIZE];
+
+    // Demodulate.
+    if (accurate_atan) polar_discriminator_t1_c1(i_t1_c1, q_t1_c1, delta_phi_t1_c1, n);
+    else polar_discriminator_t1_c1_inaccurate(i_t1_c1, q_t1_c1, delta_phi_t1_c1, n);
+
+    // Post-filtering to prevent bit errors because of signal jitter.
+    lp_fir_butter_800kHz_100kHz_160kHz(delta_phi_t1_c1, delta_phi_t1_c1, n, demod->lp_hist);
+    if (remove_dc_offset)
+    {
+        float x_old = demod->dc_x_old, y_old = demod->dc_y_old;
+        for (size_t k = 0; k < n; k++) delta_phi_t1_c1[k] = t1_c1_remove_dc_offset_demod(delta_phi_t1_c1[k], &x_old, &y_old);
+        demod->dc_x_old = x_old;
+        demod->dc_y_old = y_old;
+    }
+    if (demod->equalize) equalize_t1_c1(delta_phi_t1_c1, n, demod);
+
+    if (time2_algorithm_enabled)
+    {
+        // The time-2 method is implemented: push squared signal through a bandpass
+        // tuned close to the symbol rate. Saturating band-pass output produces a
+        // rectangular pulses with the required timing information.
+        for (size_t k = 0; k < n; k++) clock_t1_c1[k] = delta_phi_t1_c1[k] * delta_phi_t1_c1[k];
+        bp_iir_cheb1_800kHz_90kHz_98kHz_102kHz_110kHz(clock_t1_c1, clock_t1_c1, n, demod->bp_hist);
+    }
+
+    // Get the bits!
+    uint64_t bits_t1_c1[DSP_BLOCK_SIZE/64];
+    dsp_slicer(delta_phi_t1_c1, bits_t1_c1, n);
+
+    // --- rssi filtering section begin ---
+    // We are using one simple filter to rssi value in order to
+    // prevent unexpected "splashes" in signal power.
+    float rssi_t1_c1[DSP_BLOCK_SIZE];
+    float old_rssi = demod->rssi;
+    for (size_t k = 0; k < n; k++)
+    {
+        rssi_t1_c1[k] = sqrtf(i_t1_c1[k]*i_t1_c1[k] + q_t1_c1[k]*q_t1_c1[k]);
+        rssi_t1_c1[k] = rssi_filter_t1_c1(rssi_t1_c1[k], &old_rssi); // comment out, if rssi filtering is unwanted
+    }
+    demod->rssi = old_rssi;
+    // --- rssi filtering section end ---
+
+    // --- runlength algorithm section begin ---
+    if (run_length_algorithm_enabled)
+    {
+        for (size_t k = 0; k < n; k += 64)
+        {
+            runlength_algorithm_t1_c1(bits_t1_c1[k/64], (n - k < 64) ? n - k : 64, &rssi_t1_c1[k], rl_algo_t1_c1);
+        }
+    }
+    // --- runlength algorithm section end ---
+
+
+    // --- gardner algorithm section begin ---
+    if (gardner_algorithm_enabled)
+    {
+        gardner_algorithm_t1_c1(delta_phi_t1_c1, rssi_t1_c1, n, ga_algo_t1_c1);
+    }
+    // --- gardner algorithm section end ---
+
+
+    // --- time2 algorithm section begin ---
+    if (time2_algorithm_enabled)
+    {
+        int16_t old_clock_t1_c1 = demod->old_clock;
+        unsigned clock_lock_t1_c1 = demod->clock_lock;
+        const unsigned clock_lock_threshold_t1_c1 = t2_algo_t1_c1->clock_lock_threshold;
+
+        for (size_t k = 0; k < n; k++)
+        {
+            // --- clock recovery section begin ---
+            // Clock-Signal is crossing zero in half period.
+            const int16_t clock = (clock_t1_c1[k] >= 0) ? INT16_MAX : INT16_MIN;
+
+            if (clock > old_clock_t1_c1)
+            {   // Clock signal rising edge detected.
+                clock_lock_t1_c1 = 1;
+            }
+            else if (clock == INT16_MAX)
+            {   // Clock signal is still high.
+                if (clock_lock_t1_c1 < clock_lock_threshold_t1_c1)
+                {   // Skip up to (clock_lock_threshold_t1_c1 - 1) clock bits
+                    // to get closer to the middle of the data bit.
+                    clock_lock_t1_c1++;
+                }
+                else if (clock_lock_t1_c1 == clock_lock_threshold_t1_c1)
+                {   // Sample data bit at clock_lock_threshold_t1_c1 clock bit position.
+                    clock_lock_t1_c1++;
+                    const unsigned bit_t1_c1 = ((bits_t1_c1[k/64] >> (k%64)) & 1u) << PACKET_DATABIT_SHIFT;
+                    time2_algorithm_t1_c1(bit_t1_c1, rssi_t1_c1[k], t2_algo_t1_c1);
+                }
+            }
+            old_clock_t1_c1 = clock;
+            // --- clock recovery section end ---
+        }
+
+        demod->old_clock = old_clock_t1_c1;
+        demod->clock_lock = clock_lock_t1_c1;
+    }
+    // --- time2 algorithm section end ---
+
+
+    // --- matched filter algorithm section begin ---
+    if (matched_filter_algorithm_enabled)
+    {
+        matched_filter_algorithm_t1_c1(delta_phi_t1_c1, rssi_t1_c1, n, mf_algo_t1_c1);
+    }
+    // --- matched filter algorithm section end ---
+
+    // Bits still waiting for the access code search must not wait for the next block.
+    if (run_length_algorithm_enabled) runlength_algorithm_flush_t1_c1(rl_algo_t1_c1);
+    if (time2_algorithm_enabled) time2_algorithm_t1_c1_flush(t2_algo_t1_c1);
+    if (gardner_algorithm_enabled) gardner_algorithm_t1_c1_flush(ga_algo_t1_c1);
+}
+
+/* i_s1[-1], q_s1[-1] have to hold the last sample of the previous block. */
+SIGNAL_CHAIN_TEMPLATE void s1_signal_chain(const float *i_s1, const float *q_s1, size_t n,
+                                           struct demodulator_s1 *demod,
+                                           struct time2_algorithm_s1 *t2_algo_s1,
+                                           struct runlength_algorithm_s1 *rl_algo_s1,
+                                           struct gardner_algorithm_s1 *ga_algo_s1,
+                                           struct matched_filter_algorithm_s1 *mf_algo_s1,
+                                           const int accurate_atan,
+                                           const int remove_dc_offset,
+                                           const int run_length_algorithm_enabled,
+                                           const int time2_algorithm_enabled,
+                                           const int gardner_algorithm_enabled,
+                                           const int matched_filter_algorithm_enabled)
+{
+    float delta_phi_s1[DSP_BLOCK_SIZE];
+    float clock_s1[DSP_BLOCK_SIZE];
+
+    // Demodulate.
+    if (accurate_atan) polar_discriminator_s1(i_s1, q_s1, delta_phi_s1, n);
+    else polar_discriminator_s1_inaccurate(i_s1, q_s1, delta_phi_s1, n);
+
+    // Post-filtering to prevent bit errors because of signal jitter.
+    lp_fir_butter_800kHz_32kHz_36kHz(delta_phi_s1, delta_phi_s1, n, demod->lp_hist);
+    if (remove_dc_offset)
+    {
+        float x_old = demod->dc_x_old, y_old = demod->dc_y_old;
+        for (size_t k = 0; k < n; k++) delta_phi_s1[k] = s1_remove_dc_offset_demod(delta_phi_s1[k], &x_old, &y_old);
+        demod->dc_x_old = x_old;
+        demod->dc_y_old = y_old;
+    }
+    if (demod->equalize) equalize_s1(delta_phi_s1, n, demod);
+
+    if (time2_algorithm_enabled)
+    {
+        // The time-2 method is implemented: push squared signal through a bandpass
+        // tuned close to the symbol rate. Saturating band-pass output produces a
+        // rectangular pulses with the required timing information.
+        for (size_t k = 0; k < n; k++) clock_s1[k] = delta_phi_s1[k] * delta_phi_s1[k];
+        bp_iir_cheb1_800kHz_22kHz_30kHz_34kHz_42kHz(clock_s1, clock_s1, n, demod->bp_hist);
+    }
+
+    // Get the bits!
+    uint64_t bits_s1[DSP_BLOCK_SIZE/64];
+    dsp_slicer(delta_phi_s1, bits_s1, n);
+
+    // --- rssi filtering section begin ---
+    // We are using one simple filter to rssi value in order to
+    // prevent unexpected "splashes" in signal power.
+    float rssi_s1[DSP_BLOCK_SIZE];
+    float old_rssi = demod->rssi;
+    for (size_t k = 0; k < n; k++)
+    {
+        rssi_s1[k] = sqrtf(i_s1[k]*i_s1[k] + q_s1[k]*q_s1[k]);
+        rssi_s1[k] = rssi_filter_s1(rssi_s1[k], &old_rssi); // comment out, if rssi filtering is unwanted
+    }
+    demod->rssi = old_rssi;
+    // --- rssi filtering section end ---
+
+    // --- runlength algorithm section begin ---
+    if (run_length_algorithm_enabled)
+    {
+        for (size_t k = 0; k < n; k += 64)
+        {
+            runlength_algorithm_s1(bits_s1[k/64], (n - k < 64) ? n - k : 64, &rssi_s1[k], rl_algo_s1);
+        }
+    }
+    // --- runlength algorithm section end ---
+
+
+    // --- gardner algorithm section begin ---
+    if (gardner_algorithm_enabled)
+    {
+        gardner_algorithm_s1(delta_phi_s1, rssi_s1, n, ga_algo_s1);
+    }
+    // --- gardner algorithm section end ---
+
+
+    // --- time2 algorithm section begin ---
+    if (time2_algorithm_enabled)
+    {
+        int16_t old_clock_s1 = demod->old_clock;
+        unsigned clock_lock_s1 = demod->clock_lock;
+        const unsigned clock_lock_threshold_s1 = t2_algo_s1->clock_lock_threshold;
+
+        for (size_t k = 0; k < n; k++)
+        {
+            // --- clock recovery section begin ---
+            // Clock-Signal is crossing zero in half period.
+            const int16_t clock = (clock_s1[k] >= 0) ? INT16_MAX : INT16_MIN;
+
+            if (clock > old_clock_s1)
+            {   // Clock signal rising edge detected.
+                clock_lock_s1 = 1;
+            }
+            else if (clock == INT16_MAX)
+            {   // Clock signal is still high.
+                if (clock_lock_s1 < clock_lock_threshold_s1)
+                {   // Skip up to (clock_lock_threshold_s1 - 1) clock bits
+                    // to get closer to the middle of the data bit.
+                    clock_lock_s1++;
+                }
+                else if (clock_lock_s1 == clock_lock_threshold_s1)
+                {   // Sample data bit at clock_lock_threshold_s1 clock bit position.
+                    clock_lock_s1++;
+                    const unsigned bit_s1 = ((bits_s1[k/64] >> (k%64)) & 1u) << PACKET_DATABIT_SHIFT;
+                    time2_algorithm_s1(bit_s1, rssi_s1[k], t2_algo_s1);
+                }
+            }
+            old_clock_s1 = clock;
+            // --- clock recovery section end ---
+        }
+
+        demod->old_clock = old_clock_s1;
+        demod->clock_lock = clock_lock_s1;
+    }
+    // --- time2 algorithm section end ---
+
+
+    // --- matched filter algorithm section begin ---
+    if (matched_filter_algorithm_enabled)
+    {
+        matched_filter_algorithm_s1(delta_phi_s1, rssi_s1, n, mf_algo_s1);
+    }
+    // --- matched filter algorithm section end ---
+
+    // Bits still waiting for the access code search must not wait for the next block.
+    if (run_length_algorithm_enabled) runlength_algorithm_flush_s1(rl_algo_s1);
+    if (time2_algorithm_enabled) time2_algorithm_s1_flush(t2_algo_s1);
+    if (gardner_algorithm_enabled) gardner_algorithm_s1_flush(ga_algo_s1);
+}
+
+typedef void (*t1_c1_signal_chain_prototype)(const float *i_t1_c1, const float *q_t1_c1, size_t n,
+                                             struct demodulator_t1_c1 *demod,
+                                             struct time2_algorithm_t1_c1 *t2_algo_t1_c1,
+                                             struct runlength_algorithm_t1_c1 *rl_algo_t1_c1,
+                                             struct gardner_algorithm_t1_c1 *ga_algo_t1_c1,
+                                             struct matched_filter_algorithm_t1_c1 *mf_algo_t1_c1);
+
+typedef void (*s1_signal_chain_prototype)(const float *i_s1, const float *q_s1, size_t n,
+                                          struct demodulator_s1 *demod,
+                                          struct time2_algorithm_s1 *t2_algo_s1,
+                                          struct runlength_algorithm_s1 *rl_algo_s1,
+                                          struct gardner_algorithm_s1 *ga_algo_s1,
+                                          struct matched_filter_algorithm_s1 *mf_algo_s1);
+
+/* OPTION_VARIANTS_OF_n(X) expands X(o1, ..., on) for all 2^n combinations of n binary options. */
+#define OPTION_VARIANTS_6(X, ...) X(__VA_ARGS__, 0) X(__VA_ARGS__, 1)
+#define OPTION_VARIANTS_5(X, ...) OPTION_VARIANTS_6(X, __VA_ARGS__, 0) OPTION_VARIANTS_6(X, __VA_ARGS__, 1)
+#define OPTION_VARIANTS_4(X, ...) OPTION_VARIANTS_5(X, __VA_ARGS__, 0) OPTION_VARIANTS_5(X, __VA_ARGS__, 1)
+#define OPTION_VARIANTS_3(X, ...) OPTION_VARIANTS_4(X, __VA_ARGS__, 0) OPTION_VARIANTS_4(X, __VA_ARGS__, 1)
+#define OPTION_VARIANTS_2(X, ...) OPTION_VARIANTS_3(X, __VA_ARGS__, 0) OPTION_VARIANTS_3(X, __VA_ARGS__, 1)
+#define OPTION_VARIANTS_OF_5(X) OPTION_VARIANTS_3(X, 0) OPTION_VARIANTS_3(X, 1)
+#define OPTION_VARIANTS_OF_6(X) OPTION_VARIANTS_2(X, 0) OPTION_VARIANTS_2(X, 1)
+
+#define SIGNAL_CHAIN_INDEX(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter) \
+    ((accurate_atan) << 5 | (remove_dc_offset) << 4 | (run_length) << 3 | (time2) << 2 | (gardner) << 1 | (matched_filter))
+
+#define T1_C1_SIGNAL_CHAIN_INSTANCE(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter)                     \
+static void t1_c1_signal_chain_##accurate_atan##remove_dc_offset##run_length##time2##gardner##matched_filter(const float *i_t1_c1,  \
+                                                                                             const float *q_t1_c1, size_t n,       \
+                                                                                             struct demodulator_t1_c1 *demod,      \
+                                                                                             struct time2_algorithm_t1_c1 *t2_algo, \
+                                                                                             struct runlength_algorithm_t1_c1 *rl_algo, \
+                                                                                             struct gardner_algorithm_t1_c1 *ga_algo, \
+                                                                                             struct matched_filter_algorithm_t1_c1 *mf_algo) \
+{                                                                                                                                    \
+    t1_c1_signal_chain(i_t1_c1, q_t1_c1, n, demod, t2_algo, rl_algo, ga_algo, mf_algo, accurate_atan, remove_dc_offset,                     \
+                       run_length && RUN_LENGTH_ALGORITHM_ENABLED, time2 && TIME2_ALGORITHM_ENABLED,                                 \
+                       gardner && GARDNER_ALGORITHM_ENABLED, matched_filter && MATCHED_FILTER_ALGORITHM_ENABLED);                    \
+}
+
+#define S1_SIGNAL_CHAIN_INSTANCE(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter)                        \
+static void s1_signal_chain_##accurate_atan##remove_dc_offset##run_length##time2##gardner##matched_filter(const float *i_s1,        \
+                                                                                          const float *q_s1, size_t n,             \
+                                                                                          struct demodulator_s1 *demod,            \
+                                                                                          struct time2_algorithm_s1 *t2_algo,      \
+                                                                                          struct runlength_algorithm_s1 *rl_algo,  \
+                                                                                          struct gardner_algorithm_s1 *ga_algo,    \
+                                                                                          struct matched_filter_algorithm_s1 *mf_algo) \
+{                                                                                                                                    \
+    s1_signal_chain(i_s1, q_s1, n, demod, t2_algo, rl_algo, ga_algo, mf_algo, accurate_atan, remove_dc_offset,                              \
+                    run_length && RUN_LENGTH_ALGORITHM_ENABLED, time2 && TIME2_ALGORITHM_ENABLED,                                    \
+                    gardner && GARDNER_ALGORITHM_ENABLED, matched_filter && MATCHED_FILTER_ALGORITHM_ENABLED);                       \
+}
+
+OPTION_VARIANTS_OF_6(T1_C1_SIGNAL_CHAIN_INSTANCE)
+OPTION_VARIANTS_OF_6(S1_SIGNAL_CHAIN_INSTANCE)
+
+#define T1_C1_SIGNAL_CHAIN_ENTRY(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter) \
+    [SIGNAL_CHAIN_INDEX(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter)] =       \
+        t1_c1_signal_chain_##accurate_atan##remove_dc_offset##run_length##time2##gardner##matched_filter,
+
+#define S1_SIGNAL_CHAIN_ENTRY(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter) \
+    [SIGNAL_CHAIN_INDEX(accurate_atan, remove_dc_offset, run_length, time2, gardner, matched_filter)] =    \
+        s1_signal_chain_##accurate_atan##remove_dc_offset##run_length##time2##gardner##matched_filter,
+
+static const t1_c1_signal_chain_prototype T1_C1_SIGNAL_CHAINS[] = { OPTION_VARIANTS_OF_6(T1_C1_SIGNAL_CHAIN_ENTRY) };
+static const s1_signal_chain_prototype S1_SIGNAL_CHAINS[] = { OPTION_VARIANTS_OF_6(S1_SIGNAL_CHAIN_ENTRY) };
+
+/* Capture state of a channel in burst mode. */
+struct burst_channel
+{
+    unsigned channel;
+    struct burst *current;       // burst being captured, NULL while the channel is idle
+    struct sync_correlator gate; // preamble correlator deciding whether the burst is decoded
+    int overrun;                 // no free buffer: the channel is skipped until the squelch closes
+};
+
+struct receiver_work;
+typedef void (*receiver_process_prototype)(struct receiver_work *rx, const uint8_t *samples, size_t n);
+
+/* Everything the receiver keeps between two blocks of samples. */
+struct receiver_work
+{
+    // i and q before filtering; the minus ones carry the S1 band when mixing.
+    __attribute__((__aligned__(32))) float i_unfilt[DSP_BLOCK_SIZE];
+    __attribute__((__aligned__(32))) float q_unfilt[DSP_BLOCK_SIZE];
+    __attribute__((__aligned__(32))) float i_minus_unfilt[DSP_BLOCK_SIZE];
+    __attribute__((__aligned__(32))) float q_minus_unfilt[DSP_BLOCK_SIZE];
+
+    // Filtered and decimated i and q. Element 0 keeps the last sample before
+    // the block which the discriminators need. With the squelch enabled the
+    // previous block (n_prev samples) is kept in front of the current one as
+    // pre-roll, so a datagram starting just before the squelch opens is not lost.
+    float i_t1_c1[1 + 2*DSP_BLOCK_SIZE], q_t1_c1[1 + 2*DSP_BLOCK_SIZE];
+    float i_s1[1 + 2*DSP_BLOCK_SIZE], q_s1[1 + 2*DSP_BLOCK_SIZE];
+    size_t n_prev_t1_c1, n_prev_s1;
+
+    struct squelch squelch_t1_c1;
+    struct squelch squelch_s1;
+
+    struct burst_channel burst_t1_c1;
+    struct burst_channel burst_s1;
+
+    struct demodulator_t1_c1 demod_t1_c1;
+    struct demodulator_s1 demod_s1;
+    struct time2_algorithm_t1_c1 t2_algo_t1_c1;
+    struct time2_algorithm_s1 t2_algo_s1;
+    struct runlength_algorithm_t1_c1 rl_algo_t1_c1;
+    struct runlength_algorithm_s1 rl_algo_s1;
+    struct gardner_algorithm_t1_c1 ga_algo_t1_c1;
+    struct gardner_algorithm_s1 ga_algo_s1;
+    struct matched_filter_algorithm_t1_c1 mf_algo_t1_c1;
+    struct matched_filter_algorithm_s1 mf_algo_s1;
+
+    // Instances specialized for the program options; selected by receiver_init.
+    receiver_process_prototype process;
+    t1_c1_signal_chain_prototype process_t1_c1_chain;
+    s1_signal_chain_prototype process_s1_chain;
+};
+
+static void receiver_reset_t1_c1(struct receiver_work *rx)
+{
+    demodulator_t1_c1_reset(&rx->demod_t1_c1);
+    time2_algorithm_t1_c1_reset(&rx->t2_algo_t1_c1);
+    runlength_algorithm_reset_t1_c1(&rx->rl_algo_t1_c1);
+    gardner_algorithm_t1_c1_reset(&rx->ga_algo_t1_c1);
+    matched_filter_algorithm_t1_c1_reset(&rx->mf_algo_t1_c1);
+}
+
+static void receiver_reset_s1(struct receiver_work *rx)
+{
+    demodulator_s1_reset(&rx->demod_s1);
+    time2_algorithm_s1_reset(&rx->t2_algo_s1);
+    runlength_algorithm_reset_s1(&rx->rl_algo_s1);
+    gardner_algorithm_s1_reset(&rx->ga_algo_s1);
+    matched_filter_algorithm_s1_reset(&rx->mf_algo_s1);
+}
+
+/* Burst mode: the receiver thread only watches the channel power. While a
+   channel is busy its filtered and decimated samples are copied into a burst
+   buffer, starting with the block before as pre-roll. The worker thread
+   decodes every burst several times with all algorithms and the expensive
+   options, and prints each datagram with a valid CRC once. */
+#define BURST_POOL_SIZE 4u
+#define BURST_MAX_SAMPLES (1u<<18) // about 330ms at 800kHz, enough for the longest S1 datagram
+#define BURST_SAMPLE_NS 1250       // 800kHz after decimation
+/* A burst longer than BURST_MAX_SAMPLES is split. The next part starts with
+   the last samples of the previous one, as many as the longest datagram of the
+   channel with its preamble takes, so a datagram crossing the split is whole
+   in one of the parts. */
+#define BURST_OVERLAP_T1_C1 (8u * (290u*12u + 96u))           // 3 out of 6 chips at 100kchip/s
+#define BURST_OVERLAP_S1 (25000u * (290u*16u + 576u) / 1024u) // Manchester chips at 32.768kchip/s
+#define BURST_RESULTS_MAX 16u
+#define BURST_GATE_THRESHOLD 0.5f // below MATCHED_FILTER_THRESHOLD: the gate only has to reject bursts without any datagram
+
+enum { BURST_CHANNEL_T1_C1, BURST_CHANNEL_S1 };
+
+static struct burst_queue burst_queue;
+static pthread_t burst_worker_thread;
+static struct
+{
+    uint64_t decoded;          // bursts decoded by the worker thread
+    uint64_t skipped;          // bursts without a preamble
+    uint64_t overruns;         // bursts lost or cut short without a free buffer
+    uint64_t results_dropped;  // distinct datagrams of a burst beyond BURST_RESULTS_MAX
+} burst_statistics;
+
+/* Coarse preamble search on n samples about to be appended to burst b, with
+   the fast discriminator and without the post filter. */
+static void burst_gate(struct sync_correlator *gate, struct burst *b, const float *i, const float *q, size_t n)
+{
+    float delta_phi[DSP_BLOCK_SIZE];
+    struct sync_correlator_peak peaks[MATCHED_FILTER_MAX_PEAKS];
+
+    for (size_t k = 0; k < n; k += DSP_BLOCK_SIZE)
+    {
+        const size_t m = (n - k < DSP_BLOCK_SIZE) ? n - k : DSP_BLOCK_SIZE;
+
+        dsp_discriminator_fast(&i[k], &q[k], delta_phi, m);
+        const size_t count = sync_correlator_process(gate, delta_phi, m, peaks, MATCHED_FILTER_MAX_PEAKS);
+        if (count > 0) b->preamble = b->n + k + peaks[count - 1].at + 1;
+    }
+}
+
+/* Hands a burst over to the decoder thread if the gate found a preamble in it. */
+static void burst_finish(struct burst *b)
+{
+    if (b->preamble)
+    {
+        burst_queue_push(&burst_queue, b);
+    }
+    else
+    {
+        burst_queue_release(&burst_queue, b);
+        __atomic_add_fetch(&burst_statistics.skipped, 1, __ATOMIC_RELAXED);
+    }
 }
 
-static float *LUT_FREQUENCY_TRANSLATION_PLUS_COSINE = NULL;
-static float *LUT_FREQUENCY_TRANSLATION_PLUS_SINE = NULL;
-#define FREQ_STEP_KHZ (25)
+/* Takes a buffer for the next burst of channel c. Without a free buffer the
+   pool only fails when reading a live stream: the rest of the busy stretch is
+   lost then rather than holding up the receiver. */
+static struct burst *burst_begin(struct burst_channel *c)
+{
+    struct burst *b = burst_queue_get(&burst_queue);
+    if (b == NULL)
+    {
+        __atomic_add_fetch(&burst_statistics.overruns, 1, __ATOMIC_RELAXED);
+        c->overrun = 1;
+        return NULL;
+    }
 
-/* fs_kHz is the sample rate in kHz. */
-static void setup_lookup_tables_for_frequency_translation(int fs_kHz)
+    b->channel = c->channel;
+    return b;
+}
+
+static void burst_capture(struct squelch *sq, struct burst_channel *c,
+                          const float *i, const float *q, size_t n_prev, size_t n)
 {
-    const int ft_kHz = FREQ_STEP_KHZ;
-    const size_t n_max = fs_kHz/ft_kHz;
+    if (!squelch_update(sq, dsp_energy(&i[n_prev], &q[n_prev], n), n))
+    {
+        if (c->current) burst_finish(c->current);
+        c->current = NULL;
+        c->overrun = 0;
+        return;
+    }
 
-    free(LUT_FREQUENCY_TRANSLATION_PLUS_COSINE);
-    LUT_FREQUENCY_TRANSLATION_PLUS_COSINE = malloc(n_max *sizeof(LUT_FREQUENCY_TRANSLATION_PLUS_COSINE[0]));
-    if (!LUT_FREQUENCY_TRANSLATION_PLUS_COSINE) exit(EXIT_FAILURE);
+    if (c->overrun) return;
 
-    free(LUT_FREQUENCY_TRANSLATION_PLUS_SINE);
-    LUT_FREQUENCY_TRANSLATION_PLUS_SINE = malloc(n_max *sizeof(LUT_FREQUENCY_TRANSLATION_PLUS_SINE[0]));
-    if (!LUT_FREQUENCY_TRANSLATION_PLUS_SINE) exit(EXIT_FAILURE);
+    if (c->current && c->current->n + n > burst_queue.capacity)
+    {
+        struct burst *b = c->current;
+        const size_t overlap = (c->channel == BURST_CHANNEL_T1_C1) ? BURST_OVERLAP_T1_C1 : BURST_OVERLAP_S1;
+        const size_t keep = (b->n < overlap) ? b->n : overlap;
+
+        struct burst *next = burst_begin(c);
+        if (next)
+        {
+            next->continued = 1;
+            next->preamble = (b->preamble > b->n - keep) ? b->preamble - (b->n - keep) : 0;
+            next->time_ns = b->time_ns + (int64_t)(b->n - keep) * BURST_SAMPLE_NS;
+            next->sample = b->sample + (b->n - keep) * opts_decimation_rate;
+            memcpy(&next->i[-1], &b->i[b->n - keep - 1], (1 + keep) * sizeof(b->i[0]));
+            memcpy(&next->q[-1], &b->q[b->n - keep - 1], (1 + keep) * sizeof(b->q[0]));
+            next->n = keep;
+        }
+
+        burst_finish(b);
+        c->current = next;
+        if (next == NULL) return;
+    }
 
-    for (size_t n = 0; n < n_max; n++)
+    size_t from = n_prev;
+    if (c->current == NULL)
     {
-        const double phi = (2. * M_PI * (ft_kHz * n)) / fs_kHz;
-        LUT_FREQUENCY_TRANSLATION_PLUS_COSINE[n] = cosf(phi);
-        LUT_FREQUENCY_TRANSLATION_PLUS_SINE[n] = -sinf(phi); // Minus sinf!
+        struct burst *b = burst_begin(c);
+        if (b == NULL) return;
+
+        b->continued = 0;
+        b->preamble = 0;
+        b->time_ns = make_time_ns();
+        b->sample = __atomic_load_n(&telegram_clock, __ATOMIC_RELAXED);
+        b->i[-1] = i[-1];
+        b->q[-1] = q[-1];
+        sync_correlator_reset(&c->gate);
+        c->current = b;
+        from = 0;
     }
+
+    struct burst *b = c->current;
+    burst_gate(&c->gate, b, &i[from], &q[from], n_prev + n - from);
+    memcpy(&b->i[b->n], &i[from], (n_prev + n - from) * sizeof(b->i[0]));
+    memcpy(&b->q[b->n], &q[from], (n_prev + n - from) * sizeof(b->q[0]));
+    b->n += n_prev + n - from;
 }
 
-/* Positive frequencies shift: ft = +325kHz the signal will shift from 868.625M right to 868.95M.
-   Negative frequencies shift: ft = -325kHz the signal will shift from 868.625M right to 868.3M. */
-static void shift_freq_plus_minus325(float *iplus, float *qplus, float *iminus, float *qminus, int fs_kHz)
+/* Every burst is decoded in these passes. The time2 algorithm samples the
+   data bit at clock_lock_threshold clock bits after the clock edge; the other
+   algorithms don't depend on it and run in one pass only. The matched filter
+   slices at the signal mean anyway, so it doesn't need the DC offset removal.
+   The LMS equalizer changes the level of the demodulated signal, which the
+   matched filter and the Gardner loop measure, so it runs with the slicing
+   algorithms only. */
+static const struct
 {
-    const int ft = 325;
-    static size_t n = 0;
-    const size_t n_max = fs_kHz/FREQ_STEP_KHZ;
-    #if 0
-    const float complex freq_shift = cosf(2.*M_PI*(ft*n)/fs_kHz) + sin(2.*M_PI*(ft*n)/fs_kHz) * _Complex_I;
-    n++;
-    #else
-    const float x = LUT_FREQUENCY_TRANSLATION_PLUS_COSINE[n];
-    const float z = LUT_FREQUENCY_TRANSLATION_PLUS_SINE[n];
-    n += ft/FREQ_STEP_KHZ;
-    #endif
-    if (n >= n_max) n -= n_max;
-    float ix, iz, qx, qz;
+    int remove_dc_offset;
+    unsigned clock_lock_threshold;
+    int run_length;
+    int gardner;
+    int matched_filter;
+    int equalizer;
+} BURST_DECODER_PASSES[] =
+{
+    {0, 2, 1, 1, 1, 0}, {0, 1, 0, 0, 0, 0}, {0, 3, 0, 0, 0, 0},
+    {1, 2, 1, 1, 0, 0}, {1, 1, 0, 0, 0, 0}, {1, 3, 0, 0, 0, 0},
+    {0, 2, 1, 0, 0, 1}, {1, 2, 1, 0, 0, 1},
+};
 
-    // (i+Jq)*(x+Jz) =ix-qz + J(qx+iz) positive rotation
-    // (i+Jq)*(x-Jz) =ix+qz + J(qx-iz) negative rotation
-    // ix, qz, qx, iz are the same for boths shifts so we reuse them
-    // totaling 4 mul and 4 sums instead of 8 mul 4 sum.
-    // It works because iplus equals to iminus and qplus equals to qminus.
+struct burst_result
+{
+    struct telegram t;
+    size_t at; // samples into the burst at which the datagram was completed
+    uint8_t data[290];
+};
 
-    ix = *iplus * x;
-    qx = *qplus * x;
-    iz = *iplus * z;
-    qz = *qplus * z;
+/* Distinct datagrams with valid CRC decoded from the current burst, and the
+   first one with failed CRC, printed only if no pass decodes a valid one. */
+static struct burst_result burst_results[BURST_RESULTS_MAX];
+static size_t burst_results_count = 0;
+static struct burst_result burst_failed;
+static int burst_failed_count = 0;
+static size_t burst_position = 0; // start of the block being decoded in the burst
 
-    // Symmetric positive shift.
-    *iplus = ix - qz;
-    *qplus = qx + iz;
+static void burst_print_statistics(FILE *stream)
+{
+    fprintf(stream, "rtl_wmbus: bursts (%s): %llu decoded, %llu without preamble, %llu lost without a free buffer, %llu datagrams dropped with more than %u in a burst\n",
+            burst_queue.wait ? "wait" : "drop",
+            (unsigned long long)__atomic_load_n(&burst_statistics.decoded, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&burst_statistics.skipped, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&burst_statistics.overruns, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&burst_statistics.results_dropped, __ATOMIC_RELAXED),
+            BURST_RESULTS_MAX);
+}
 
-    // Symmetric negative shift .
-    *iminus = ix + qz;
-    *qminus = qx - iz;
+static int burst_same_telegram(const struct telegram *a, const struct telegram *b)
+{
+    return strcmp(a->mode, b->mode) == 0 && a->length == b->length && memcmp(a->data, b->data, a->length) == 0;
 }
 
-typedef void (*t1_c1_signal_chain_prototype)(float i_t1_c1, float q_t1_c1,
-                                             struct time2_algorithm_t1_c1 *t2_algo_t1_c1,
-                                             struct runlength_algorithm_t1_c1 *rl_algo_t1_c1,
-                                             float (*polar_discriminator_t1_c1_function)(float i, float q));
+static void burst_result_store(struct burst_result *r, const struct telegram *t)
+{
+    r->t = *t;
+    r->at = burst_position;
+    memcpy(r->data, t->data, t->length);
+    r->t.data = r->data;
+}
 
-void t1_c1_signal_chain(float i_t1_c1, float q_t1_c1,
-                        struct time2_algorithm_t1_c1 *t2_algo_t1_c1,
-                        struct runlength_algorithm_t1_c1 *rl_algo_t1_c1,
-                        float (*polar_discriminator_t1_c1_function)(float i, float q))
+/* Collects the datagrams of all passes; installed as telegram_output in burst mode.
+   The passes decode most datagrams several times, only the first is kept. */
+static void burst_collect(const struct telegram *t)
 {
-    static int16_t old_clock_t1_c1 = INT16_MIN;
-    static unsigned clock_lock_t1_c1 = 0;
+    if (t->length > sizeof(burst_results[0].data)) return;
 
-    // Demodulate.
-    const float _delta_phi_t1_c1 = polar_discriminator_t1_c1_function(i_t1_c1, q_t1_c1);
-    //int16_t demodulated_signal = (INT16_MAX-1)*delta_phi;
-    //fwrite(&demodulated_signal, sizeof(demodulated_signal), 1, demod_out);
+    if (!t->crc_ok)
+    {
+        if (burst_failed_count++ == 0) burst_result_store(&burst_failed, t);
+        return;
+    }
 
-    // Post-filtering to prevent bit errors because of signal jitter.
-    float delta_phi_t1_c1 = lp_fir_butter_800kHz_100kHz_160kHz(_delta_phi_t1_c1);
-    //float delta_phi_t1_c1 = equalizer_t1_c1(_delta_phi_t1_c1, _delta_phi_t1_c1 >= 0.f ? 1.f : -1.f);
-    if (opts_remove_dc_offset) delta_phi_t1_c1 = t1_c1_remove_dc_offset_demod(delta_phi_t1_c1);
-    //int16_t demodulated_signal = (INT16_MAX-1)*delta_phi_t1_c1;
-    //fwrite(&demodulated_signal, sizeof(demodulated_signal), 1, demod_out2_t1_c1);
+    for (size_t k = 0; k < burst_results_count; k++)
+    {
+        if (burst_same_telegram(&burst_results[k].t, t)) return;
+    }
 
-    // Get the bit!
-    unsigned bit_t1_c1 = (delta_phi_t1_c1 >= 0) ? (1u<<PACKET_DATABIT_SHIFT) : (0u<<PACKET_DATABIT_SHIFT);
-    //int16_t u = bit ? (INT16_MAX-1) : 0;
-    //fwrite(&u, sizeof(u), 1, rawbits_out);
+    if (burst_results_count == BURST_RESULTS_MAX)
+    {
+        __atomic_add_fetch(&burst_statistics.results_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
 
-    // --- rssi filtering section begin ---
-    // We are using one simple filter to rssi value in order to
-    // prevent unexpected "splashes" in signal power.
-    float rssi_t1_c1 = sqrtf(i_t1_c1*i_t1_c1 + q_t1_c1*q_t1_c1);
-    rssi_t1_c1 = rssi_filter_t1_c1(rssi_t1_c1); // comment out, if rssi filtering is unwanted
-    // --- rssi filtering section end ---
+    burst_result_store(&burst_results[burst_results_count++], t);
+}
 
-    // --- runlength algorithm section begin ---
-    #if RUN_LENGTH_ALGORITHM_ENABLED
-    if (opts_run_length_algorithm_enabled)
+/* Hashes of the datagrams printed for the last burst of each channel: a datagram
+   within the overlap of a split burst is decoded in both parts. */
+static uint64_t burst_reported[2][BURST_RESULTS_MAX];
+static size_t burst_reported_count[2];
+
+static int burst_reported_before(const struct burst *b, uint64_t hash)
+{
+    if (!b->continued) return 0;
+
+    for (size_t k = 0; k < burst_reported_count[b->channel]; k++)
     {
-        runlength_algorithm_t1_c1(bit_t1_c1, rssi_t1_c1, rl_algo_t1_c1);
+        if (burst_reported[b->channel][k] == hash) return 1;
     }
-    #endif
-    // --- runlength algorithm section end ---
+    return 0;
+}
+
+/* Dates a datagram by the burst start and its position in the burst, as the
+   receiver thread would have at the time the datagram was completed. */
+static void burst_date(const struct burst *b, struct burst_result *r)
+{
+    r->t.time_ns = b->time_ns + (int64_t)r->at * BURST_SAMPLE_NS;
+    r->t.sample = b->sample + r->at * opts_decimation_rate;
+}
 
+/* Prints each datagram with valid CRC once, or the first one decoded if no CRC is valid. */
+static void burst_report(const struct burst *b)
+{
+    uint64_t reported[BURST_RESULTS_MAX];
 
-    // --- time2 algorithm section begin ---
-    #if TIME2_ALGORITHM_ENABLED
-    if (opts_time2_algorithm_enabled)
+    for (size_t k = 0; k < burst_results_count; k++)
     {
-        // --- clock recovery section begin ---
-        // The time-2 method is implemented: push squared signal through a bandpass
-        // tuned close to the symbol rate. Saturating band-pass output produces a
-        // rectangular pulses with the required timing information.
-        // Clock-Signal is crossing zero in half period.
-        const int16_t clock_t1_c1 = (bp_iir_cheb1_800kHz_90kHz_98kHz_102kHz_110kHz(delta_phi_t1_c1 * delta_phi_t1_c1) >= 0) ? INT16_MAX : INT16_MIN;
-        //fwrite(&clock_t1_c1, sizeof(clock_t1_c1), 1, clock_out);
+        struct telegram *t = &burst_results[k].t;
 
-        if (clock_t1_c1 > old_clock_t1_c1)
-        {   // Clock signal rising edge detected.
-            clock_lock_t1_c1 = 1;
-        }
-        else if (clock_t1_c1 == INT16_MAX)
-        {   // Clock signal is still high.
-            if (clock_lock_t1_c1 < opts_CLOCK_LOCK_THRESHOLD_T1_C1)
-            {   // Skip up to (opts_CLOCK_LOCK_THRESHOLD_T1_C1 - 1) clock bits
-                // to get closer to the middle of the data bit.
-                clock_lock_t1_c1++;
+        const uint64_t hash = telegram_hash(t);
+        reported[k] = hash;
+        if (burst_reported_before(b, hash)) continue;
+
+        burst_date(b, &burst_results[k]);
+        telegram_sink(t);
+    }
+
+    memcpy(burst_reported[b->channel], reported, burst_results_count * sizeof(reported[0]));
+    burst_reported_count[b->channel] = burst_results_count;
+
+    if (burst_results_count == 0 && burst_failed_count > 0)
+    {
+        burst_date(b, &burst_failed);
+        telegram_sink(&burst_failed.t);
+    }
+}
+
+static void receiver_init(struct receiver_work *rx);
+
+static void *burst_worker(void *arg)
+{
+    static struct receiver_work rx;
+    struct burst *b;
+
+    (void)arg;
+    receiver_init(&rx);
+
+    while ((b = burst_queue_pop(&burst_queue)) != NULL)
+    {
+        burst_results_count = 0;
+        burst_failed_count = 0;
+
+        for (size_t p = 0; p < sizeof(BURST_DECODER_PASSES)/sizeof(BURST_DECODER_PASSES[0]); p++)
+        {
+            const unsigned chain = SIGNAL_CHAIN_INDEX(1, BURST_DECODER_PASSES[p].remove_dc_offset,
+                                                      BURST_DECODER_PASSES[p].run_length, 1, BURST_DECODER_PASSES[p].gardner,
+                                                      BURST_DECODER_PASSES[p].matched_filter);
+
+            if (b->channel == BURST_CHANNEL_T1_C1)
+            {
+                receiver_reset_t1_c1(&rx);
+                rx.t2_algo_t1_c1.clock_lock_threshold = BURST_DECODER_PASSES[p].clock_lock_threshold;
+                rx.demod_t1_c1.equalize = BURST_DECODER_PASSES[p].equalizer;
+
+                for (size_t k = 0; k < b->n; k += DSP_BLOCK_SIZE)
+                {
+                    const size_t n = (b->n - k < DSP_BLOCK_SIZE) ? b->n - k : DSP_BLOCK_SIZE;
+                    burst_position = k;
+                    T1_C1_SIGNAL_CHAINS[chain](&b->i[k], &b->q[k], n, &rx.demod_t1_c1, &rx.t2_algo_t1_c1, &rx.rl_algo_t1_c1, &rx.ga_algo_t1_c1, &rx.mf_algo_t1_c1);
+                }
             }
-            else if (clock_lock_t1_c1 == opts_CLOCK_LOCK_THRESHOLD_T1_C1)
-            {   // Sample data bit at CLOCK_LOCK_THRESHOLD_T1_C1 clock bit position.
-                clock_lock_t1_c1++;
-                time2_algorithm_t1_c1(bit_t1_c1, rssi_t1_c1, t2_algo_t1_c1);
-                //int16_t u = bit_t1_c1 ? (INT16_MAX-1) : 0;
-                //fwrite(&u, sizeof(u), 1, bits_out);
+            else
+            {
+                receiver_reset_s1(&rx);
+                rx.t2_algo_s1.clock_lock_threshold = BURST_DECODER_PASSES[p].clock_lock_threshold;
+                rx.demod_s1.equalize = BURST_DECODER_PASSES[p].equalizer;
+
+                for (size_t k = 0; k < b->n; k += DSP_BLOCK_SIZE)
+                {
+                    const size_t n = (b->n - k < DSP_BLOCK_SIZE) ? b->n - k : DSP_BLOCK_SIZE;
+                    burst_position = k;
+                    S1_SIGNAL_CHAINS[chain](&b->i[k], &b->q[k], n, &rx.demod_s1, &rx.t2_algo_s1, &rx.rl_algo_s1, &rx.ga_algo_s1, &rx.mf_algo_s1);
+                }
             }
         }
-        old_clock_t1_c1 = clock_t1_c1;
-        // --- clock recovery section end ---
+
+        burst_report(b);
+        burst_queue_release(&burst_queue, b);
+        __atomic_add_fetch(&burst_statistics.decoded, 1, __ATOMIC_RELAXED);
     }
-    #endif
-    // --- time2 algorithm section end ---
+
+    return NULL;
 }
 
-void t1_c1_signal_chain_empty(float i_t1_c1, float q_t1_c1,
-                              struct time2_algorithm_t1_c1 *t2_algo_t1_c1,
-                              struct runlength_algorithm_t1_c1 *rl_algo_t1_c1,
-                              float (*polar_discriminator_t1_c1_function)(float i, float q))
+/* Waits for a free burst buffer when decoding a file, since nothing gets lost
+   then. A pipe or device is read as a live stream: holding up the receiver
+   would only lose the samples upstream where nobody counts them. */
+static void burst_pipeline_start(FILE *input)
 {
-}
+    struct stat st;
+    const int wait = fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode);
 
-typedef void (*s1_signal_chain_prototype)(float i_s1, float q_s1,
-                                          struct time2_algorithm_s1 *t2_algo_s1,
-                                          struct runlength_algorithm_s1 *rl_algo_s1,
-                                          float (*polar_discriminator_s1_function)(float i, float q));
+    burst_queue_init(&burst_queue, BURST_POOL_SIZE, BURST_MAX_SAMPLES, wait);
+    telegram_output = burst_collect;
+
+    if (pthread_create(&burst_worker_thread, NULL, burst_worker, NULL) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot start the burst decoder thread!\n");
+        exit(EXIT_FAILURE);
+    }
+}
 
-void s1_signal_chain(float i_s1, float q_s1,
-                      struct time2_algorithm_s1 *t2_algo_s1,
-                      struct runlength_algorithm_s1 *rl_algo_s1,
-                      float (*polar_discriminator_s1_function)(float i, float q))
+/* Decodes the bursts still in progress and waits for the worker thread. */
+static void burst_pipeline_finish(struct receiver_work *rx)
 {
-    static int16_t old_clock_s1 = INT16_MIN;
-    static unsigned clock_lock_s1 = 0;
+    if (rx->burst_t1_c1.current) burst_finish(rx->burst_t1_c1.current);
+    if (rx->burst_s1.current) burst_finish(rx->burst_s1.current);
+    rx->burst_t1_c1.current = rx->burst_s1.current = NULL;
 
-    // Demodulate.
-    const float _delta_phi_s1 = polar_discriminator_s1_function(i_s1, q_s1);
-    //int16_t demodulated_signal = (INT16_MAX-1)*delta_phi;
-    //fwrite(&demodulated_signal, sizeof(demodulated_signal), 1, demod_out);
+    burst_queue_close(&burst_queue);
+    pthread_join(burst_worker_thread, NULL);
+    burst_queue_free(&burst_queue);
+}
 
-    // Post-filtering to prevent bit errors because of signal jitter.
-    float delta_phi_s1 = lp_fir_butter_800kHz_32kHz_36kHz(_delta_phi_s1);
-    //float delta_phi_s1 = equalizer_s1(_delta_phi_s1, _delta_phi_s1 >= 0.f ? 1.f : -1.f);
-    if (opts_remove_dc_offset) delta_phi_s1 = s1_remove_dc_offset_demod(delta_phi_s1);
-    //int16_t demodulated_signal = (INT16_MAX-1)*delta_phi_s1;
-    //fwrite(&demodulated_signal, sizeof(demodulated_signal), 1, demod_out2_s1);
+/* Processes n complex samples of interleaved u8 i/q data. */
+SIGNAL_CHAIN_TEMPLATE void receiver_process(struct receiver_work *rx, const uint8_t *samples, size_t n,
+                                            const int t1_c1_processing_enabled,
+                                            const int s1_processing_enabled,
+                                            const int s1_t1_c1_simultaneously,
+                                            const int squelch_enabled,
+                                            const int burst_mode)
+{
+    dsp_u8_to_iq(samples, rx->i_unfilt, rx->q_unfilt, n);
 
-    // Get the bit!
-    unsigned bit_s1 = (delta_phi_s1 >= 0) ? (1u<<PACKET_DATABIT_SHIFT) : (0u<<PACKET_DATABIT_SHIFT);
-    //int16_t u = bit ? (INT16_MAX-1) : 0;
-    //fwrite(&u, sizeof(u), 1, rawbits_out);
+    // rtl_sdr -f 868.35M -s 2400000 - 2>/dev/null | build/rtl_wmbus -d 3
+    //shift_freq(&i_unfilt, &q_unfilt, 600, 2400);
 
-    // --- rssi filtering section begin ---
-    // We are using one simple filter to rssi value in order to
-    // prevent unexpected "splashes" in signal power.
-    float rssi_s1 = sqrtf(i_s1*i_s1 + q_s1*q_s1);
-    rssi_s1 = rssi_filter_s1(rssi_s1); // comment out, if rssi filtering is unwanted
-    // --- rssi filtering section end ---
+    const float *i_s1_unfilt = rx->i_unfilt;
+    const float *q_s1_unfilt = rx->q_unfilt;
 
-    // --- runlength algorithm section begin ---
-    #if RUN_LENGTH_ALGORITHM_ENABLED
-    if (opts_run_length_algorithm_enabled)
+    if (s1_t1_c1_simultaneously)
     {
-        runlength_algorithm_s1(bit_s1, rssi_s1, rl_algo_s1);
+        shift_freq_plus_minus325(rx->i_unfilt, rx->q_unfilt, rx->i_minus_unfilt, rx->q_minus_unfilt, n);
+        i_s1_unfilt = rx->i_minus_unfilt;
+        q_s1_unfilt = rx->q_minus_unfilt;
     }
-    #endif
-    // --- runlength algorithm section end ---
 
+    // Low-Pass-Filtering before decimation is necessary, to ensure
+    // that i and q signals don't contain frequencies above new sample
+    // rate. Moving average can be viewed as a low pass filter.
+    if (t1_c1_processing_enabled)
+    {
+        const size_t n_prev = rx->n_prev_t1_c1;
+        float *i_t1_c1 = &rx->i_t1_c1[1 + n_prev];
+        float *q_t1_c1 = &rx->q_t1_c1[1 + n_prev];
 
-    // --- time2 algorithm section begin ---
-    #if TIME2_ALGORITHM_ENABLED
-    if (opts_time2_algorithm_enabled)
+        const size_t n_t1_c1 = moving_average_t1_c1(rx->i_unfilt, n, opts_decimation_rate, i_t1_c1, 0);
+        moving_average_t1_c1(rx->q_unfilt, n, opts_decimation_rate, q_t1_c1, 1);
+
+        if (!squelch_enabled)
+        {
+            rx->process_t1_c1_chain(i_t1_c1, q_t1_c1, n_t1_c1, &rx->demod_t1_c1, &rx->t2_algo_t1_c1, &rx->rl_algo_t1_c1, &rx->ga_algo_t1_c1, &rx->mf_algo_t1_c1);
+
+            rx->i_t1_c1[0] = i_t1_c1[n_t1_c1 - 1];
+            rx->q_t1_c1[0] = q_t1_c1[n_t1_c1 - 1];
+        }
+        else
+        {
+            if (burst_mode)
+            {
+                burst_capture(&rx->squelch_t1_c1, &rx->burst_t1_c1, &rx->i_t1_c1[1], &rx->q_t1_c1[1], n_prev, n_t1_c1);
+            }
+            else
+            {
+                const int was_open = rx->squelch_t1_c1.open;
+
+                if (squelch_update(&rx->squelch_t1_c1, dsp_energy(i_t1_c1, q_t1_c1, n_t1_c1), n_t1_c1))
+                {
+                    if (!was_open && n_prev > 0)
+                    {
+                        rx->process_t1_c1_chain(&rx->i_t1_c1[1], &rx->q_t1_c1[1], n_prev,
+                                                &rx->demod_t1_c1, &rx->t2_algo_t1_c1, &rx->rl_algo_t1_c1, &rx->ga_algo_t1_c1, &rx->mf_algo_t1_c1);
+                    }
+                    rx->process_t1_c1_chain(i_t1_c1, q_t1_c1, n_t1_c1, &rx->demod_t1_c1, &rx->t2_algo_t1_c1, &rx->rl_algo_t1_c1, &rx->ga_algo_t1_c1, &rx->mf_algo_t1_c1);
+                }
+                else if (was_open)
+                {
+                    receiver_reset_t1_c1(rx);
+                }
+            }
+
+            // The current block becomes the pre-roll of the next one.
+            rx->i_t1_c1[0] = i_t1_c1[-1];
+            rx->q_t1_c1[0] = q_t1_c1[-1];
+            memmove(&rx->i_t1_c1[1], i_t1_c1, n_t1_c1 * sizeof(rx->i_t1_c1[0]));
+            memmove(&rx->q_t1_c1[1], q_t1_c1, n_t1_c1 * sizeof(rx->q_t1_c1[0]));
+            rx->n_prev_t1_c1 = n_t1_c1;
+        }
+    }
+
+    if (s1_processing_enabled)
     {
-        // --- clock recovery section begin ---
-        // The time-2 method is implemented: push squared signal through a bandpass
-        // tuned close to the symbol rate. Saturating band-pass output produces a
-        // rectangular pulses with the required timing information.
-        // Clock-Signal is crossing zero in half period.
-        const int16_t clock_s1 = (bp_iir_cheb1_800kHz_22kHz_30kHz_34kHz_42kHz(delta_phi_s1 * delta_phi_s1) >= 0) ? INT16_MAX : INT16_MIN;
-        //fwrite(&clock_s1, sizeof(clock_s1), 1, clock_out);
+        const size_t n_prev = rx->n_prev_s1;
+        float *i_s1 = &rx->i_s1[1 + n_prev];
+        float *q_s1 = &rx->q_s1[1 + n_prev];
+
+        const size_t n_s1 = moving_average_s1(i_s1_unfilt, n, opts_decimation_rate, i_s1, 0);
+        moving_average_s1(q_s1_unfilt, n, opts_decimation_rate, q_s1, 1);
 
-        if (clock_s1 > old_clock_s1)
-        {   // Clock signal rising edge detected.
-            clock_lock_s1 = 1;
+        if (!squelch_enabled)
+        {
+            rx->process_s1_chain(i_s1, q_s1, n_s1, &rx->demod_s1, &rx->t2_algo_s1, &rx->rl_algo_s1, &rx->ga_algo_s1, &rx->mf_algo_s1);
+
+            rx->i_s1[0] = i_s1[n_s1 - 1];
+            rx->q_s1[0] = q_s1[n_s1 - 1];
         }
-        else if (clock_s1 == INT16_MAX)
-        {   // Clock signal is still high.
-            if (clock_lock_s1 < opts_CLOCK_LOCK_THRESHOLD_S1)
-            {   // Skip up to (opts_CLOCK_LOCK_THRESHOLD_S1 - 1) clock bits
-                // to get closer to the middle of the data bit.
-                clock_lock_s1++;
+        else
+        {
+            if (burst_mode)
+            {
+                burst_capture(&rx->squelch_s1, &rx->burst_s1, &rx->i_s1[1], &rx->q_s1[1], n_prev, n_s1);
             }
-            else if (clock_lock_s1 == opts_CLOCK_LOCK_THRESHOLD_S1)
-            {   // Sample data bit at CLOCK_LOCK_THRESHOLD_S1 clock bit position.
-                clock_lock_s1++;
-                time2_algorithm_s1(bit_s1, rssi_s1, t2_algo_s1);
-                //int16_t u = bit ? (INT16_MAX-1) : 0;
-                //fwrite(&u, sizeof(u), 1, bits_out);
+            else
+            {
+                const int was_open = rx->squelch_s1.open;
+
+                if (squelch_update(&rx->squelch_s1, dsp_energy(i_s1, q_s1, n_s1), n_s1))
+                {
+                    if (!was_open && n_prev > 0)
+                    {
+                        rx->process_s1_chain(&rx->i_s1[1], &rx->q_s1[1], n_prev, &rx->demod_s1, &rx->t2_algo_s1, &rx->rl_algo_s1, &rx->ga_algo_s1, &rx->mf_algo_s1);
+                    }
+                    rx->process_s1_chain(i_s1, q_s1, n_s1, &rx->demod_s1, &rx->t2_algo_s1, &rx->rl_algo_s1, &rx->ga_algo_s1, &rx->mf_algo_s1);
+                }
+                else if (was_open)
+                {
+                    receiver_reset_s1(rx);
+                }
             }
+
+            // The current block becomes the pre-roll of the next one.
+            rx->i_s1[0] = i_s1[-1];
+            rx->q_s1[0] = q_s1[-1];
+            memmove(&rx->i_s1[1], i_s1, n_s1 * sizeof(rx->i_s1[0]));
+            memmove(&rx->q_s1[1], q_s1, n_s1 * sizeof(rx->q_s1[0]));
+            rx->n_prev_s1 = n_s1;
         }
-        old_clock_s1 = clock_s1;
-        // --- clock recovery section end ---
     }
-    #endif
-    // --- time2 algorithm section end ---
 }
 
-void s1_signal_chain_empty(float i_s1, float q_s1,
-                           struct time2_algorithm_s1 *t2_algo_s1,
-                           struct runlength_algorithm_s1 *rl_algo_s1,
-                           float (*polar_discriminator_s1_function)(float i, float q))
+#define RECEIVER_INDEX(t1_c1, s1, simultaneously, squelch, burst) \
+    ((t1_c1) << 4 | (s1) << 3 | (simultaneously) << 2 | (squelch) << 1 | (burst))
+
+#define RECEIVER_INSTANCE(t1_c1, s1, simultaneously, squelch, burst)                                                           \
+static void receiver_process_##t1_c1##s1##simultaneously##squelch##burst(struct receiver_work *rx, const uint8_t *samples, size_t n) \
+{                                                                                                                            \
+    receiver_process(rx, samples, n, t1_c1, s1, simultaneously, squelch, burst);                                             \
+}
+
+#define RECEIVER_ENTRY(t1_c1, s1, simultaneously, squelch, burst) \
+    [RECEIVER_INDEX(t1_c1, s1, simultaneously, squelch, burst)] = receiver_process_##t1_c1##s1##simultaneously##squelch##burst,
+
+OPTION_VARIANTS_OF_5(RECEIVER_INSTANCE)
+
+static const receiver_process_prototype RECEIVER_PROCESS[] = { OPTION_VARIANTS_OF_5(RECEIVER_ENTRY) };
+
+/* Resets the receiver state and picks the instances matching the program options. */
+static void receiver_init(struct receiver_work *rx)
+{
+    memset(rx->i_t1_c1, 0, sizeof(rx->i_t1_c1));
+    memset(rx->q_t1_c1, 0, sizeof(rx->q_t1_c1));
+    memset(rx->i_s1, 0, sizeof(rx->i_s1));
+    memset(rx->q_s1, 0, sizeof(rx->q_s1));
+
+    rx->t2_algo_t1_c1.clock_lock_threshold = opts_CLOCK_LOCK_THRESHOLD_T1_C1;
+    rx->t2_algo_s1.clock_lock_threshold = opts_CLOCK_LOCK_THRESHOLD_S1;
+    sync_detector_init(&rx->t2_algo_t1_c1.sync, ACCESS_CODE_T1_C1, ACCESS_CODE_T1_C1_BITS, opts_access_code_errors_t1_c1);
+    sync_detector_init(&rx->rl_algo_t1_c1.sync, ACCESS_CODE_T1_C1, ACCESS_CODE_T1_C1_BITS, opts_access_code_errors_t1_c1);
+    sync_detector_init(&rx->t2_algo_s1.sync, ACCESS_CODE_S1, ACCESS_CODE_S1_BITS, opts_access_code_errors_s1);
+    sync_detector_init(&rx->rl_algo_s1.sync, ACCESS_CODE_S1, ACCESS_CODE_S1_BITS, opts_access_code_errors_s1);
+    sync_detector_init(&rx->ga_algo_t1_c1.sync, ACCESS_CODE_T1_C1, ACCESS_CODE_T1_C1_BITS, opts_access_code_errors_t1_c1);
+    sync_detector_init(&rx->ga_algo_s1.sync, ACCESS_CODE_S1, ACCESS_CODE_S1_BITS, opts_access_code_errors_s1);
+    sync_correlator_init(&rx->mf_algo_t1_c1.correlator, MATCHED_FILTER_PATTERN_T1_C1, MATCHED_FILTER_PATTERN_CHIPS,
+                         MATCHED_FILTER_SAMPLES_PER_CHIP_T1_C1, MATCHED_FILTER_THRESHOLD);
+    sync_correlator_init(&rx->mf_algo_s1.correlator, MATCHED_FILTER_PATTERN_S1, MATCHED_FILTER_PATTERN_CHIPS,
+                         MATCHED_FILTER_SAMPLES_PER_CHIP_S1, MATCHED_FILTER_THRESHOLD);
+    rx->mf_algo_t1_c1.sampler.period_nominal = MATCHED_FILTER_SAMPLES_PER_CHIP_T1_C1;
+    rx->mf_algo_s1.sampler.period_nominal = MATCHED_FILTER_SAMPLES_PER_CHIP_S1;
+    sync_correlator_init(&rx->burst_t1_c1.gate, MATCHED_FILTER_PATTERN_T1_C1, MATCHED_FILTER_PATTERN_CHIPS,
+                         MATCHED_FILTER_SAMPLES_PER_CHIP_T1_C1, BURST_GATE_THRESHOLD);
+    sync_correlator_init(&rx->burst_s1.gate, MATCHED_FILTER_PATTERN_S1, MATCHED_FILTER_PATTERN_CHIPS,
+                         MATCHED_FILTER_SAMPLES_PER_CHIP_S1, BURST_GATE_THRESHOLD);
+
+    receiver_reset_t1_c1(rx);
+    receiver_reset_s1(rx);
+
+    rx->n_prev_t1_c1 = 0;
+    rx->n_prev_s1 = 0;
+    squelch_init(&rx->squelch_t1_c1, opts_squelch_threshold_db);
+    squelch_init(&rx->squelch_s1, opts_squelch_threshold_db);
+    rx->burst_t1_c1.channel = BURST_CHANNEL_T1_C1;
+    rx->burst_t1_c1.current = NULL;
+    rx->burst_t1_c1.overrun = 0;
+    rx->burst_s1.channel = BURST_CHANNEL_S1;
+    rx->burst_s1.current = NULL;
+    rx->burst_s1.overrun = 0;
+
+    const unsigned chain = SIGNAL_CHAIN_INDEX(!!opts_accurate_atan, !!opts_remove_dc_offset,
+                                              !!opts_run_length_algorithm_enabled, !!opts_time2_algorithm_enabled,
+                                              !!opts_gardner_algorithm_enabled, !!opts_matched_filter_algorithm_enabled);
+
+    rx->process_t1_c1_chain = T1_C1_SIGNAL_CHAINS[chain];
+    rx->process_s1_chain = S1_SIGNAL_CHAINS[chain];
+    rx->process = RECEIVER_PROCESS[RECEIVER_INDEX(!!opts_t1_c1_processing_enabled, !!opts_s1_processing_enabled,
+                                                  !!opts_s1_t1_c1_simultaneously, opts_squelch_threshold_db > 0.f,
+                                                  !!opts_burst_mode)];
+}
+
+#if WINDOWS_BUILD == 0
+/* Seconds since the epoch or local time as "2024-01-31", "2024-01-31T12:00" or "2024-01-31T12:00:00". */
+static int parse_query_time(const char *s, int64_t *us)
+{
+    struct tm tm = {0};
+    char *end;
+
+    const long long seconds = strtoll(s, &end, 10);
+    if (*end == '\0')
+    {
+        *us = seconds * 1000000;
+        return 0;
+    }
+
+    const int fields = sscanf(s, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    if (fields != 3 && fields != 5 && fields != 6) return -1;
+
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    *us = (int64_t)mktime(&tm) * 1000000;
+    return 0;
+}
+
+/* rtl_wmbus query dir ident [from [to]] */
+static int run_store_query(int argc, char *argv[])
+{
+    int64_t from_us = INT64_MIN, to_us = INT64_MAX;
+    uint32_t ident;
+
+    if (argc < 3 || argc > 5 || meter_parse_ident(argv[2], &ident) != 0 ||
+        (argc > 3 && parse_query_time(argv[3], &from_us) != 0) ||
+        (argc > 4 && parse_query_time(argv[4], &to_us) != 0))
+    {
+        fprintf(stderr, "rtl_wmbus: usage: query dir ident [from [to]], ident in 8 hex digits, times as seconds since the epoch or 2024-01-31T12:00:00\n");
+        return EXIT_FAILURE;
+    }
+
+    const long found = telegram_store_query(argv[1], ident, from_us, to_us);
+    telegram_writer_flush(&telegram_writer);
+
+    return found < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static struct telegram_ring telegram_ring;
+
+/* Added to the telegram tees with -W. */
+static void telegram_ring_output(const struct telegram *t)
+{
+    struct telegram_line line;
+
+    telegram_render_binary(&line, t);
+    if (line.length) telegram_ring_write(&telegram_ring, line.data, line.length);
+}
+
+/* rtl_wmbus follow ring: prints the datagrams published in the ring from now on. */
+static int run_ring_follow(int argc, char *argv[])
 {
+    static const char *const MODES[] = { "", "T1", "C1", "S1" };
+    struct telegram_ring_reader r;
+    uint8_t record[TELEGRAM_RING_RECORD_SIZE];
+    uint64_t lost = 0;
+    size_t n;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "rtl_wmbus: usage: follow ring\n");
+        return EXIT_FAILURE;
+    }
+
+    if (telegram_ring_reader_open(&r, argv[1]) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot open the ring \"%s\": %s\n", argv[1], errno == EINVAL ? "not a ring of this version" : strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    for (;;)
+    {
+        while ((n = telegram_ring_read(&r, record, sizeof(record))) >= TELEGRAM_BINARY_HEADER_LENGTH)
+        {
+            struct telegram_binary_header h;
+
+            telegram_binary_decode(&h, record);
+
+            const struct telegram t =
+            {
+                .algorithm = "",
+                .mode = MODES[h.mode < 4 ? h.mode : 0],
+                .crc_ok = (h.flags & TELEGRAM_BINARY_CRC_OK) != 0,
+                .ok_3outof6 = (h.flags & TELEGRAM_BINARY_3OUTOF6_OK) != 0,
+                .time_ns = (int64_t)h.timestamp_ns,
+                .packet_rssi = h.packet_rssi,
+                .current_rssi = h.current_rssi,
+                .serial = h.ident,
+                .data = &record[TELEGRAM_BINARY_HEADER_LENGTH],
+                .length = n - TELEGRAM_BINARY_HEADER_LENGTH,
+                .sample = h.sample,
+            };
+            telegram_print(&t);
+        }
+
+        if (r.lost != lost)
+        {
+            fprintf(stderr, "rtl_wmbus: %llu datagrams overwritten before they were read\n", (unsigned long long)(r.lost - lost));
+            lost = r.lost;
+        }
+
+        telegram_writer_flush(&telegram_writer);
+        nanosleep(&(struct timespec){ .tv_nsec = 10000000 }, NULL);
+    }
+
+    return EXIT_SUCCESS;
 }
+#endif
 
 int main(int argc, char *argv[])
 {
@@ -1229,8 +2922,62 @@ int main(int argc, char *argv[])
     #endif /* DEBUG */
     #endif /* WINDOWS_BUILD == 1 */
 
+    dsp_kernels_init();
+    t1_c1_packet_decoder_init_tables();
+    s1_packet_decoder_init_tables();
+    mbus_records_init_tables();
+
+#if WINDOWS_BUILD == 0
+    if (argc > 1 && strcmp(argv[1], "query") == 0) return run_store_query(argc - 1, &argv[1]);
+    if (argc > 1 && strcmp(argv[1], "follow") == 0) return run_ring_follow(argc - 1, &argv[1]);
+#endif
+
     process_options(argc, argv);
 
+#if WINDOWS_BUILD == 1
+    if (telegram_render == telegram_render_binary) _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    if (telegram_writer.flush_lines != 1) atexit(telegram_writer_flush_at_exit);
+
+    if (opts_key_file && wmbus_keys_load(&wmbus_keys, opts_key_file) != 0) exit(EXIT_FAILURE);
+    if (opts_parse_headers) telegram_fields = wmbus_frame_print_fields;
+
+#if WINDOWS_BUILD == 0
+    if (opts_store_dir)
+    {
+        if (telegram_store_open(&telegram_store, opts_store_dir) != 0) exit(EXIT_FAILURE);
+        telegram_tee_add(telegram_store_output);
+    }
+
+    if (opts_ring_path)
+    {
+        if (telegram_ring_create(&telegram_ring, opts_ring_path, opts_ring_slots ? opts_ring_slots : TELEGRAM_RING_DEFAULT_SLOTS) != 0)
+        {
+            fprintf(stderr, "rtl_wmbus: cannot create the ring \"%s\": %s\n", opts_ring_path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        telegram_tee_add(telegram_ring_output);
+    }
+
+    if (telegram_socket.destinations)
+    {
+        telegram_send = telegram_socket_output;
+        telegram_send_tick = telegram_socket_tick;
+    }
+#endif
+
+    if (meter_filter_enabled(&meter_filter))
+    {
+        if (meter_filter_load(&meter_filter) != 0) exit(EXIT_FAILURE);
+#if WINDOWS_BUILD == 0
+        struct sigaction hup;
+        hup.sa_handler = sig_hup_handler;
+        sigemptyset(&hup.sa_mask);
+        hup.sa_flags = SA_RESTART;
+        sigaction(SIGHUP, &hup, NULL);
+#endif
+    }
+
 #if CHECK_FLOW == 1
     struct sigaction old_alarm;
     struct sigaction new_alarm;
@@ -1246,31 +2993,40 @@ int main(int argc, char *argv[])
     }
 #endif
 
-    __attribute__((__aligned__(16))) uint8_t samples[4096];
+    __attribute__((__aligned__(16))) uint8_t samples[2*DSP_BLOCK_SIZE];
     const int fs_kHz = opts_decimation_rate*800; // Sample rate [kHz] as a multiple of 800 kHz.
-    float i_t1_c1, q_t1_c1;
-    float i_s1, q_s1;
-
 
-    unsigned decimation_rate_index = 0;
-
-    struct time2_algorithm_t1_c1 t2_algo_t1_c1;
-    time2_algorithm_t1_c1_reset(&t2_algo_t1_c1);
-
-    struct time2_algorithm_s1 t2_algo_s1;
-    time2_algorithm_s1_reset(&t2_algo_s1);
+    static struct receiver_work rx;
+    receiver_init(&rx);
 
-    struct runlength_algorithm_t1_c1 rl_algo_t1_c1;
-    runlength_algorithm_reset_t1_c1(&rl_algo_t1_c1);
+    if (opts_limit_change || opts_limit_interval_s)
+    {
+        meter_limit_init(&meter_limit, opts_limit_change, (uint64_t)opts_limit_interval_s * fs_kHz * 1000u);
+        telegram_output = telegram_sink = meter_limit_output;
+    }
 
-    struct runlength_algorithm_s1 rl_algo_s1;
-    runlength_algorithm_reset_s1(&rl_algo_s1);
+    if (opts_output_queue && telegram_queue_start(&telegram_queue) != 0) exit(EXIT_FAILURE);
 
-    t1_c1_signal_chain_prototype process_t1_c1_chain = opts_t1_c1_processing_enabled ? t1_c1_signal_chain: t1_c1_signal_chain_empty;
-    s1_signal_chain_prototype process_s1_chain = opts_s1_processing_enabled ? s1_signal_chain : s1_signal_chain_empty;
+#if WINDOWS_BUILD == 0
+    if (telegram_sink == meter_limit_output || opts_output_queue || telegram_send == telegram_socket_output || opts_burst_mode)
+    {
+        struct sigaction usr1;
+        usr1.sa_handler = sig_usr1_handler;
+        sigemptyset(&usr1.sa_mask);
+        usr1.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &usr1, NULL);
+    }
+#endif
 
-    float (*polar_discriminator_t1_c1_function)(float i, float q) = opts_accurate_atan ? polar_discriminator_t1_c1 : polar_discriminator_t1_c1_inaccurate;
-    float (*polar_discriminator_s1_function)(float i, float q) = opts_accurate_atan ? polar_discriminator_s1 : polar_discriminator_s1_inaccurate;
+    if (opts_burst_mode)
+    {   // The burst decoder prints every datagram of a burst once anyway.
+        burst_pipeline_start(stdin);
+    }
+    else if (opts_dedup_window_ms > 0)
+    {
+        telegram_dedup_init(&telegram_dedup, (uint64_t)opts_dedup_window_ms * fs_kHz, opts_dedup_merge);
+        telegram_output = telegram_dedup_output;
+    }
 
     FILE *input = stdin;
     //input = fopen("samples/samples2.bin", "rb");
@@ -1286,13 +3042,6 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    //demod_out = fopen("demod.bin", "wb");
-    //demod_out2_t1_c1 = fopen("demod2_t1_c1.bin", "wb");
-    //demod_out2_s1 = fopen("demod2_s1.bin", "wb");
-    //clock_out = fopen("clock.bin", "wb");
-    //bits_out = fopen("bits.bin", "wb");
-    //rawbits_out = fopen("rawbits.bin", "wb");
-
     setup_lookup_tables_for_frequency_translation(fs_kHz);
 
     while (!feof(input))
@@ -1307,54 +3056,46 @@ int main(int argc, char *argv[])
             break;
         }
 
-        for (size_t k = 0; k < sizeof(samples)/sizeof(samples[0]); k += 2)   // +2 : i and q interleaved
-        {
-            const float i_unfilt = ((float)(samples[k])     - 127.5f);
-            const float q_unfilt = ((float)(samples[k + 1]) - 127.5f);
-
-            // rtl_sdr -f 868.35M -s 2400000 - 2>/dev/null | build/rtl_wmbus -d 3
-            //shift_freq(&i_unfilt, &q_unfilt, 600, 2400);
-
-            float i_t1_c1_unfilt = i_unfilt;
-            float q_t1_c1_unfilt = q_unfilt;
-
-            float i_s1_unfilt = i_unfilt;
-            float q_s1_unfilt = q_unfilt;
-
-            if (opts_s1_t1_c1_simultaneously)
-            {
-                shift_freq_plus_minus325(&i_t1_c1_unfilt, &q_t1_c1_unfilt, &i_s1_unfilt, &q_s1_unfilt, fs_kHz);
-                //shift_freq_plus_minus325(&i_s1_unfilt, &q_s1_unfilt, &i_t1_c1_unfilt, &q_t1_c1_unfilt, fs_kHz); // Just to test T1/C1 at 869.275M.
-            }
-
-            // Low-Pass-Filtering before decimation is necessary, to ensure
-            // that i and q signals don't contain frequencies above new sample
-            // rate. Moving average can be viewed as a low pass filter.
-            i_t1_c1 = moving_average_t1_c1(i_t1_c1_unfilt, 0);
-            q_t1_c1 = moving_average_t1_c1(q_t1_c1_unfilt, 1);
-
-            #if 0
-            equalizer_complex_t1_c1(&i_t1_c1, &q_t1_c1);
-            #endif
+        rx.process(&rx, samples, DSP_BLOCK_SIZE);
+        if (telegram_output == telegram_dedup_output) telegram_dedup_tick(&telegram_dedup, DSP_BLOCK_SIZE);
+        __atomic_add_fetch(&telegram_clock, DSP_BLOCK_SIZE, __ATOMIC_RELAXED);
+        if (!opts_output_queue) telegram_tick(); // else the writer thread does
 
-            // Low-Pass-Filtering before decimation is necessary, to ensure
-            // that i and q signals don't contain frequencies above new sample
-            // rate. Moving average can be viewed as a low pass filter.
-            i_s1 = moving_average_s1(i_s1_unfilt, 0);
-            q_s1 = moving_average_s1(q_s1_unfilt, 1);
-
-            #if 0
-            equalizer_complex_s1(&i_s1, &q_s1); // FIXME: Function does not exist.
-            #endif
-
-            ++decimation_rate_index;
-            if (decimation_rate_index < opts_decimation_rate) continue;
-            decimation_rate_index = 0;
+#if WINDOWS_BUILD == 0
+        if (meter_filter_reload_requested)
+        {
+            meter_filter_reload_requested = 0;
+            meter_filter_load(&meter_filter);
+        }
 
-            process_t1_c1_chain(i_t1_c1, q_t1_c1, &t2_algo_t1_c1, &rl_algo_t1_c1, polar_discriminator_t1_c1_function);
-            process_s1_chain(i_s1, q_s1, &t2_algo_s1, &rl_algo_s1, polar_discriminator_s1_function);
+        if (statistics_requested)
+        {
+            statistics_requested = 0;
+            if (telegram_sink == meter_limit_output) meter_limit_print_statistics(&meter_limit, stderr, 1);
+            if (opts_output_queue) telegram_queue_print_statistics(&telegram_queue, stderr);
+            if (telegram_send == telegram_socket_output) telegram_socket_print_statistics(&telegram_socket, stderr);
+            if (opts_burst_mode) burst_print_statistics(stderr);
         }
+#endif
+    }
+
+    if (opts_burst_mode)
+    {
+        burst_pipeline_finish(&rx);
+        burst_print_statistics(stderr);
+    }
+    if (telegram_output == telegram_dedup_output) telegram_dedup_flush(&telegram_dedup);
+    if (telegram_sink == meter_limit_output) meter_limit_print_statistics(&meter_limit, stderr, 0);
+    if (opts_output_queue)
+    {
+        telegram_queue_stop(&telegram_queue);
+        telegram_queue_print_statistics(&telegram_queue, stderr);
     }
+#if WINDOWS_BUILD == 0
+    if (opts_store_dir) telegram_store_close(&telegram_store);
+    if (opts_ring_path) telegram_ring_close(&telegram_ring);
+    if (telegram_send == telegram_socket_output) telegram_socket_close(&telegram_socket);
+#endif
 
     if (opts_check_flow)
     {
@@ -1,39 +1,50 @@
+#ifndef RTL_WMBUS_UTIL_H
+#define RTL_WMBUS_UTIL_H
+
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 
+
+/* Wall clock time in nanoseconds since the epoch, 0 if not available. */
+static inline int64_t make_time_ns(void)
+{
 #if WINDOWS_BUILD
+  return (int64_t)time(NULL) * 1000000000;
 #else
-#include <sys/time.h>
-#endif
+  struct timespec ts;
+  if (clock_gettime(CLOCK_REALTIME, &ts) != 0)
+	return 0;
 
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
 
-inline int make_time_string(char* timestamp, size_t timestamp_size)
+/* Formats a time taken by make_time_ns() as "2024-01-31 12:34:56.123456". */
+static inline int make_time_string(char* timestamp, size_t timestamp_size, int64_t time_ns)
 {
   memset(timestamp, 0, timestamp_size);
 
-#if WINDOWS_BUILD
-  time_t now;
-  if (time(&now) == NULL)
-	return -1;
+  const time_t seconds = (time_t)(time_ns / 1000000000);
 
-  struct tm* timeinfo = gmtime(&now);
+#if WINDOWS_BUILD
+  struct tm* timeinfo = gmtime(&seconds);
   if (timeinfo == NULL)
 	return -1;
 
-  strftime(timestamp, timestamp_size, "%Y-%m-%d %H:%M:%S.000000", timeinfo);
+  const size_t n = strftime(timestamp, timestamp_size, "%Y-%m-%d %H:%M:%S", timeinfo);
 #else
-  struct timeval tv;
-  if (gettimeofday(&tv, NULL) != 0)
-	return -1;
-
   struct tm timeinfo;
-  if (localtime_r(&tv.tv_sec, &timeinfo) == NULL)
+  if (localtime_r(&seconds, &timeinfo) == NULL)
 	return -1;
 
-  char fmt[timestamp_size];
-  strftime(fmt, sizeof(fmt), "%Y-%m-%d %H:%M:%S.%%06u", &timeinfo);
-  snprintf(timestamp, timestamp_size, fmt, tv.tv_usec);
+  const size_t n = strftime(timestamp, timestamp_size, "%Y-%m-%d %H:%M:%S", &timeinfo);
 #endif
+  snprintf(&timestamp[n], timestamp_size - n, ".%06u", (unsigned)(time_ns % 1000000000 / 1000));
 
   return 0;
 }
+
+#endif /* RTL_WMBUS_UTIL_H */
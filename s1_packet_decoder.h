@@ -32,73 +32,61 @@
 #include <stdio.h>
 #include <string.h>
 
-static const uint8_t MANCHESTER_IEEE_802_3[4] = {
-    0xFF, 0x01, 0x00, 0xFF // According to wireless MBus spec.: "01b” representing a “one”; "10b" representing a "zero".
+/* The decoder collects the 16 chips of a Manchester coded byte and decodes it at once. */
+enum s1_packet_decoder_state
+{
+    S1_IDLE,   // waiting for the access code
+    S1_LFIELD,
+    S1_DATA,
+    S1_DONE,
 };
 
-struct s1_packet_decoder_work;
-typedef void (*s1_packet_decoder_state)(unsigned bit, struct s1_packet_decoder_work *decoder);
-
-static void s1_idle(unsigned bit, struct s1_packet_decoder_work *decoder);
-static void s1_done(unsigned bit, struct s1_packet_decoder_work *decoder);
-static void s1_rx_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
-static void s1_rx_bit2(unsigned bit, struct s1_packet_decoder_work *decoder);
+#define S1_CHIPS_PER_BYTE 16u
 
-static void s1_rx_first_mode_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
-static void s1_rx_last_mode_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
+/* According to wireless MBus spec.: "01b" representing a "one"; "10b" representing a "zero".
+   Four chip pairs give a nibble; S1_MANCHESTER_ERROR is set if one of the pairs is invalid. */
+#define S1_MANCHESTER_ERROR 0xFFu
+static uint8_t S1_MANCHESTER_NIBBLE[1u<<8];
 
-static void s1_rx_first_lfield_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
-static void s1_rx_last_lfield_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
+static void s1_packet_decoder_init_tables(void)
+{
+    for (unsigned k = 0; k < (1u<<8); k++)
+    {
+        unsigned nibble = 0;
 
-static void s1_rx_first_data_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
-static void s1_rx_last_data_bit(unsigned bit, struct s1_packet_decoder_work *decoder);
+        for (int pair = 3; pair >= 0; pair--)
+        {
+            const unsigned chips = (k >> (2*pair)) & 0b11;
+
+            if (chips == 0b00 || chips == 0b11)
+            {
+                nibble = S1_MANCHESTER_ERROR;
+                break;
+            }
+            nibble = (nibble << 1) | (chips & 1u);
+        }
 
+        S1_MANCHESTER_NIBBLE[k] = (uint8_t)nibble;
+    }
+}
 
-static const s1_packet_decoder_state s1_decoder_states[] =
+/* Position of the last chip of the earliest invalid pair among the first count chips of a byte,
+   the newest chip in bit 0 of chips; count if all complete pairs are valid. */
+static inline unsigned s1_first_invalid_chip(uint32_t chips, unsigned count)
 {
-    s1_idle,                                       // 0
-
-    s1_rx_first_lfield_bit,                        // 1
-    s1_rx_bit2,                                    // 2
-    s1_rx_bit,                                     // 3
-    s1_rx_bit2,                                    // 4
-    s1_rx_bit,                                     // 5
-    s1_rx_bit2,                                    // 6
-    s1_rx_bit,                                     // 7
-    s1_rx_bit2,                                    // 8
-    s1_rx_bit,                                     // 9
-    s1_rx_bit2,                                    // 10
-    s1_rx_bit,                                     // 11
-    s1_rx_bit2,                                    // 12
-    s1_rx_bit,                                     // 13
-    s1_rx_bit2,                                    // 14
-    s1_rx_bit,                                     // 15
-    s1_rx_last_lfield_bit,                         // 16
-
-    s1_rx_first_data_bit,                          // 17
-    s1_rx_bit2,                                    // 18
-    s1_rx_bit,                                     // 19
-    s1_rx_bit2,                                    // 20
-    s1_rx_bit,                                     // 21
-    s1_rx_bit2,                                    // 22
-    s1_rx_bit,                                     // 23
-    s1_rx_bit2,                                    // 24
-    s1_rx_bit,                                     // 25
-    s1_rx_bit2,                                    // 26
-    s1_rx_bit,                                     // 27
-    s1_rx_bit2,                                    // 28
-    s1_rx_bit,                                     // 29
-    s1_rx_bit2,                                    // 30
-    s1_rx_bit,                                     // 31
-    s1_rx_last_data_bit,                           // 32
-
-    s1_done,                                       // 33
-};
+    const unsigned paired = count & ~1u;
+    const uint32_t pairs = chips >> (count & 1u);
+    const uint32_t invalid = ~(pairs ^ (pairs >> 1)) & 0x5555u & ((1u << paired) - 1);
+
+    return invalid ? paired - 1 - (31 - __builtin_clz(invalid)) : count;
+}
 
 
 struct s1_packet_decoder_work
 {
-    const s1_packet_decoder_state *state;
+    enum s1_packet_decoder_state state;
+    uint32_t shift;  // chips of the current byte, the newest one in bit 0
+    unsigned count;  // chips in shift
     unsigned current_rssi;
     unsigned packet_rssi;
     union
@@ -112,173 +100,158 @@ struct s1_packet_decoder_work
     };
     unsigned l;
     unsigned L;
-    unsigned mode;
-    unsigned byte;
+    struct wmbus_crc_blocks crc;
     __attribute__((__aligned__(16))) uint8_t packet[290]; // max. packet length with L- and all CRC-Fields
-    char timestamp[64];
 };
 
 static int in_rx_s1_packet_decoder(struct s1_packet_decoder_work *decoder)
 {
-    return (decoder->state == &s1_decoder_states[0]) ? 0 : 1;
+    return (decoder->state == S1_IDLE) ? 0 : 1;
 }
 
+/* Only the header fields are reset; the packet is written before it is read. */
 static void reset_s1_packet_decoder(struct s1_packet_decoder_work *decoder)
 {
-    memset(decoder, 0, sizeof(*decoder));
-    decoder->state = &s1_decoder_states[0];
+    decoder->state = S1_IDLE;
+    decoder->shift = 0;
+    decoder->count = 0;
+    decoder->current_rssi = 0;
+    decoder->packet_rssi = 0;
+    decoder->flags = 0;
+    decoder->l = 0;
+    decoder->L = 0;
+    decoder->crc.abort = opts_crc_abort;
 }
 
-static void s1_idle(unsigned bit, struct s1_packet_decoder_work *decoder)
+static void s1_decode_byte(struct s1_packet_decoder_work *decoder, unsigned chips)
 {
-    if (!(bit & PACKET_PREAMBLE_DETECTED_MASK))
+    const unsigned byte = (S1_MANCHESTER_NIBBLE[chips >> 8] << 4) | S1_MANCHESTER_NIBBLE[chips & 0xFFu];
+
+    if (decoder->state == S1_LFIELD)
     {
-        reset_s1_packet_decoder(decoder);
-    }
-}
+        decoder->l = 0;
+        decoder->packet[decoder->l++] = byte;
+        decoder->L = FULL_TLG_LENGTH_FROM_L_FIELD[byte];
+        decoder->state = S1_DATA;
 
-static void s1_done(unsigned bit, struct s1_packet_decoder_work *decoder)
-{
-    (void)bit;
-    (void)decoder;
+        if (!wmbus_crc_blocks_start(&decoder->crc, decoder->L, 0) && decoder->crc.abort) reset_s1_packet_decoder(decoder);
+    }
+    else
+    {
+        decoder->packet[decoder->l++] = byte;
+        if (!wmbus_crc_blocks_update(&decoder->crc, decoder->packet, decoder->l) && decoder->crc.abort) reset_s1_packet_decoder(decoder);
+        else if (decoder->l == METER_FILTER_HEADER_LENGTH && !meter_filter_wanted(&meter_filter, decoder->packet)) reset_s1_packet_decoder(decoder);
+        else if (decoder->l >= decoder->L) decoder->state = S1_DONE;
+    }
 }
 
-static void s1_rx_bit(unsigned bit, struct s1_packet_decoder_work *decoder)
+static void s1_packet_decoder_output(struct s1_packet_decoder_work *decoder, unsigned rssi, const char *algorithm)
 {
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-}
+    decoder->crc_ok = decoder->crc.failed ^ 1; // All blocks have been checked while receiving.
 
-static void s1_rx_bit2(unsigned bit, struct s1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
+    // The serial of a datagram too short to carry one reads as 0.
+    if (decoder->L < 8) memset(&decoder->packet[decoder->L], 0, 8 - decoder->L);
+    const uint32_t serial = get_serial(decoder->packet);
 
-    const unsigned b = MANCHESTER_IEEE_802_3[decoder->byte & 0b11];
+    decoder->L = cook_pkt(decoder->packet, decoder->L);
 
-    if (b == 0xFFu)
+    const struct telegram t =
     {
-        reset_s1_packet_decoder(decoder);
-        return;
-    }
-
-    decoder->byte >>= 2;
-    decoder->byte <<= 1;
-    decoder->byte |= b;
-}
+        .algorithm = algorithm,
+        .mode = "S1",
+        .crc_ok = decoder->crc_ok,
+        .ok_3outof6 = 1,
+        .time_ns = make_time_ns(),
+        .packet_rssi = decoder->packet_rssi,
+        .current_rssi = rssi,
+        .serial = serial,
+        .data = decoder->packet,
+        .length = decoder->L,
+    };
+    telegram_output(&t);
 
-static void s1_rx_first_lfield_bit(unsigned bit, struct s1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-    decoder->packet_rssi = decoder->current_rssi;
+    reset_s1_packet_decoder(decoder);
 }
 
-static void s1_rx_last_lfield_bit(unsigned bit, struct s1_packet_decoder_work *decoder)
+/** @brief Decode n <= 64 chips of a datagram being received at once.
+ *
+ *  @param chips the first chip in bit n-1, the last one in bit 0
+ *  @param rssi of every chip, in order of arrival
+ *  @return number of chips consumed; less than n if the datagram was complete or dropped before.
+ */
+static unsigned s1_packet_decoder_chips(uint64_t chips, unsigned n, const unsigned *rssi,
+                                        struct s1_packet_decoder_work *decoder, const char *algorithm)
 {
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
+    unsigned k = 0;
 
-    const unsigned b = MANCHESTER_IEEE_802_3[decoder->byte & 0b11];
-
-    if (b == 0xFFu)
+    while (k < n && decoder->state != S1_IDLE)
     {
-        reset_s1_packet_decoder(decoder);
-        return;
-    }
+        const unsigned need = S1_CHIPS_PER_BYTE - decoder->count;
+        const unsigned take = (n - k < need) ? n - k : need;
 
-    decoder->byte >>= 2;
-    decoder->byte <<= 1;
-    decoder->byte |= b;
+        if (decoder->state == S1_LFIELD && decoder->count == 0) decoder->packet_rssi = rssi[k];
 
-    decoder->L = decoder->byte;
-    decoder->l = 0;
-    decoder->packet[decoder->l++] = decoder->L;
-    decoder->L = FULL_TLG_LENGTH_FROM_L_FIELD[decoder->L];
-}
+        const uint32_t shift = (decoder->shift << take) | (uint32_t)((chips >> (n - k - take)) & ((1ull << take) - 1));
 
-static void s1_rx_first_data_bit(unsigned bit, struct s1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
+        // Stop receiving packet at an invalid Manchester pair.
+        const unsigned invalid = k + s1_first_invalid_chip(shift, decoder->count + take) - decoder->count;
 
-static void s1_rx_last_data_bit(unsigned bit, struct s1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
+        // Stop receiving packet if current rssi below threshold unless that chip completes the packet.
+        // The current packet seems to be collided with an another one.
+        unsigned weak = k;
+        while (weak < k + take && rssi[weak] >= PACKET_CAPTURE_THRESHOLD) weak++;
 
-    const unsigned b = MANCHESTER_IEEE_802_3[decoder->byte & 0b11];
+        if (invalid < k + take && invalid <= weak)
+        {
+            reset_s1_packet_decoder(decoder);
+            return invalid + 1;
+        }
 
-    if (b == 0xFFu)
-    {
-        reset_s1_packet_decoder(decoder);
-        return;
-    }
+        if (weak + 1 < k + take || (weak + 1 == k + take && take < need))
+        {
+            reset_s1_packet_decoder(decoder);
+            return weak + 1;
+        }
 
-    decoder->byte >>= 2;
-    decoder->byte <<= 1;
-    decoder->byte |= b;
+        decoder->shift = shift;
+        decoder->count += take;
+        k += take;
+        decoder->current_rssi = rssi[k - 1];
 
-    decoder->packet[decoder->l++] = decoder->byte;
+        if (decoder->count == S1_CHIPS_PER_BYTE)
+        {
+            s1_decode_byte(decoder, decoder->shift);
+            decoder->shift = 0;
+            decoder->count = 0;
+        }
 
-    if (decoder->l < decoder->L)
-    {
-        decoder->state = &s1_decoder_states[17]; // s1_rx_first_data_bit
-    }
-    else
-    {
-        make_time_string(decoder->timestamp, sizeof(decoder->timestamp));
+        if (decoder->state == S1_DONE)
+        {
+            s1_packet_decoder_output(decoder, rssi[k - 1], algorithm);
+        }
+        else if (weak < k)
+        {
+            reset_s1_packet_decoder(decoder);
+        }
     }
+
+    return k;
 }
 
+/* Feeds one chip; a chip with PACKET_PREAMBLE_DETECTED_MASK set starts a datagram. */
 static void s1_packet_decoder(unsigned bit, unsigned rssi, struct s1_packet_decoder_work *decoder, const char *algorithm)
 {
-    decoder->current_rssi = rssi;
-
-    (*decoder->state++)(bit, decoder);
-
-    if (*decoder->state == s1_idle)
-    {
-        // nothing
-    }
-    else if (*decoder->state == s1_done)
-    {
-        decoder->crc_ok = check_calc_crc_wmbus(decoder->packet, decoder->L) ? 1 : 0;
-
-        if (!opts_show_used_algorithm) algorithm = "";
-        fprintf(stdout, "%s%s;%u;%u;%s;%u;%u;%08X;", algorithm, "S1",
-               decoder->crc_ok,
-               1,
-               decoder->timestamp,
-               decoder->packet_rssi,
-                rssi,
-                get_serial(decoder->packet));
-
-#if 0
-        fprintf(stdout, "0x");
-        for (size_t l = 0; l < decoder->L; l++) fprintf(stdout, "%02x", decoder->packet[l]);
-        fprintf(stdout, ";");
-#endif
-
-#if 1
-        decoder->L = cook_pkt(decoder->packet, decoder->L);
-        fprintf(stdout, "0x");
-        for (size_t l = 0; l < decoder->L; l++) fprintf(stdout, "%02x", decoder->packet[l]);
-#endif
-
-        fprintf(stdout, "\n");
-        fflush(stdout);
-
-        reset_s1_packet_decoder(decoder);
-    }
-    else
-    {
-        // Stop receiving packet if current rssi below threshold.
-        // The current packet seems to be collided with an another one.
-        if (rssi < PACKET_CAPTURE_THRESHOLD)
+    if (decoder->state == S1_IDLE)
+    {   // Fast path: waiting for the access code.
+        if ((bit & PACKET_PREAMBLE_DETECTED_MASK) && rssi >= PACKET_CAPTURE_THRESHOLD)
         {
-            reset_s1_packet_decoder(decoder);
+            decoder->current_rssi = rssi;
+            decoder->state = S1_LFIELD;
         }
+        return;
     }
+
+    s1_packet_decoder_chips(bit & PACKET_DATABIT_MASK, 1, &rssi, decoder, algorithm);
 }
 
 #endif /* S1_PACKET_DECODER_H */
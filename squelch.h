@@ -0,0 +1,93 @@
+#ifndef SQUELCH_H
+#define SQUELCH_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Energy squelch. The mean power of every block of samples is compared to a
+ * noise floor which follows the block power down at once and rises slowly
+ * otherwise, so it settles on the power of the idle channel. The squelch
+ * opens when a block is more than the threshold above the noise floor and
+ * closes again after a few quiet blocks.
+*/
+
+#include <math.h>
+#include <stddef.h>
+
+#define SQUELCH_FLOOR_RISE 1.002f // per block; about 7 dB/s at 1.6MHz sample rate
+#define SQUELCH_HANG_BLOCKS 8u    // quiet blocks before closing, about 10 ms at 1.6MHz
+#define SQUELCH_FLOOR_MIN 1e-6f   // keeps the floor rising after all-zero blocks
+
+struct squelch
+{
+    float threshold; // linear power ratio to the noise floor
+    float floor;     // noise floor, at least SQUELCH_FLOOR_MIN
+    int initialized; // the floor was set by a block
+    unsigned hang;   // quiet blocks still to go before closing
+    int open;
+};
+
+static void squelch_init(struct squelch *sq, float threshold_db)
+{
+    sq->threshold = powf(10.f, threshold_db / 10.f);
+    sq->floor = SQUELCH_FLOOR_MIN;
+    sq->initialized = 0;
+    sq->hang = 0;
+    sq->open = 0;
+}
+
+/** @brief Update the squelch with the energy of a block of n samples.
+ *
+ *  @return 1 if the channel is open, 0 otherwise.
+ */
+static int squelch_update(struct squelch *sq, float energy, size_t n)
+{
+    const float power = (n > 0) ? energy / n : 0.f;
+
+    if (!sq->initialized || power < sq->floor) sq->floor = power;
+    else sq->floor *= SQUELCH_FLOOR_RISE;
+
+    if (sq->floor < SQUELCH_FLOOR_MIN) sq->floor = SQUELCH_FLOOR_MIN;
+    sq->initialized = 1;
+
+    if (power > sq->floor * sq->threshold)
+    {
+        sq->hang = SQUELCH_HANG_BLOCKS;
+        sq->open = 1;
+    }
+    else if (sq->hang > 0)
+    {
+        sq->hang--;
+    }
+    else
+    {
+        sq->open = 0;
+    }
+
+    return sq->open;
+}
+
+#endif /* SQUELCH_H */
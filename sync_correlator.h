@@ -0,0 +1,182 @@
+#ifndef SYNC_CORRELATOR_H
+#define SYNC_CORRELATOR_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Soft decision sync word detector. The end of the preamble and the access
+ * code are known chip by chip, so the demodulated signal is correlated with
+ * that pattern (a matched filter) instead of slicing it into bits first.
+ * Every chip of the pattern is the sum of the samples over one chip period;
+ * the correlation needs one multiply-add per chip and sample then.
+ *
+ * The correlation is normalized by the signal variance over the pattern, so
+ * it is 1 for a noise free signal whatever its level is. Its peaks give the
+ * timing of the first data chip to a sample. The mean of the signal over the
+ * pattern is the frequency offset, since the pattern has as many 1 chips as
+ * 0 chips, and the rest of the variance is the noise power.
+*/
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "dsp_kernels.h"
+
+#define SYNC_CORRELATOR_MAX_CHIPS 32u
+#define SYNC_CORRELATOR_MAX_BOX 32u    // samples per chip
+#define SYNC_CORRELATOR_MAX_SPAN 1024u // samples covered by the pattern
+
+struct sync_correlator_peak
+{
+    size_t at;         // sample of the block in the middle of the first chip after the pattern
+    float correlation; // normalized, 1 for a noise free signal
+    float level;       // mean of the signal over the pattern, i.e. the frequency offset
+    float deviation;   // half of the distance between 1 and 0 chips
+    float snr;         // deviation^2 to noise power
+};
+
+struct sync_correlator
+{
+    unsigned chips;
+    unsigned box;       // samples summed per chip
+    float threshold;    // minimal normalized correlation of a peak
+    float taps[SYNC_CORRELATOR_MAX_CHIPS];  // +1 for 1 chips, -1 for 0 chips
+    float ones[SYNC_CORRELATOR_MAX_CHIPS];
+    unsigned delays[SYNC_CORRELATOR_MAX_CHIPS]; // of the chip sums from the end of the pattern
+
+    double sum, sum2;   // running sums of x and x^2 over the last box samples
+    float x[SYNC_CORRELATOR_MAX_BOX + DSP_BLOCK_SIZE];
+    float s[SYNC_CORRELATOR_MAX_SPAN + DSP_BLOCK_SIZE];  // chip sums of x ...
+    float s2[SYNC_CORRELATOR_MAX_SPAN + DSP_BLOCK_SIZE]; // ... and of x^2
+
+    float correlation[DSP_BLOCK_SIZE], mean[DSP_BLOCK_SIZE], power[DSP_BLOCK_SIZE];
+
+    struct sync_correlator_peak best; // largest correlation so far, not yet reported
+    unsigned countdown;               // samples to go until best is reported; 0 if there is no candidate
+};
+
+/** @brief Set up the correlator.
+ *
+ *  @param pattern chips to look for, the last one in bit 0
+ *  @param chips number of chips in the pattern
+ *  @param samples_per_chip chip period in samples, needn't be an integer
+ *  @param threshold minimal normalized correlation of a peak, 0...1
+ */
+static void sync_correlator_init(struct sync_correlator *sc, uint64_t pattern, unsigned chips, float samples_per_chip, float threshold)
+{
+    memset(sc, 0, sizeof(*sc));
+
+    sc->chips = chips;
+    sc->box = (unsigned)lrintf(samples_per_chip);
+    sc->threshold = threshold;
+
+    for (unsigned j = 0; j < chips; j++)
+    {
+        sc->taps[j] = ((pattern >> j) & 1u) ? 1.f : -1.f;
+        sc->ones[j] = 1.f;
+        sc->delays[j] = (unsigned)lrintf(j * samples_per_chip);
+    }
+}
+
+/* Forgets the signal seen so far. */
+static void sync_correlator_reset(struct sync_correlator *sc)
+{
+    sc->sum = sc->sum2 = 0.;
+    memset(sc->x, 0, sizeof(sc->x));
+    memset(sc->s, 0, sizeof(sc->s));
+    memset(sc->s2, 0, sizeof(sc->s2));
+    sc->countdown = 0;
+}
+
+/** @brief Correlate a block of n <= DSP_BLOCK_SIZE samples with the pattern.
+ *
+ *  A peak is reported half a chip after it, when no larger correlation
+ *  followed; that is in the middle of the first chip after the pattern.
+ *
+ *  @return number of peaks written to peaks, in order of at.
+ */
+static size_t sync_correlator_process(struct sync_correlator *sc, const float *x, size_t n,
+                                      struct sync_correlator_peak *peaks, size_t max_peaks)
+{
+    float *const xb = &sc->x[SYNC_CORRELATOR_MAX_BOX];
+    float *const s = &sc->s[SYNC_CORRELATOR_MAX_SPAN];
+    float *const s2 = &sc->s2[SYNC_CORRELATOR_MAX_SPAN];
+    const unsigned box = sc->box;
+
+    memcpy(xb, x, n * sizeof(x[0]));
+
+    for (size_t k = 0; k < n; k++)
+    {
+        const float old = xb[(ptrdiff_t)k - (ptrdiff_t)box];
+        sc->sum += xb[k] - old;
+        sc->sum2 += xb[k]*xb[k] - old*old;
+        s[k] = (float)sc->sum;
+        s2[k] = (float)sc->sum2;
+    }
+
+    dsp_correlate(s, sc->taps, sc->delays, sc->chips, sc->correlation, n);
+    dsp_correlate(s, sc->ones, sc->delays, sc->chips, sc->mean, n);
+    dsp_correlate(s2, sc->ones, sc->delays, sc->chips, sc->power, n);
+
+    const float scale = 1.f / (float)(sc->chips * box);
+    const float threshold2 = sc->threshold * sc->threshold;
+    size_t count = 0;
+
+    for (size_t k = 0; k < n; k++)
+    {
+        const float deviation = sc->correlation[k] * scale;
+        const float level = sc->mean[k] * scale;
+        const float variance = sc->power[k] * scale - level*level;
+
+        if (deviation > 0.f && variance > 0.f && deviation*deviation >= threshold2 * variance &&
+            (sc->countdown == 0 || deviation*deviation > sc->best.correlation*sc->best.correlation * variance))
+        {
+            const float noise = fmaxf(variance - deviation*deviation, 1e-12f);
+
+            sc->best.correlation = deviation / sqrtf(variance);
+            sc->best.level = level;
+            sc->best.deviation = deviation;
+            sc->best.snr = deviation*deviation / noise;
+            sc->countdown = (box + 1) / 2;
+        }
+        else if (sc->countdown > 0 && --sc->countdown == 0 && count < max_peaks)
+        {
+            peaks[count] = sc->best;
+            peaks[count].at = k;
+            count++;
+        }
+    }
+
+    // Keep the history the next block needs.
+    memmove(sc->x, &sc->x[n], SYNC_CORRELATOR_MAX_BOX * sizeof(sc->x[0]));
+    memmove(sc->s, &sc->s[n], SYNC_CORRELATOR_MAX_SPAN * sizeof(sc->s[0]));
+    memmove(sc->s2, &sc->s2[n], SYNC_CORRELATOR_MAX_SPAN * sizeof(sc->s2[0]));
+
+    return count;
+}
+
+#endif /* SYNC_CORRELATOR_H */
@@ -0,0 +1,107 @@
+#ifndef SYNC_DETECTOR_H
+#define SYNC_DETECTOR_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Access code ("sync word") detector working on packed bits. Bits coming out
+ * of the clock recovery are collected into a 64-bit word together with their
+ * rssi values (sync_detector_push). Once the word is full or the block ends,
+ * the caller searches it for the access code at all bit offsets at once
+ * (sync_detector_search), hands the collected bits to the packet decoder
+ * with the preamble flag set on the exact bits the access code ends with,
+ * and marks them consumed (sync_detector_consumed).
+ *
+ * The search tolerates up to SYNC_DETECTOR_MAX_ERRORS wrong bits in the
+ * access code.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "dsp_kernels.h"
+
+#define SYNC_DETECTOR_MAX_ERRORS DSP_SYNC_SEARCH_MAX_ERRORS // the limit of the dsp_sync_search() kernels
+
+struct sync_detector
+{
+    uint32_t access_code;
+    unsigned length; // of the access code in bits
+    unsigned errors; // Hamming distance to the access code that is still accepted
+
+    uint64_t history; // bits already searched, the newest one in bit 0
+    uint64_t bits;    // bits collected since the last search, the newest one in bit 0
+    unsigned count;   // number of bits collected
+    unsigned rssi[64];
+};
+
+static void sync_detector_init(struct sync_detector *sd, uint32_t access_code, unsigned length, unsigned errors)
+{
+    memset(sd, 0, sizeof(*sd));
+    sd->access_code = access_code;
+    sd->length = length;
+    sd->errors = errors;
+}
+
+/* Forgets the bit history. Collected bits have to be consumed before. */
+static inline void sync_detector_reset(struct sync_detector *sd)
+{
+    sd->history = 0;
+    sd->bits = 0;
+    sd->count = 0;
+}
+
+/** @brief Collects one bit.
+ *  @return true if the word is full and has to be consumed by the caller.
+ */
+static inline bool sync_detector_push(struct sync_detector *sd, unsigned bit, unsigned rssi)
+{
+    sd->bits = (sd->bits << 1) | (bit & 1u);
+    sd->rssi[sd->count++] = rssi;
+
+    return sd->count == 64;
+}
+
+/** @brief Searches the collected bits for the access code.
+ *  @return bit k set if the access code ends with the k-th collected bit, counted from the newest one
+ *          (bit count - 1 is the oldest collected bit).
+ */
+static inline uint64_t sync_detector_search(const struct sync_detector *sd)
+{
+    if (sd->count == 0) return 0;
+
+    return dsp_sync_search(sd->history, sd->bits, sd->count, sd->access_code, sd->length, sd->errors);
+}
+
+/* Marks the collected bits as consumed; they become the history of the next search. */
+static inline void sync_detector_consumed(struct sync_detector *sd)
+{
+    sd->history = (sd->count < 64) ? (sd->history << sd->count) | sd->bits : sd->bits;
+    sd->bits = 0;
+    sd->count = 0;
+}
+
+#endif /* SYNC_DETECTOR_H */
@@ -31,6 +31,9 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include "dsp_kernels.h"
+#include "telegram.h"
+#include "meter_filter.h"
 
 #if !defined(PACKET_CAPTURE_THRESHOLD)
 #define PACKET_CAPTURE_THRESHOLD  5u
@@ -96,136 +99,102 @@ static const uint16_t FULL_TLG_LENGTH_FROM_L_FIELD[] =
 };
 
 
-static const uint16_t CRC16_DNP_TABLE[] =
+/* The decoder collects the bits of one unit - a 3 out of 6 coded byte, a
+   byte of C1 or the C1 mode trailer - and decodes the unit at once. */
+enum t1_c1_packet_decoder_state
 {
-    0x0000, 0x3d65, 0x7aca, 0x47af, 0xf594, 0xc8f1, 0x8f5e, 0xb23b,
-    0xd64d, 0xeb28, 0xac87, 0x91e2, 0x23d9, 0x1ebc, 0x5913, 0x6476,
-    0x91ff, 0xac9a, 0xeb35, 0xd650, 0x646b, 0x590e, 0x1ea1, 0x23c4,
-    0x47b2, 0x7ad7, 0x3d78, 0x001d, 0xb226, 0x8f43, 0xc8ec, 0xf589,
-    0x1e9b, 0x23fe, 0x6451, 0x5934, 0xeb0f, 0xd66a, 0x91c5, 0xaca0,
-    0xc8d6, 0xf5b3, 0xb21c, 0x8f79, 0x3d42, 0x0027, 0x4788, 0x7aed,
-    0x8f64, 0xb201, 0xf5ae, 0xc8cb, 0x7af0, 0x4795, 0x003a, 0x3d5f,
-    0x5929, 0x644c, 0x23e3, 0x1e86, 0xacbd, 0x91d8, 0xd677, 0xeb12,
-    0x3d36, 0x0053, 0x47fc, 0x7a99, 0xc8a2, 0xf5c7, 0xb268, 0x8f0d,
-    0xeb7b, 0xd61e, 0x91b1, 0xacd4, 0x1eef, 0x238a, 0x6425, 0x5940,
-    0xacc9, 0x91ac, 0xd603, 0xeb66, 0x595d, 0x6438, 0x2397, 0x1ef2,
-    0x7a84, 0x47e1, 0x004e, 0x3d2b, 0x8f10, 0xb275, 0xf5da, 0xc8bf,
-    0x23ad, 0x1ec8, 0x5967, 0x6402, 0xd639, 0xeb5c, 0xacf3, 0x9196,
-    0xf5e0, 0xc885, 0x8f2a, 0xb24f, 0x0074, 0x3d11, 0x7abe, 0x47db,
-    0xb252, 0x8f37, 0xc898, 0xf5fd, 0x47c6, 0x7aa3, 0x3d0c, 0x0069,
-    0x641f, 0x597a, 0x1ed5, 0x23b0, 0x918b, 0xacee, 0xeb41, 0xd624,
-    0x7a6c, 0x4709, 0x00a6, 0x3dc3, 0x8ff8, 0xb29d, 0xf532, 0xc857,
-    0xac21, 0x9144, 0xd6eb, 0xeb8e, 0x59b5, 0x64d0, 0x237f, 0x1e1a,
-    0xeb93, 0xd6f6, 0x9159, 0xac3c, 0x1e07, 0x2362, 0x64cd, 0x59a8,
-    0x3dde, 0x00bb, 0x4714, 0x7a71, 0xc84a, 0xf52f, 0xb280, 0x8fe5,
-    0x64f7, 0x5992, 0x1e3d, 0x2358, 0x9163, 0xac06, 0xeba9, 0xd6cc,
-    0xb2ba, 0x8fdf, 0xc870, 0xf515, 0x472e, 0x7a4b, 0x3de4, 0x0081,
-    0xf508, 0xc86d, 0x8fc2, 0xb2a7, 0x009c, 0x3df9, 0x7a56, 0x4733,
-    0x2345, 0x1e20, 0x598f, 0x64ea, 0xd6d1, 0xebb4, 0xac1b, 0x917e,
-    0x475a, 0x7a3f, 0x3d90, 0x00f5, 0xb2ce, 0x8fab, 0xc804, 0xf561,
-    0x9117, 0xac72, 0xebdd, 0xd6b8, 0x6483, 0x59e6, 0x1e49, 0x232c,
-    0xd6a5, 0xebc0, 0xac6f, 0x910a, 0x2331, 0x1e54, 0x59fb, 0x649e,
-    0x00e8, 0x3d8d, 0x7a22, 0x4747, 0xf57c, 0xc819, 0x8fb6, 0xb2d3,
-    0x59c1, 0x64a4, 0x230b, 0x1e6e, 0xac55, 0x9130, 0xd69f, 0xebfa,
-    0x8f8c, 0xb2e9, 0xf546, 0xc823, 0x7a18, 0x477d, 0x00d2, 0x3db7,
-    0xc83e, 0xf55b, 0xb2f4, 0x8f91, 0x3daa, 0x00cf, 0x4760, 0x7a05,
-    0x1e73, 0x2316, 0x64b9, 0x59dc, 0xebe7, 0xd682, 0x912d, 0xac48,
+    T1_C1_IDLE,      // waiting for the access code
+    T1_C1_LFIELD,    // 12 bits: 3 out of 6 coded L-field of T1 or the mode word of C1
+    C1_MODE_TRAILER, // 4 bits
+    C1_LFIELD,       // 8 bits
+    T1_DATA,         // 12 bits per byte
+    C1_DATA,         // 8 bits per byte
+    T1_C1_DONE,
 };
 
+static const unsigned T1_C1_UNIT_BITS[] = { 0, 12, 4, 8, 12, 8, 0 };
 
-struct t1_c1_packet_decoder_work;
-typedef void (*t1_c1_packet_decoder_state)(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+/* Both 3 out of 6 codewords of a byte at once; T1_3OUTOF6_ERROR is set if one of them is invalid. */
+#define T1_3OUTOF6_ERROR 0x100u
+static uint16_t T1_3OUTOF6_BYTE[1u<<12];
 
-static void t1_c1_idle(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void t1_c1_done(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void t1_c1_rx_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+static void t1_c1_packet_decoder_init_tables(void)
+{
+    for (unsigned k = 0; k < (1u<<12); k++)
+    {
+        const unsigned high = HIGH_NIBBLE_3OUTOF6[k >> 6];
+        const unsigned low = LOW_NIBBLE_3OUTOF6[k & 0x3Fu];
 
-static void t1_rx_high_nibble_first_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void t1_rx_high_nibble_last_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+        T1_3OUTOF6_BYTE[k] = (uint16_t)(((high | low) & 0xFFu) | ((high == 0xFFu || low == 0xFFu) ? T1_3OUTOF6_ERROR : 0u));
+    }
+}
 
-static void t1_rx_low_nibble_first_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void t1_rx_low_nibble_last_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
 
-static void t1_rx_high_nibble_first_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void t1_rx_high_nibble_last_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+static uint16_t calc_crc_wmbus(const uint8_t *data, size_t datalen)
+{
+    uint16_t crc = dsp_crc16(0, data, datalen);
+    crc = ~crc;
+    return crc;
+}
 
-static void t1_rx_low_nibble_first_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void t1_rx_low_nibble_last_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+/* The CRC fields are checked block by block while a datagram is received:
+   frame type A has a first block of 10 bytes and blocks of 16 bytes, frame
+   type B blocks of 126 bytes, each followed by its CRC field. */
+struct wmbus_crc_blocks
+{
+    unsigned start;  // first byte of the current block
+    unsigned end;    // end of the current block including its CRC field
+    unsigned length; // of the whole datagram including all CRC fields
+    unsigned b_frame_type;
+    unsigned failed;
+    unsigned abort;  // drop the datagram as soon as one of its blocks fails; kept by wmbus_crc_blocks_start()
+};
 
-static void c1_rx_first_mode_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void c1_rx_last_mode_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+/* Default of wmbus_crc_blocks::abort. */
+extern int opts_crc_abort;
 
-static void c1_rx_first_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void c1_rx_last_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+/** @return 0 if the datagram cannot pass the CRC check anymore. */
+static int wmbus_crc_blocks_start(struct wmbus_crc_blocks *crc, unsigned length, unsigned b_frame_type)
+{
+    const unsigned first = b_frame_type ? 128 : 12;
 
-static void c1_rx_first_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
-static void c1_rx_last_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder);
+    crc->start = 0;
+    crc->end = (length < first) ? length : first;
+    crc->length = length;
+    crc->b_frame_type = b_frame_type;
+    crc->failed = (length < 12) ? 1 : 0;
 
+    return !crc->failed;
+}
 
-static const t1_c1_packet_decoder_state t1_c1_decoder_states[] =
+/** @brief Check the block just completed, if any; l bytes of packet have been received.
+ *  @return 0 if the datagram cannot pass the CRC check anymore.
+ */
+static int wmbus_crc_blocks_update(struct wmbus_crc_blocks *crc, const uint8_t *packet, unsigned l)
 {
-    t1_c1_idle,                                    // 0
-
-    t1_rx_high_nibble_first_lfield_bit,            // 1
-    t1_c1_rx_bit,                                  // 2
-    t1_c1_rx_bit,                                  // 3
-    t1_c1_rx_bit,                                  // 4
-    t1_c1_rx_bit,                                  // 5
-    t1_rx_high_nibble_last_lfield_bit,             // 6
-
-    t1_rx_low_nibble_first_lfield_bit,             // 7
-    t1_c1_rx_bit,                                  // 8
-    t1_c1_rx_bit,                                  // 9
-    t1_c1_rx_bit,                                  // 10
-    t1_c1_rx_bit,                                  // 11
-    t1_rx_low_nibble_last_lfield_bit,              // 12
-
-    t1_rx_high_nibble_first_data_bit,              // 13
-    t1_c1_rx_bit,                                  // 14
-    t1_c1_rx_bit,                                  // 15
-    t1_c1_rx_bit,                                  // 16
-    t1_c1_rx_bit,                                  // 17
-    t1_rx_high_nibble_last_data_bit,               // 18
-
-    t1_rx_low_nibble_first_data_bit,               // 19
-    t1_c1_rx_bit,                                  // 20
-    t1_c1_rx_bit,                                  // 21
-    t1_c1_rx_bit,                                  // 22
-    t1_c1_rx_bit,                                  // 23
-    t1_rx_low_nibble_last_data_bit,                // 24
-
-    t1_c1_done,                                    // 25
-
-    c1_rx_first_mode_bit,                          // 26
-    t1_c1_rx_bit,                                  // 27
-    t1_c1_rx_bit,                                  // 28
-    c1_rx_last_mode_bit,                           // 29
-
-    c1_rx_first_lfield_bit,                        // 30
-    t1_c1_rx_bit,                                  // 31
-    t1_c1_rx_bit,                                  // 32
-    t1_c1_rx_bit,                                  // 33
-    t1_c1_rx_bit,                                  // 34
-    t1_c1_rx_bit,                                  // 35
-    t1_c1_rx_bit,                                  // 36
-    c1_rx_last_lfield_bit,                         // 37
-
-    c1_rx_first_data_bit,                          // 38
-    t1_c1_rx_bit,                                  // 39
-    t1_c1_rx_bit,                                  // 40
-    t1_c1_rx_bit,                                  // 41
-    t1_c1_rx_bit,                                  // 42
-    t1_c1_rx_bit,                                  // 43
-    t1_c1_rx_bit,                                  // 44
-    c1_rx_last_data_bit,                           // 45
-
-    t1_c1_done,                                    // 46
-};
+    if (l != crc->end || crc->failed) return !crc->failed;
+
+    const unsigned size = crc->end - crc->start;
+
+    if (size < 2 || calc_crc_wmbus(&packet[crc->start], size - 2) != ((packet[crc->end - 2] << 8) | packet[crc->end - 1]))
+    {
+        crc->failed = 1;
+        return 0;
+    }
+
+    crc->start = crc->end;
+    crc->end += crc->b_frame_type ? 128 : 18;
+    if (crc->end > crc->length) crc->end = crc->length;
+
+    return 1;
+}
 
 
 struct t1_c1_packet_decoder_work
 {
-    const t1_c1_packet_decoder_state *state;
+    enum t1_c1_packet_decoder_state state;
+    uint64_t shift;  // bits of the current unit, the newest one in bit 0
+    unsigned count;  // bits in shift
     unsigned current_rssi;
     unsigned packet_rssi;
     union
@@ -242,9 +211,8 @@ struct t1_c1_packet_decoder_work
     unsigned l;
     unsigned L;
     unsigned mode;
-    unsigned byte;
+    struct wmbus_crc_blocks crc;
     __attribute__((__aligned__(16))) uint8_t packet[290]; // max. packet length with L- and all CRC-Fields
-    char timestamp[64];
 };
 
 int get_mode_a_tlg_length(uint8_t lfield)
@@ -260,214 +228,117 @@ int get_mode_b_tlg_length(uint8_t lfield)
 
 static int in_rx_t1_c1_packet_decoder(struct t1_c1_packet_decoder_work *decoder)
 {
-    return (decoder->state == &t1_c1_decoder_states[0]) ? 0 : 1;
+    return (decoder->state == T1_C1_IDLE) ? 0 : 1;
 }
 
+/* Only the header fields are reset; the packet is written before it is read. */
 static void reset_t1_c1_packet_decoder(struct t1_c1_packet_decoder_work *decoder)
 {
-    memset(decoder, 0, sizeof(*decoder));
-    decoder->state = &t1_c1_decoder_states[0];
+    decoder->state = T1_C1_IDLE;
+    decoder->shift = 0;
+    decoder->count = 0;
+    decoder->current_rssi = 0;
+    decoder->packet_rssi = 0;
+    decoder->flags = 0;
+    decoder->l = 0;
+    decoder->L = 0;
+    decoder->mode = 0;
+    decoder->crc.abort = opts_crc_abort;
 }
 
-static void t1_c1_idle(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
+static void t1_c1_decode_unit(struct t1_c1_packet_decoder_work *decoder, unsigned unit)
 {
-    if (!(bit & PACKET_PREAMBLE_DETECTED_MASK))
+    switch (decoder->state)
     {
-        reset_t1_c1_packet_decoder(decoder);
-    }
-}
-
-static void t1_c1_done(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    (void)bit;
-    (void)decoder;
-}
-
-static void t1_c1_rx_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-}
-
-static void t1_rx_high_nibble_first_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-    decoder->packet_rssi = decoder->current_rssi;
-}
-
-static void t1_rx_high_nibble_last_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-    decoder->mode = decoder->byte;
+    case T1_C1_LFIELD:
+        decoder->mode = unit;
 
-    decoder->L = HIGH_NIBBLE_3OUTOF6[decoder->byte];
-    decoder->flags = 0;
-}
+        if (T1_3OUTOF6_BYTE[unit] & T1_3OUTOF6_ERROR)
+        {
+            if (unit == C1_MODE_A)
+            {
+                decoder->b_frame_type = 0;
+                decoder->state = C1_MODE_TRAILER;
+            }
+            else if (unit == C1_MODE_B)
+            {
+                decoder->b_frame_type = 1;
+                decoder->state = C1_MODE_TRAILER;
+            }
+            else
+            {
+                reset_t1_c1_packet_decoder(decoder);
+            }
+        }
+        else
+        {
+            decoder->b_frame_type = 0;
+            decoder->c1_packet = 0;
 
-static void t1_rx_low_nibble_first_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
+            decoder->L = T1_3OUTOF6_BYTE[unit];
+            decoder->l = 0;
+            decoder->packet[decoder->l++] = decoder->L;
+            decoder->L = FULL_TLG_LENGTH_FROM_L_FIELD[decoder->L];
+            decoder->state = T1_DATA;
 
-static void t1_rx_low_nibble_last_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-    decoder->mode <<= 6;
-    decoder->mode |= decoder->byte;
+            if (!wmbus_crc_blocks_start(&decoder->crc, decoder->L, 0) && decoder->crc.abort) reset_t1_c1_packet_decoder(decoder);
+        }
+        break;
 
-    const unsigned byte = LOW_NIBBLE_3OUTOF6[decoder->byte];
+    case C1_MODE_TRAILER:
+        decoder->mode <<= 4;
+        decoder->mode |= unit;
 
-    if (decoder->L == 0xFFu || byte == 0xFFu)
-    {
-        if (decoder->mode == C1_MODE_A)
+        if (unit == C1_MODE_AB_TRAILER)
         {
-            decoder->b_frame_type = 0;
-            decoder->state = &t1_c1_decoder_states[26]; // c1_rx_first_mode_bit
-        }
-        else if (decoder->mode == C1_MODE_B)
-        {
-            decoder->b_frame_type = 1;
-            decoder->state = &t1_c1_decoder_states[26]; // c1_rx_first_mode_bit
+            decoder->c1_packet = 1;
+            decoder->state = C1_LFIELD;
         }
         else
         {
             reset_t1_c1_packet_decoder(decoder);
         }
-    }
-    else
-    {
-        decoder->b_frame_type = 0;
-        decoder->c1_packet = 0;
+        break;
 
-        decoder->L |= byte;
+    case C1_LFIELD:
+        decoder->L = unit;
         decoder->l = 0;
         decoder->packet[decoder->l++] = decoder->L;
-        decoder->L = FULL_TLG_LENGTH_FROM_L_FIELD[decoder->L];
-    }
-}
-
-static void t1_rx_high_nibble_first_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
-
-static void t1_rx_high_nibble_last_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-
-    const unsigned byte = HIGH_NIBBLE_3OUTOF6[decoder->byte];
-
-    if (byte == 0xFFu) decoder->err_3outof = 1;
-
-    decoder->packet[decoder->l] = byte;
-}
-
-static void t1_rx_low_nibble_first_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
-
-static void t1_rx_low_nibble_last_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-
-    const unsigned byte = LOW_NIBBLE_3OUTOF6[decoder->byte];
-
-    if (byte == 0xFFu) decoder->err_3outof = 1;
-
-    decoder->packet[decoder->l++] |= byte;
-
-    if (decoder->l < decoder->L)
-    {
-        decoder->state = &t1_c1_decoder_states[13]; // rx_high_nibble_first_data_bit
-    }
-    else
-    {
-        make_time_string(decoder->timestamp, sizeof(decoder->timestamp));
-    }
-}
-
-static void c1_rx_first_mode_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
-
-static void c1_rx_last_mode_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
-
-    decoder->mode <<= 4;
-    decoder->mode |= decoder->byte;
-
-    if (decoder->byte == C1_MODE_AB_TRAILER)
-    {
-        decoder->c1_packet = 1;
-    }
-    else
-    {
-        reset_t1_c1_packet_decoder(decoder);
-    }
-}
-
-static void c1_rx_first_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
-
-static void c1_rx_last_lfield_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
+        if (decoder->b_frame_type)
+        {
+            decoder->L = get_mode_b_tlg_length(decoder->L);
+        }
+        else
+        {
+            decoder->L = FULL_TLG_LENGTH_FROM_L_FIELD[decoder->L];
+        }
+        decoder->state = C1_DATA; // At least one byte follows the L-field.
 
-    decoder->L = decoder->byte;
-    decoder->l = 0;
-    decoder->packet[decoder->l++] = decoder->L;
-    if (decoder->b_frame_type)
-    {
-        decoder->L = get_mode_b_tlg_length(decoder->L); 
-    }
-    else
-    {
-        decoder->L = FULL_TLG_LENGTH_FROM_L_FIELD[decoder->L];
-    }
-}
+        if (!wmbus_crc_blocks_start(&decoder->crc, decoder->L, decoder->b_frame_type) && decoder->crc.abort) reset_t1_c1_packet_decoder(decoder);
+        break;
 
-static void c1_rx_first_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte = (bit & PACKET_DATABIT_MASK);
-}
+    case T1_DATA:
+        if (T1_3OUTOF6_BYTE[unit] & T1_3OUTOF6_ERROR) decoder->err_3outof = 1;
 
-static void c1_rx_last_data_bit(unsigned bit, struct t1_c1_packet_decoder_work *decoder)
-{
-    decoder->byte <<= 1;
-    decoder->byte |= (bit & PACKET_DATABIT_MASK);
+        decoder->packet[decoder->l++] = (uint8_t)T1_3OUTOF6_BYTE[unit];
+        if (!wmbus_crc_blocks_update(&decoder->crc, decoder->packet, decoder->l) && decoder->crc.abort) reset_t1_c1_packet_decoder(decoder);
+        else if (decoder->l == METER_FILTER_HEADER_LENGTH && !meter_filter_wanted(&meter_filter, decoder->packet)) reset_t1_c1_packet_decoder(decoder);
+        else if (decoder->l >= decoder->L) decoder->state = T1_C1_DONE;
+        break;
 
-    decoder->packet[decoder->l++] = decoder->byte;
+    case C1_DATA:
+        decoder->packet[decoder->l++] = unit;
+        if (!wmbus_crc_blocks_update(&decoder->crc, decoder->packet, decoder->l) && decoder->crc.abort) reset_t1_c1_packet_decoder(decoder);
+        else if (decoder->l == METER_FILTER_HEADER_LENGTH && !meter_filter_wanted(&meter_filter, decoder->packet)) reset_t1_c1_packet_decoder(decoder);
+        else if (decoder->l >= decoder->L) decoder->state = T1_C1_DONE;
+        break;
 
-    if (decoder->l < decoder->L)
-    {
-        decoder->state = &t1_c1_decoder_states[38]; // c1_rx_first_data_bit
-    }
-    else
-    {
-        make_time_string(decoder->timestamp, sizeof(decoder->timestamp));
+    default:
+        break;
     }
 }
 
 
-static uint16_t calc_crc_wmbus(const uint8_t *data, size_t datalen)
-{
-    uint16_t crc = 0;
-    while (datalen--) crc = CRC16_DNP_TABLE[*data++ ^ (crc >> 8)] ^ (crc << 8);
-    crc = ~crc;
-    return crc;
-}
-
 static bool check_calc_crc_wmbus(const uint8_t *data, size_t datalen)
 {
     bool crc_ok = false;
@@ -644,71 +515,109 @@ static inline uint32_t get_serial(const uint8_t *const packet)
     return serial;
 }
 
-extern int opts_show_used_algorithm;
-
-static void t1_c1_packet_decoder(unsigned bit, unsigned rssi, struct t1_c1_packet_decoder_work *decoder, const char *algorithm)
+static void t1_c1_packet_decoder_output(struct t1_c1_packet_decoder_work *decoder, unsigned rssi, const char *algorithm)
 {
-    decoder->current_rssi = rssi;
+    decoder->crc_ok = decoder->crc.failed ^ 1; // All blocks have been checked while receiving.
 
-    (*decoder->state++)(bit, decoder);
+    // The serial of a datagram too short to carry one reads as 0.
+    if (decoder->L < 8) memset(&decoder->packet[decoder->L], 0, 8 - decoder->L);
+    const uint32_t serial = get_serial(decoder->packet);
 
-    if (*decoder->state == t1_c1_idle)
+    if (decoder->b_frame_type)
     {
-        // nothing
+        decoder->L = cook_pkt_b_frame_type(decoder->packet, decoder->L);
     }
-    else if (*decoder->state == t1_c1_done)
+    else
     {
-        if (decoder->b_frame_type)
+        decoder->L = cook_pkt(decoder->packet, decoder->L);
+    }
+
+    const struct telegram t =
+    {
+        .algorithm = algorithm,
+        .mode = decoder->c1_packet ? "C1": "T1",
+        .crc_ok = decoder->crc_ok,
+        .ok_3outof6 = decoder->err_3outof^1,
+        .time_ns = make_time_ns(),
+        .packet_rssi = decoder->packet_rssi,
+        .current_rssi = rssi,
+        .serial = serial,
+        .data = decoder->packet,
+        .length = decoder->L,
+    };
+    telegram_output(&t);
+
+    reset_t1_c1_packet_decoder(decoder);
+}
+
+/** @brief Decode n <= 64 bits of a datagram being received at once.
+ *
+ *  @param bits the first bit in bit n-1, the last one in bit 0
+ *  @param rssi of every bit, in order of arrival
+ *  @return number of bits consumed; less than n if the datagram was complete or dropped before.
+ */
+static unsigned t1_c1_packet_decoder_bits(uint64_t bits, unsigned n, const unsigned *rssi,
+                                          struct t1_c1_packet_decoder_work *decoder, const char *algorithm)
+{
+    unsigned k = 0;
+
+    while (k < n && decoder->state != T1_C1_IDLE)
+    {
+        const unsigned need = T1_C1_UNIT_BITS[decoder->state] - decoder->count;
+        const unsigned take = (n - k < need) ? n - k : need;
+
+        if (decoder->state == T1_C1_LFIELD && decoder->count == 0) decoder->packet_rssi = rssi[k];
+
+        // Stop receiving packet if current rssi below threshold unless that bit completes the packet.
+        // The current packet seems to be collided with an another one.
+        unsigned weak = k;
+        while (weak < k + take && rssi[weak] >= PACKET_CAPTURE_THRESHOLD) weak++;
+
+        if (weak + 1 < k + take || (weak + 1 == k + take && take < need))
         {
-            decoder->crc_ok = check_calc_crc_wmbus_b_frame_type(decoder->packet, decoder->L) ? 1 : 0;
+            reset_t1_c1_packet_decoder(decoder);
+            return weak + 1;
         }
-        else
+
+        decoder->shift = (decoder->shift << take) | ((bits >> (n - k - take)) & ((1ull << take) - 1));
+        decoder->count += take;
+        k += take;
+        decoder->current_rssi = rssi[k - 1];
+
+        if (decoder->count == T1_C1_UNIT_BITS[decoder->state])
         {
-            decoder->crc_ok = check_calc_crc_wmbus(decoder->packet, decoder->L) ? 1 : 0;
+            t1_c1_decode_unit(decoder, (unsigned)decoder->shift & ((1u << decoder->count) - 1));
+            decoder->shift = 0;
+            decoder->count = 0;
         }
 
-        if (!opts_show_used_algorithm) algorithm = "";
-        fprintf(stdout, "%s%s;%u;%u;%s;%u;%u;%08X;", algorithm, decoder->c1_packet ? "C1": "T1",
-               decoder->crc_ok,
-               decoder->err_3outof^1,
-               decoder->timestamp,
-               decoder->packet_rssi,
-                rssi,
-                get_serial(decoder->packet));
-
-#if 0
-        fprintf(stdout, "0x");
-        for (size_t l = 0; l < decoder->L; l++) fprintf(stdout, "%02x", decoder->packet[l]);
-        fprintf(stdout, ";");
-#endif
-
-#if 1
-        if (decoder->b_frame_type)
+        if (decoder->state == T1_C1_DONE)
         {
-            decoder->L = cook_pkt_b_frame_type(decoder->packet, decoder->L);
+            t1_c1_packet_decoder_output(decoder, rssi[k - 1], algorithm);
         }
-        else
+        else if (weak < k && decoder->state != T1_C1_IDLE)
         {
-            decoder->L = cook_pkt(decoder->packet, decoder->L);
+            reset_t1_c1_packet_decoder(decoder);
         }
-        fprintf(stdout, "0x");
-        for (size_t l = 0; l < decoder->L; l++) fprintf(stdout, "%02x", decoder->packet[l]);
-#endif
+    }
 
-        fprintf(stdout, "\n");
-        fflush(stdout);
+    return k;
+}
 
-        reset_t1_c1_packet_decoder(decoder);
-    }
-    else
-    {
-        // Stop receiving packet if current rssi below threshold.
-        // The current packet seems to be collided with an another one.
-        if (rssi < PACKET_CAPTURE_THRESHOLD)
+/* Feeds one bit; a bit with PACKET_PREAMBLE_DETECTED_MASK set starts a datagram. */
+static void t1_c1_packet_decoder(unsigned bit, unsigned rssi, struct t1_c1_packet_decoder_work *decoder, const char *algorithm)
+{
+    if (decoder->state == T1_C1_IDLE)
+    {   // Fast path: waiting for the access code.
+        if ((bit & PACKET_PREAMBLE_DETECTED_MASK) && rssi >= PACKET_CAPTURE_THRESHOLD)
         {
-            reset_t1_c1_packet_decoder(decoder);
+            decoder->current_rssi = rssi;
+            decoder->state = T1_C1_LFIELD;
         }
+        return;
     }
+
+    t1_c1_packet_decoder_bits(bit & PACKET_DATABIT_MASK, 1, &rssi, decoder, algorithm);
 }
 
 #endif /* T1_C1_PACKET_DECODER_H */
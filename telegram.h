@@ -0,0 +1,204 @@
+#ifndef TELEGRAM_H
+#define TELEGRAM_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * A datagram received by one of the packet decoders. The decoders hand every
+ * datagram to telegram_output which prints it by default; other consumers
+ * may install their own output function.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rtl_wmbus_util.h"
+#include "telegram_binary.h"
+#include "telegram_writer.h"
+
+struct telegram
+{
+    const char *algorithm; // e.g. "rla;", printed with option -v only
+    const char *mode;      // "T1", "C1" or "S1"
+    unsigned crc_ok;
+    unsigned ok_3outof6;
+    int64_t time_ns;       // wall clock time of the datagram, see make_time_ns()
+    unsigned packet_rssi;
+    unsigned current_rssi;
+    uint32_t serial;
+    const uint8_t *data;   // datagram without CRC bytes
+    size_t length;
+    uint64_t sample;       // sample time if taken earlier, 0 for telegram_clock
+};
+
+typedef void (*telegram_output_fn)(const struct telegram *t);
+
+extern int opts_show_used_algorithm;
+
+typedef void (*telegram_fields_fn)(struct telegram_line *line, const struct telegram *t);
+
+/* Appends further fields to every printed datagram, if set. */
+static telegram_fields_fn telegram_fields = NULL;
+
+typedef void (*telegram_render_fn)(struct telegram_line *line, const struct telegram *t);
+
+/* Renders a datagram as MODE;CRC_OK;3OUTOF6OK;TIMESTAMP;PACKET_RSSI;CURRENT_RSSI;LINK_LAYER_IDENT_NO;DATAGRAM_WITHOUT_CRC_BYTES. */
+static void telegram_render_text(struct telegram_line *line, const struct telegram *t)
+{
+    char timestamp[64];
+
+    make_time_string(timestamp, sizeof(timestamp), t->time_ns);
+
+    line->length = 0;
+    if (opts_show_used_algorithm) telegram_line_puts(line, t->algorithm);
+    telegram_line_puts(line, t->mode);
+    telegram_line_putc(line, ';');
+    telegram_line_uint(line, t->crc_ok);
+    telegram_line_putc(line, ';');
+    telegram_line_uint(line, t->ok_3outof6);
+    telegram_line_putc(line, ';');
+    telegram_line_puts(line, timestamp);
+    telegram_line_putc(line, ';');
+    telegram_line_uint(line, t->packet_rssi);
+    telegram_line_putc(line, ';');
+    telegram_line_uint(line, t->current_rssi);
+    telegram_line_putc(line, ';');
+    telegram_line_hex32(line, t->serial);
+    telegram_line_append(line, ";0x", 3);
+    telegram_line_hex(line, t->data, t->length);
+
+    if (telegram_fields) telegram_fields(line, t);
+
+    if (line->length == TELEGRAM_LINE_SIZE) line->length--; // The newline is never cut off.
+    line->data[line->length++] = '\n';
+}
+
+static void telegram_print(const struct telegram *t)
+{
+    struct telegram_line line;
+
+    telegram_render_text(&line, t);
+    telegram_writer_write(&telegram_writer, line.data, line.length);
+}
+
+/* Sample time of the input, advanced by the main loop. */
+static uint64_t telegram_clock = 0;
+
+static uint64_t telegram_sample(const struct telegram *t)
+{
+    return t->sample ? t->sample : __atomic_load_n(&telegram_clock, __ATOMIC_RELAXED);
+}
+
+/* Renders a datagram as one record of the binary format, see telegram_binary.h.
+   A datagram longer than any decoder outputs gives no record (length 0). */
+static void telegram_render_binary(struct telegram_line *line, const struct telegram *t)
+{
+    uint8_t *record = (uint8_t *)line->data;
+    const size_t length = t->length;
+    const char *algorithm = t->algorithm ? t->algorithm : "";
+
+    if (length > TELEGRAM_BINARY_PAYLOAD_MAX)
+    {
+        line->length = 0;
+        return;
+    }
+
+    const struct telegram_binary_header h =
+    {
+        .length = (uint16_t)(TELEGRAM_BINARY_HEADER_LENGTH + length),
+        .version = TELEGRAM_BINARY_VERSION,
+        .mode = t->mode[0] == 'T' ? TELEGRAM_BINARY_MODE_T1 : t->mode[0] == 'C' ? TELEGRAM_BINARY_MODE_C1 : TELEGRAM_BINARY_MODE_S1,
+        .flags = (uint8_t)((t->crc_ok ? TELEGRAM_BINARY_CRC_OK : 0) | (t->ok_3outof6 ? TELEGRAM_BINARY_3OUTOF6_OK : 0)),
+        .algorithms = (uint8_t)((strstr(algorithm, "rla") ? TELEGRAM_BINARY_ALGORITHM_RLA : 0) |
+                                (strstr(algorithm, "t2a") ? TELEGRAM_BINARY_ALGORITHM_T2A : 0) |
+                                (strstr(algorithm, "gta") ? TELEGRAM_BINARY_ALGORITHM_GTA : 0) |
+                                (strstr(algorithm, "mfa") ? TELEGRAM_BINARY_ALGORITHM_MFA : 0)),
+        .payload_length = (uint16_t)length,
+        .timestamp_ns = (uint64_t)t->time_ns,
+        .sample = telegram_sample(t),
+        .packet_rssi = t->packet_rssi,
+        .current_rssi = t->current_rssi,
+        .ident = t->serial,
+    };
+
+    telegram_binary_encode(record, &h);
+    memcpy(&record[TELEGRAM_BINARY_HEADER_LENGTH], t->data, length);
+    line->length = TELEGRAM_BINARY_HEADER_LENGTH + length;
+}
+
+/* Output format of emitted datagrams: telegram_render_text or telegram_render_binary. */
+static telegram_render_fn telegram_render = telegram_render_text;
+
+/* Further consumers of every emitted datagram besides stdout, e.g. the telegram store. */
+#define TELEGRAM_TEES_MAX 4u
+static telegram_output_fn telegram_tees[TELEGRAM_TEES_MAX];
+static unsigned telegram_tee_count = 0;
+
+static void telegram_tee_add(telegram_output_fn tee)
+{
+    if (telegram_tee_count < TELEGRAM_TEES_MAX) telegram_tees[telegram_tee_count++] = tee;
+}
+
+/* Further consumer of the rendered lines or records besides stdout, e.g. the socket sink. */
+static void (*telegram_send)(const char *data, size_t n) = NULL;
+static void (*telegram_send_tick)(void) = NULL;
+
+static void telegram_write_now(const struct telegram *t)
+{
+    struct telegram_line line;
+
+    telegram_render(&line, t);
+    if (line.length)
+    {
+        telegram_writer_write(&telegram_writer, line.data, line.length);
+        if (telegram_send) telegram_send(line.data, line.length);
+    }
+    for (unsigned k = 0; k < telegram_tee_count; k++) telegram_tees[k](t);
+}
+
+/* Called regularly by the main loop or the writer thread: writes output which waited long enough. */
+static void telegram_tick(void)
+{
+    telegram_writer_tick(&telegram_writer);
+    if (telegram_send_tick) telegram_send_tick();
+}
+
+/* Writes emitted datagrams at once, or hands them over to the writer thread (telegram_queue.h). */
+static telegram_output_fn telegram_write = telegram_write_now;
+
+static void telegram_emit(const struct telegram *t)
+{
+    telegram_write(t);
+}
+
+static telegram_output_fn telegram_output = telegram_emit;
+
+/* Last stage of the output; the stages in front of it (burst, dedup) hand their datagrams over to it. */
+static telegram_output_fn telegram_sink = telegram_emit;
+
+#endif /* TELEGRAM_H */
@@ -0,0 +1,139 @@
+#ifndef TELEGRAM_BINARY_H
+#define TELEGRAM_BINARY_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Binary output format of rtl_wmbus (option "-O bin"), for consumers as well:
+ * this header depends on nothing else of rtl_wmbus.
+ *
+ * The output is a sequence of records. Every record starts with a header of
+ * TELEGRAM_BINARY_HEADER_LENGTH bytes, all fields little endian, followed by
+ * payload_length bytes of the datagram without CRC bytes (as printed in hex
+ * by the text format). The first field is the length of the whole record, so
+ * a consumer can skip records of a later version with a longer header:
+ *
+ *   offset size field
+ *        0    2 length          header and payload
+ *        2    1 version         TELEGRAM_BINARY_VERSION
+ *        3    1 mode            TELEGRAM_BINARY_MODE_*
+ *        4    1 flags           TELEGRAM_BINARY_CRC_OK, TELEGRAM_BINARY_3OUTOF6_OK
+ *        5    1 algorithms      TELEGRAM_BINARY_ALGORITHM_* which decoded the datagram
+ *        6    2 payload_length
+ *        8    8 timestamp_ns    nanoseconds since the epoch
+ *       16    8 sample          sample index of the input when the datagram was output
+ *       24    4 packet_rssi
+ *       28    4 current_rssi
+ *       32    4 ident           LINK_LAYER_IDENT_NO of the text format
+ *       36    4 reserved        0
+ *
+ * payload_length is at most TELEGRAM_BINARY_PAYLOAD_MAX, the length of a
+ * datagram whose CRC bytes could not be removed.
+ *
+ * On a little endian host the header may be copied into struct
+ * telegram_binary_header with memcpy; telegram_binary_decode() works anywhere.
+*/
+
+#include <stdint.h>
+
+#define TELEGRAM_BINARY_VERSION 1u
+#define TELEGRAM_BINARY_HEADER_LENGTH 40u
+#define TELEGRAM_BINARY_PAYLOAD_MAX 290u
+#define TELEGRAM_BINARY_RECORD_MAX (TELEGRAM_BINARY_HEADER_LENGTH + TELEGRAM_BINARY_PAYLOAD_MAX)
+
+#define TELEGRAM_BINARY_MODE_T1 1u
+#define TELEGRAM_BINARY_MODE_C1 2u
+#define TELEGRAM_BINARY_MODE_S1 3u
+
+#define TELEGRAM_BINARY_CRC_OK     (1u<<0)
+#define TELEGRAM_BINARY_3OUTOF6_OK (1u<<1)
+
+#define TELEGRAM_BINARY_ALGORITHM_RLA (1u<<0) // run length
+#define TELEGRAM_BINARY_ALGORITHM_T2A (1u<<1) // time2
+#define TELEGRAM_BINARY_ALGORITHM_GTA (1u<<2) // Gardner timing recovery
+#define TELEGRAM_BINARY_ALGORITHM_MFA (1u<<3) // matched filter
+
+struct telegram_binary_header
+{
+    uint16_t length;
+    uint8_t version;
+    uint8_t mode;
+    uint8_t flags;
+    uint8_t algorithms;
+    uint16_t payload_length;
+    uint64_t timestamp_ns;
+    uint64_t sample;
+    uint32_t packet_rssi;
+    uint32_t current_rssi;
+    uint32_t ident;
+    uint32_t reserved;
+};
+
+static inline void telegram_binary_put(uint8_t *dst, uint64_t value, unsigned size)
+{
+    for (unsigned k = 0; k < size; k++) dst[k] = (uint8_t)(value >> (8*k));
+}
+
+static inline uint64_t telegram_binary_get(const uint8_t *src, unsigned size)
+{
+    uint64_t value = 0;
+    for (unsigned k = size; k > 0; k--) value = (value << 8) | src[k - 1];
+    return value;
+}
+
+static inline void telegram_binary_encode(uint8_t dst[TELEGRAM_BINARY_HEADER_LENGTH], const struct telegram_binary_header *h)
+{
+    telegram_binary_put(&dst[0], h->length, 2);
+    dst[2] = h->version;
+    dst[3] = h->mode;
+    dst[4] = h->flags;
+    dst[5] = h->algorithms;
+    telegram_binary_put(&dst[6], h->payload_length, 2);
+    telegram_binary_put(&dst[8], h->timestamp_ns, 8);
+    telegram_binary_put(&dst[16], h->sample, 8);
+    telegram_binary_put(&dst[24], h->packet_rssi, 4);
+    telegram_binary_put(&dst[28], h->current_rssi, 4);
+    telegram_binary_put(&dst[32], h->ident, 4);
+    telegram_binary_put(&dst[36], h->reserved, 4);
+}
+
+static inline void telegram_binary_decode(struct telegram_binary_header *h, const uint8_t src[TELEGRAM_BINARY_HEADER_LENGTH])
+{
+    h->length = (uint16_t)telegram_binary_get(&src[0], 2);
+    h->version = src[2];
+    h->mode = src[3];
+    h->flags = src[4];
+    h->algorithms = src[5];
+    h->payload_length = (uint16_t)telegram_binary_get(&src[6], 2);
+    h->timestamp_ns = telegram_binary_get(&src[8], 8);
+    h->sample = telegram_binary_get(&src[16], 8);
+    h->packet_rssi = (uint32_t)telegram_binary_get(&src[24], 4);
+    h->current_rssi = (uint32_t)telegram_binary_get(&src[28], 4);
+    h->ident = (uint32_t)telegram_binary_get(&src[32], 4);
+    h->reserved = (uint32_t)telegram_binary_get(&src[36], 4);
+}
+
+#endif /* TELEGRAM_BINARY_H */
@@ -0,0 +1,188 @@
+#ifndef TELEGRAM_DEDUP_H
+#define TELEGRAM_DEDUP_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Duplicate suppression. All algorithms run in parallel, so most datagrams
+ * are decoded more than once. A datagram is printed only if the same one
+ * has not been seen within a window of sample time. Seen datagrams are kept
+ * in a fixed ring of entries, found again by a hash of the datagram.
+ *
+ * In merge mode a datagram is held back for the window: it is printed once
+ * with the algorithm tags of all copies and the rssi of the strongest copy.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "telegram.h"
+
+#define TELEGRAM_DEDUP_SLOTS 64u
+
+struct telegram_dedup_entry
+{
+    uint64_t hash;
+    uint64_t time;    // sample time of the first copy
+    unsigned pending; // merge mode: not printed yet
+    struct telegram t;
+    char algorithm[64];
+    uint8_t data[290];
+};
+
+struct telegram_dedup
+{
+    uint64_t now;    // sample time
+    uint64_t window; // in samples
+    int merge;
+    unsigned head;   // the oldest entry, used next
+    struct telegram_dedup_entry entries[TELEGRAM_DEDUP_SLOTS];
+};
+
+static struct telegram_dedup telegram_dedup;
+
+static uint64_t telegram_hash(const struct telegram *t)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ t->length ^ ((uint64_t)t->crc_ok << 32) ^ ((uint64_t)t->ok_3outof6 << 33) ^ ((uint64_t)(unsigned char)t->mode[0] << 40);
+    size_t k;
+
+    for (k = 0; k + 8 <= t->length; k += 8)
+    {
+        uint64_t w;
+        memcpy(&w, &t->data[k], sizeof(w));
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    for (; k < t->length; k++)
+    {
+        h = (h ^ t->data[k]) * 0x100000001B3ull;
+    }
+
+    return h ^ (h >> 29);
+}
+
+static int telegram_dedup_same(const struct telegram_dedup_entry *e, uint64_t hash, const struct telegram *t)
+{
+    return e->hash == hash && e->t.length == t->length && e->t.crc_ok == t->crc_ok && e->t.ok_3outof6 == t->ok_3outof6 &&
+           strcmp(e->t.mode, t->mode) == 0 && memcmp(e->data, t->data, t->length) == 0;
+}
+
+/* Appends the algorithm tag of another copy: "rla;" and "t2a;" give "rla,t2a;". */
+static void telegram_dedup_merge_tag(struct telegram_dedup_entry *e, const char *algorithm)
+{
+    const size_t length = strlen(e->algorithm);
+    const size_t add = strcspn(algorithm, ";");
+    const char *found = strstr(e->algorithm, algorithm);
+
+    if (found != NULL && (found == e->algorithm || found[-1] == ',')) return;
+    if (length == 0 || length + add + 2 > sizeof(e->algorithm)) return;
+
+    snprintf(&e->algorithm[length - 1], sizeof(e->algorithm) - length + 1, ",%.*s;", (int)add, algorithm);
+}
+
+static void telegram_dedup_print(struct telegram_dedup_entry *e)
+{
+    telegram_sink(&e->t);
+    e->pending = 0;
+}
+
+/* Installed as telegram_output. */
+static void telegram_dedup_output(const struct telegram *t)
+{
+    struct telegram_dedup *d = &telegram_dedup;
+    const uint64_t hash = telegram_hash(t);
+
+    if (t->length > sizeof(d->entries[0].data)) return;
+
+    for (unsigned k = 0; k < TELEGRAM_DEDUP_SLOTS; k++)
+    {
+        struct telegram_dedup_entry *e = &d->entries[k];
+
+        if (e->time + d->window < d->now || !telegram_dedup_same(e, hash, t)) continue;
+
+        if (e->pending)
+        {
+            telegram_dedup_merge_tag(e, t->algorithm);
+            if (t->packet_rssi > e->t.packet_rssi)
+            {
+                e->t.packet_rssi = t->packet_rssi;
+                e->t.current_rssi = t->current_rssi;
+            }
+        }
+        return;
+    }
+
+    struct telegram_dedup_entry *e = &d->entries[d->head];
+    d->head = (d->head + 1) % TELEGRAM_DEDUP_SLOTS;
+
+    if (e->pending) telegram_dedup_print(e); // The ring is full.
+
+    e->hash = hash;
+    e->time = d->now;
+    e->t = *t;
+    snprintf(e->algorithm, sizeof(e->algorithm), "%s", t->algorithm);
+    memcpy(e->data, t->data, t->length);
+    e->t.algorithm = e->algorithm;
+    e->t.data = e->data;
+    e->pending = 1;
+
+    if (!d->merge) telegram_dedup_print(e);
+}
+
+static void telegram_dedup_init(struct telegram_dedup *d, uint64_t window, int merge)
+{
+    memset(d, 0, sizeof(*d));
+    d->now = window + 1; // The empty entries are out of the window.
+    d->window = window;
+    d->merge = merge;
+}
+
+/* Advances the sample time by n samples and prints the held datagrams whose window has passed. */
+static void telegram_dedup_tick(struct telegram_dedup *d, size_t n)
+{
+    d->now += n;
+
+    for (unsigned k = 0; k < TELEGRAM_DEDUP_SLOTS; k++)
+    {
+        struct telegram_dedup_entry *e = &d->entries[(d->head + k) % TELEGRAM_DEDUP_SLOTS];
+
+        if (e->pending && e->time + d->window < d->now) telegram_dedup_print(e);
+    }
+}
+
+/* Prints all datagrams still held. */
+static void telegram_dedup_flush(struct telegram_dedup *d)
+{
+    for (unsigned k = 0; k < TELEGRAM_DEDUP_SLOTS; k++)
+    {
+        struct telegram_dedup_entry *e = &d->entries[(d->head + k) % TELEGRAM_DEDUP_SLOTS];
+
+        if (e->pending) telegram_dedup_print(e);
+    }
+}
+
+#endif /* TELEGRAM_DEDUP_H */
@@ -0,0 +1,400 @@
+#ifndef TELEGRAM_QUEUE_H
+#define TELEGRAM_QUEUE_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Asynchronous output. Writing to a stalled pipe or a full disk must not
+ * hold up the receiver: with option -Q every emitted datagram is copied into
+ * a fixed size record of a bounded ring and written (and stored) by a writer
+ * thread. Producers are the receiver thread and the burst decoder thread; they
+ * never take a lock. Every slot carries a sequence number telling whether it
+ * is free or filled for a position, so a producer claims a slot with a single
+ * compare and swap of the tail (the bounded queue of D. Vyukov).
+ *
+ * If the ring is full, the policy decides: drop the oldest queued datagram,
+ * drop the new one, or wait for the writer (no datagram gets lost when
+ * decoding a file). The writer sleeps on a condition variable while the ring
+ * is empty; a producer signals it only then.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "telegram.h"
+
+#define TELEGRAM_QUEUE_DATA_LENGTH 290u
+#define TELEGRAM_QUEUE_DEFAULT_RECORDS 1024u
+
+enum telegram_queue_policy
+{
+    TELEGRAM_QUEUE_DROP_OLDEST,
+    TELEGRAM_QUEUE_DROP_NEWEST,
+    TELEGRAM_QUEUE_BLOCK,
+};
+
+static const char *const TELEGRAM_QUEUE_POLICY_NAMES[] = { "drop-oldest", "drop-newest", "block" };
+
+struct telegram_queue_record
+{
+    uint64_t sample;
+    int64_t time_ns;
+    unsigned crc_ok;
+    unsigned ok_3outof6;
+    unsigned packet_rssi;
+    unsigned current_rssi;
+    uint32_t serial;
+    size_t length;
+    char mode[4];
+    char algorithm[64];
+    uint8_t data[TELEGRAM_QUEUE_DATA_LENGTH];
+};
+
+struct telegram_queue_slot
+{
+    size_t sequence; // == position: free for it, == position + 1: filled for it
+    struct telegram_queue_record record;
+};
+
+struct telegram_queue
+{
+    enum telegram_queue_policy policy;
+    size_t records;
+    size_t mask;
+    struct telegram_queue_slot *slots;
+    __attribute__((aligned(64))) size_t tail; // next position to fill
+    __attribute__((aligned(64))) size_t head; // next position to write
+    __attribute__((aligned(64))) int idle;    // the writer waits for datagrams
+    int closed;
+    uint64_t queued;
+    uint64_t written;
+    uint64_t dropped_oldest;
+    uint64_t dropped_newest;
+    uint64_t waits;          // producers which had to wait for a free slot
+    size_t high_water;       // most datagrams queued at once
+    pthread_mutex_t lock;    // only held around waiting, never while writing
+    pthread_cond_t wakeup;
+    pthread_t thread;
+};
+
+static struct telegram_queue telegram_queue = { .records = TELEGRAM_QUEUE_DEFAULT_RECORDS, .lock = PTHREAD_MUTEX_INITIALIZER, .wakeup = PTHREAD_COND_INITIALIZER };
+
+/* Claims the slot at the tail, NULL if the ring is full. */
+static struct telegram_queue_slot *telegram_queue_claim_tail(struct telegram_queue *q, size_t *position)
+{
+    size_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        struct telegram_queue_slot *slot = &q->slots[pos & q->mask];
+        const intptr_t diff = (intptr_t)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (intptr_t)pos;
+
+        if (diff < 0) return NULL;
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *position = pos;
+                return slot;
+            }
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Claims the slot at the head, NULL if the ring is empty. Producers use it to drop the oldest datagram. */
+static struct telegram_queue_slot *telegram_queue_claim_head(struct telegram_queue *q, size_t *position)
+{
+    size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+    for (;;)
+    {
+        struct telegram_queue_slot *slot = &q->slots[pos & q->mask];
+        const intptr_t diff = (intptr_t)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (intptr_t)(pos + 1);
+
+        if (diff < 0) return NULL;
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *position = pos;
+                return slot;
+            }
+        }
+        else
+        {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void telegram_queue_release(struct telegram_queue *q, struct telegram_queue_slot *slot, size_t position)
+{
+    __atomic_store_n(&slot->sequence, position + q->mask + 1, __ATOMIC_RELEASE);
+}
+
+static void telegram_queue_wake(struct telegram_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_signal(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void telegram_queue_copy(struct telegram_queue_record *r, const struct telegram *t)
+{
+    r->sample = telegram_sample(t);
+    r->time_ns = t->time_ns;
+    r->crc_ok = t->crc_ok;
+    r->ok_3outof6 = t->ok_3outof6;
+    r->packet_rssi = t->packet_rssi;
+    r->current_rssi = t->current_rssi;
+    r->serial = t->serial;
+    r->length = t->length < TELEGRAM_QUEUE_DATA_LENGTH ? t->length : TELEGRAM_QUEUE_DATA_LENGTH;
+    snprintf(r->mode, sizeof(r->mode), "%s", t->mode);
+    snprintf(r->algorithm, sizeof(r->algorithm), "%s", t->algorithm ? t->algorithm : "");
+    memcpy(r->data, t->data, r->length);
+}
+
+/** @brief Queues a datagram for the writer thread; waits only with the block policy. */
+static void telegram_queue_push(struct telegram_queue *q, const struct telegram *t)
+{
+    struct telegram_queue_slot *slot;
+    size_t position;
+    int waited = 0;
+
+    while ((slot = telegram_queue_claim_tail(q, &position)) == NULL)
+    {
+        if (q->policy == TELEGRAM_QUEUE_DROP_OLDEST)
+        {
+            struct telegram_queue_slot *oldest = telegram_queue_claim_head(q, &position);
+
+            if (oldest != NULL)
+            {
+                telegram_queue_release(q, oldest, position);
+                __atomic_add_fetch(&q->dropped_oldest, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+        }
+
+        if (q->policy != TELEGRAM_QUEUE_BLOCK)
+        {   // Also if the writer holds the oldest datagram just now.
+            __atomic_add_fetch(&q->dropped_newest, 1, __ATOMIC_RELAXED);
+            return;
+        }
+
+        if (!waited) __atomic_add_fetch(&q->waits, 1, __ATOMIC_RELAXED);
+        waited = 1;
+        telegram_queue_wake(q);
+        nanosleep(&(struct timespec){ .tv_nsec = 100000 }, NULL);
+    }
+
+    telegram_queue_copy(&slot->record, t);
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&q->queued, 1, __ATOMIC_RELAXED);
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->idle, __ATOMIC_RELAXED)) telegram_queue_wake(q);
+}
+
+/* Installed as telegram_write. */
+static void telegram_queue_output(const struct telegram *t)
+{
+    telegram_queue_push(&telegram_queue, t);
+}
+
+/* Takes the oldest datagram out of the ring; the slot is free again before it gets written. */
+static int telegram_queue_pop(struct telegram_queue *q, struct telegram_queue_record *r)
+{
+    size_t position;
+    struct telegram_queue_slot *slot = telegram_queue_claim_head(q, &position);
+
+    if (slot == NULL) return 0;
+
+    const size_t queued = __atomic_load_n(&q->tail, __ATOMIC_RELAXED) - position;
+    if (queued > q->high_water) __atomic_store_n(&q->high_water, queued, __ATOMIC_RELAXED);
+
+    memcpy(r, &slot->record, sizeof(*r));
+    telegram_queue_release(q, slot, position);
+    return 1;
+}
+
+static int telegram_queue_ready(struct telegram_queue *q)
+{
+    const size_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    return __atomic_load_n(&q->slots[pos & q->mask].sequence, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+static void *telegram_queue_writer(void *arg)
+{
+    struct telegram_queue *q = arg;
+    struct telegram_queue_record r;
+
+    for (;;)
+    {
+        if (telegram_queue_pop(q, &r))
+        {
+            const struct telegram t =
+            {
+                .algorithm = r.algorithm,
+                .mode = r.mode,
+                .crc_ok = r.crc_ok,
+                .ok_3outof6 = r.ok_3outof6,
+                .time_ns = r.time_ns,
+                .packet_rssi = r.packet_rssi,
+                .current_rssi = r.current_rssi,
+                .serial = r.serial,
+                .data = r.data,
+                .length = r.length,
+                .sample = r.sample,
+            };
+            telegram_write_now(&t);
+            __atomic_add_fetch(&q->written, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        telegram_tick();
+
+        pthread_mutex_lock(&q->lock);
+        __atomic_store_n(&q->idle, 1, __ATOMIC_SEQ_CST);
+
+        if (!telegram_queue_ready(q))
+        {
+            if (q->closed)
+            {
+                pthread_mutex_unlock(&q->lock);
+                break;
+            }
+
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += 10000000; // the writer's flush policy is checked every 10 ms
+            if (until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&q->wakeup, &q->lock, &until);
+        }
+
+        __atomic_store_n(&q->idle, 0, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&q->lock);
+    }
+
+    return NULL;
+}
+
+/** @brief Parse a policy like "drop-oldest" or "block,4096" (the number of records, rounded up to a power of two).
+ *  @return 0 on success, -1 if the policy is malformed.
+ */
+static int telegram_queue_parse(struct telegram_queue *q, const char *spec)
+{
+    const size_t name_length = strcspn(spec, ",");
+    size_t policy;
+
+    for (policy = 0; policy < sizeof(TELEGRAM_QUEUE_POLICY_NAMES)/sizeof(TELEGRAM_QUEUE_POLICY_NAMES[0]); policy++)
+    {
+        if (strlen(TELEGRAM_QUEUE_POLICY_NAMES[policy]) == name_length && strncmp(spec, TELEGRAM_QUEUE_POLICY_NAMES[policy], name_length) == 0) break;
+    }
+    if (policy == sizeof(TELEGRAM_QUEUE_POLICY_NAMES)/sizeof(TELEGRAM_QUEUE_POLICY_NAMES[0])) return -1;
+
+    if (spec[name_length] == ',')
+    {
+        char *end;
+        const unsigned long records = strtoul(&spec[name_length + 1], &end, 10);
+
+        if (end == &spec[name_length + 1] || *end != '\0' || records < 2 || records > (1ul << 20)) return -1;
+        q->records = records;
+    }
+
+    q->policy = (enum telegram_queue_policy)policy;
+    return 0;
+}
+
+/* Allocates the ring and starts the writer thread; emitted datagrams are queued from now on. */
+static int telegram_queue_start(struct telegram_queue *q)
+{
+    size_t records = 2;
+    while (records < q->records) records <<= 1;
+
+    q->slots = calloc(records, sizeof(q->slots[0]));
+    if (q->slots == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot allocate %zu output queue records!\n", records);
+        return -1;
+    }
+
+    for (size_t k = 0; k < records; k++) q->slots[k].sequence = k;
+    q->records = records;
+    q->mask = records - 1;
+
+    if (pthread_create(&q->thread, NULL, telegram_queue_writer, q) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot start the output writer thread!\n");
+        free(q->slots);
+        q->slots = NULL;
+        return -1;
+    }
+
+    telegram_write = telegram_queue_output;
+    return 0;
+}
+
+/* Writes the datagrams still queued and waits for the writer thread. */
+static void telegram_queue_stop(struct telegram_queue *q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_signal(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+
+    pthread_join(q->thread, NULL);
+    telegram_write = telegram_write_now;
+    free(q->slots);
+    q->slots = NULL;
+}
+
+static void telegram_queue_print_statistics(struct telegram_queue *q, FILE *stream)
+{
+    fprintf(stream, "rtl_wmbus: output queue (%s, %zu records): %llu queued, %llu written, %llu oldest dropped, %llu new dropped, %llu waits, at most %zu queued\n",
+            TELEGRAM_QUEUE_POLICY_NAMES[q->policy], q->records,
+            (unsigned long long)__atomic_load_n(&q->queued, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&q->written, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&q->dropped_oldest, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&q->dropped_newest, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&q->waits, __ATOMIC_RELAXED),
+            __atomic_load_n(&q->high_water, __ATOMIC_RELAXED));
+}
+
+#endif /* TELEGRAM_QUEUE_H */
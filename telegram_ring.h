@@ -0,0 +1,328 @@
+#ifndef TELEGRAM_RING_H
+#define TELEGRAM_RING_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Shared memory ring of the emitted datagrams (option "-W"), for consumers as
+ * well: this header depends on nothing else of rtl_wmbus but telegram_binary.h.
+ *
+ * The ring is a file, best on a tmpfs like /dev/shm, which rtl_wmbus and any
+ * number of readers map. rtl_wmbus is the only writer. Datagram n (counted
+ * since the ring was created) goes into slot n % slots as a record of the
+ * binary format. Each slot is guarded by a sequence number like a seqlock:
+ * it is 2n+1 while datagram n is being written and 2n+2 once it is complete.
+ * The head in the ring header is the number of datagrams written so far.
+ * All fields are in host byte order.
+ *
+ * A reader follows the stream without any system call: it reads a record in
+ * place and checks the sequence of the slot before and afterwards. If the
+ * writer has come round in between, the reader was overrun; it skips to the
+ * oldest datagram still in the ring and counts the lost ones:
+ *
+ *   struct telegram_ring_reader r;
+ *   uint8_t record[TELEGRAM_RING_RECORD_SIZE];
+ *   size_t n;
+ *
+ *   if (telegram_ring_reader_open(&r, "/dev/shm/rtl_wmbus") != 0) ...
+ *   for (;;)
+ *   {
+ *       while ((n = telegram_ring_read(&r, record, sizeof(record))) > 0) ... telegram_binary_decode() ...
+ *       usleep(10000); // nothing new; r.lost tells how many datagrams were missed
+ *   }
+ *
+ * telegram_ring_peek() and telegram_ring_done() give access to a record in
+ * place instead of copying it; the record is valid only if done returns 1.
+ *
+ * A restarted rtl_wmbus continues a ring of the same size where it stopped,
+ * so readers keep following. A ring of another size is replaced by a new
+ * file; readers have to open it again.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "telegram_binary.h"
+
+#define TELEGRAM_RING_MAGIC 0x474E5257u // "WRNG"
+#define TELEGRAM_RING_VERSION 1u
+#define TELEGRAM_RING_RECORD_SIZE TELEGRAM_BINARY_RECORD_MAX
+#define TELEGRAM_RING_SLOT_SIZE 384u
+#define TELEGRAM_RING_DEFAULT_SLOTS 4096u
+
+struct telegram_ring_header
+{
+    uint32_t magic;    // written last when the ring is created
+    uint32_t version;
+    uint32_t slots;    // a power of two
+    uint32_t slot_size;
+    uint64_t head;     // datagrams written
+    uint8_t reserved[40];
+};
+
+struct telegram_ring_slot
+{
+    uint64_t sequence;
+    uint32_t length;   // of the record
+    uint32_t reserved;
+    uint8_t record[TELEGRAM_RING_SLOT_SIZE - 16u];
+};
+
+static inline size_t telegram_ring_size(uint32_t slots)
+{
+    return sizeof(struct telegram_ring_header) + (size_t)slots * sizeof(struct telegram_ring_slot);
+}
+
+static inline struct telegram_ring_slot *telegram_ring_slot_at(const struct telegram_ring_header *header, uint64_t n)
+{
+    return (struct telegram_ring_slot *)((uintptr_t)header + sizeof(*header) + (size_t)(n & (header->slots - 1)) * sizeof(struct telegram_ring_slot));
+}
+
+
+struct telegram_ring
+{
+    int fd;
+    size_t size;
+    struct telegram_ring_header *header;
+};
+
+static int telegram_ring_map(struct telegram_ring *ring, size_t size)
+{
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+
+    if (map == MAP_FAILED) return -1;
+    ring->header = (struct telegram_ring_header *)map;
+    ring->size = size;
+    return 0;
+}
+
+/** @brief Create the ring at path or continue an existing one of the same size.
+ *  @return 0 on success, -1 with errno set on error.
+ */
+static int telegram_ring_create(struct telegram_ring *ring, const char *path, uint32_t slots)
+{
+    const size_t size = telegram_ring_size(slots);
+    struct stat st;
+
+    ring->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (ring->fd < 0) return -1;
+
+    if (fstat(ring->fd, &st) == 0 && (size_t)st.st_size == size && telegram_ring_map(ring, size) == 0)
+    {
+        const struct telegram_ring_header *h = ring->header;
+
+        if (h->magic == TELEGRAM_RING_MAGIC && h->version == TELEGRAM_RING_VERSION && h->slots == slots && h->slot_size == TELEGRAM_RING_SLOT_SIZE) return 0;
+
+        munmap(ring->header, size);
+    }
+
+    // Readers may still map the old file, so it is replaced rather than resized.
+    close(ring->fd);
+    if (unlink(path) != 0 && errno != ENOENT) return -1;
+
+    ring->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (ring->fd < 0) return -1;
+
+    if (ftruncate(ring->fd, (off_t)size) != 0 || telegram_ring_map(ring, size) != 0)
+    {
+        const int error = errno;
+        close(ring->fd);
+        errno = error;
+        return -1;
+    }
+
+    ring->header->version = TELEGRAM_RING_VERSION;
+    ring->header->slots = slots;
+    ring->header->slot_size = TELEGRAM_RING_SLOT_SIZE;
+    ring->header->head = 0;
+    for (uint32_t k = 0; k < slots; k++) telegram_ring_slot_at(ring->header, k)->sequence = 0;
+    __atomic_store_n(&ring->header->magic, TELEGRAM_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/* Publishes one record; the writer never waits for readers. */
+static void telegram_ring_write(struct telegram_ring *ring, const void *record, size_t length)
+{
+    const uint64_t n = ring->header->head;
+    struct telegram_ring_slot *slot = telegram_ring_slot_at(ring->header, n);
+
+    if (length > sizeof(slot->record)) length = sizeof(slot->record);
+
+    __atomic_store_n(&slot->sequence, 2*n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->length = (uint32_t)length;
+    memcpy(slot->record, record, length);
+
+    __atomic_store_n(&slot->sequence, 2*n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->header->head, n + 1, __ATOMIC_RELEASE);
+}
+
+static void telegram_ring_close(struct telegram_ring *ring)
+{
+    munmap(ring->header, ring->size);
+    close(ring->fd);
+}
+
+
+struct telegram_ring_reader
+{
+    int fd;
+    size_t size;
+    const struct telegram_ring_header *header;
+    uint64_t next;      // datagram to read next
+    uint64_t lost;      // datagrams overwritten before they were read
+    uint64_t sequence;  // of the slot handed out by telegram_ring_peek()
+};
+
+/** @brief Map the ring at path; reading starts with the next datagram written.
+ *  @return 0 on success, -1 with errno set on error (EINVAL: not a ring).
+ */
+static int telegram_ring_reader_open(struct telegram_ring_reader *r, const char *path)
+{
+    struct stat st;
+
+    memset(r, 0, sizeof(*r));
+    r->fd = open(path, O_RDONLY);
+    if (r->fd < 0) return -1;
+
+    if (fstat(r->fd, &st) != 0 || (size_t)st.st_size < sizeof(struct telegram_ring_header))
+    {
+        close(r->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (map == MAP_FAILED)
+    {
+        const int error = errno;
+        close(r->fd);
+        errno = error;
+        return -1;
+    }
+
+    r->header = (const struct telegram_ring_header *)map;
+    r->size = (size_t)st.st_size;
+
+    const uint32_t slots = r->header->slots;
+    if (__atomic_load_n(&r->header->magic, __ATOMIC_ACQUIRE) != TELEGRAM_RING_MAGIC || r->header->version != TELEGRAM_RING_VERSION ||
+        r->header->slot_size != TELEGRAM_RING_SLOT_SIZE || slots == 0 || (slots & (slots - 1)) || telegram_ring_size(slots) != r->size)
+    {
+        munmap(map, r->size);
+        close(r->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    r->next = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+/* Starts over with the oldest datagram still in the ring. */
+static void telegram_ring_reader_rewind(struct telegram_ring_reader *r)
+{
+    const uint64_t head = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+    r->next = head > r->header->slots ? head - r->header->slots + 1 : 0;
+}
+
+/** @brief The next record in place, NULL if there is none yet.
+ *  The record may be overwritten while it is read: it is valid only if telegram_ring_done() returns 1.
+ */
+static const uint8_t *telegram_ring_peek(struct telegram_ring_reader *r, size_t *length)
+{
+    const uint64_t slots = r->header->slots;
+
+    for (;;)
+    {
+        const uint64_t head = __atomic_load_n(&r->header->head, __ATOMIC_ACQUIRE);
+        if (r->next >= head) return NULL;
+
+        if (head - r->next >= slots)
+        {   // The slot of the oldest one may be written just now.
+            r->lost += head - slots + 1 - r->next;
+            r->next = head - slots + 1;
+            continue;
+        }
+
+        const struct telegram_ring_slot *slot = telegram_ring_slot_at(r->header, r->next);
+        r->sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+        if (r->sequence != 2*r->next + 2)
+        {   // Overwritten meanwhile.
+            r->lost++;
+            r->next++;
+            continue;
+        }
+
+        const uint32_t n = __atomic_load_n(&slot->length, __ATOMIC_RELAXED);
+        *length = n < sizeof(slot->record) ? n : sizeof(slot->record);
+        return slot->record;
+    }
+}
+
+/* Returns 1 and moves on if the record from telegram_ring_peek() was not overwritten while it was read, else 0. */
+static int telegram_ring_done(struct telegram_ring_reader *r)
+{
+    const struct telegram_ring_slot *slot = telegram_ring_slot_at(r->header, r->next);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != r->sequence) return 0; // telegram_ring_peek() counts it lost
+
+    r->next++;
+    return 1;
+}
+
+/** @brief Copy the next record to dst (size >= TELEGRAM_RING_RECORD_SIZE).
+ *  @return the length of the record, 0 if there is no new one.
+ */
+static size_t telegram_ring_read(struct telegram_ring_reader *r, void *dst, size_t size)
+{
+    const uint8_t *record;
+    size_t length;
+
+    while ((record = telegram_ring_peek(r, &length)) != NULL)
+    {
+        if (length > size) length = size;
+        memcpy(dst, record, length);
+        if (telegram_ring_done(r)) return length;
+    }
+
+    return 0;
+}
+
+static void telegram_ring_reader_close(struct telegram_ring_reader *r)
+{
+    munmap((void *)(uintptr_t)r->header, r->size);
+    close(r->fd);
+}
+
+#endif /* TELEGRAM_RING_H */
@@ -0,0 +1,339 @@
+#ifndef TELEGRAM_SOCKET_H
+#define TELEGRAM_SOCKET_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Socket sinks. Every line or binary record written to stdout is also sent
+ * as one datagram to each destination given with -U: a UDP unicast or
+ * multicast address ("udp:239.0.0.1:5000", "udp:[ff02::1]:5000") or a Unix
+ * datagram socket ("unix:/run/wmbus.sock"). Several consumers on the host
+ * can then subscribe to a multicast group or to sockets of their own.
+ *
+ * Datagrams are collected for a short window of their own (independent of
+ * the flush policy of stdout) and sent with one sendmmsg() call per
+ * destination. The sockets are non blocking: what a destination does not
+ * take at once (a full socket buffer, no receiver bound to a Unix socket) is
+ * dropped and counted. Multicast datagrams are looped back to the host and
+ * do not leave the local network (TTL 1).
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "telegram.h"
+
+#define TELEGRAM_SOCKET_DESTINATIONS_MAX 8u
+#define TELEGRAM_SOCKET_BATCH 64u
+#define TELEGRAM_SOCKET_BUFFER_SIZE 65536u
+#define TELEGRAM_SOCKET_WINDOW_MS 20u    // datagrams collected before they are sent
+#define TELEGRAM_SOCKET_MULTICAST_TTL 1
+
+#if !defined(__linux__) && !defined(__FreeBSD__)
+struct mmsghdr
+{
+    struct msghdr msg_hdr;
+    unsigned msg_len;
+};
+
+static int sendmmsg(int fd, struct mmsghdr *messages, unsigned n, int flags)
+{
+    unsigned k;
+
+    for (k = 0; k < n; k++)
+    {
+        const ssize_t sent = sendmsg(fd, &messages[k].msg_hdr, flags);
+        if (sent < 0) return k ? (int)k : -1;
+        messages[k].msg_len = (unsigned)sent;
+    }
+
+    return (int)k;
+}
+#endif
+
+struct telegram_socket_destination
+{
+    char name[128];  // as given with -U
+    int fd;
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    uint64_t sent;
+    uint64_t dropped;
+    int error;       // the last error, reported once
+};
+
+struct telegram_socket
+{
+    unsigned destinations;
+    struct telegram_socket_destination destination[TELEGRAM_SOCKET_DESTINATIONS_MAX];
+    unsigned window_ms;    // send once the oldest datagram collected is that old
+    unsigned count;        // datagrams collected
+    size_t used;
+    uint64_t oldest_ms;    // time the oldest datagram was collected
+    pthread_mutex_t lock;  // datagrams may come from the burst worker
+    struct iovec iov[TELEGRAM_SOCKET_BATCH];
+    char buffer[TELEGRAM_SOCKET_BUFFER_SIZE];
+};
+
+static struct telegram_socket telegram_socket = { .window_ms = TELEGRAM_SOCKET_WINDOW_MS, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Returns -1 if the address is malformed, -2 if it cannot be resolved (reported). */
+static int telegram_socket_address_udp(struct telegram_socket_destination *d, const char *address)
+{
+    char host[128];
+    const char *colon = strrchr(address, ':');
+    size_t host_length = colon ? (size_t)(colon - address) : 0;
+
+    if (host_length >= 2 && address[0] == '[' && address[host_length - 1] == ']')
+    {
+        address++;
+        host_length -= 2;
+    }
+    if (host_length == 0 || host_length >= sizeof(host) || colon[1] == '\0') return -1;
+
+    memcpy(host, address, host_length);
+    host[host_length] = '\0';
+
+    struct addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    const int error = getaddrinfo(host, &colon[1], &hints, &found);
+    if (error != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot resolve \"%s\": %s\n", d->name, gai_strerror(error));
+        return -2;
+    }
+
+    memcpy(&d->address, found->ai_addr, found->ai_addrlen);
+    d->address_length = found->ai_addrlen;
+    freeaddrinfo(found);
+    return 0;
+}
+
+static int telegram_socket_address_unix(struct telegram_socket_destination *d, const char *path)
+{
+    struct sockaddr_un *address = (struct sockaddr_un *)&d->address;
+
+    if (path[0] == '\0' || strlen(path) >= sizeof(address->sun_path)) return -1;
+
+    address->sun_family = AF_UNIX;
+    strcpy(address->sun_path, path);
+    d->address_length = (socklen_t)sizeof(*address);
+    return 0;
+}
+
+/* Sets the TTL (hops) and the loopback of a multicast destination. */
+static int telegram_socket_multicast(const struct telegram_socket_destination *d)
+{
+    const int ttl = TELEGRAM_SOCKET_MULTICAST_TTL, loop = 1;
+
+    if (d->address.ss_family == AF_INET)
+    {
+        const struct sockaddr_in *a = (const struct sockaddr_in *)&d->address;
+        if (!IN_MULTICAST(ntohl(a->sin_addr.s_addr))) return 0;
+
+        const unsigned char ttl8 = (unsigned char)ttl, loop8 = (unsigned char)loop;
+        if (setsockopt(d->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl8, sizeof(ttl8)) != 0) return -1;
+        return setsockopt(d->fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop8, sizeof(loop8));
+    }
+
+    if (d->address.ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *a = (const struct sockaddr_in6 *)&d->address;
+        if (!IN6_IS_ADDR_MULTICAST(&a->sin6_addr)) return 0;
+
+        if (setsockopt(d->fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl)) != 0) return -1;
+        return setsockopt(d->fd, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &loop, sizeof(loop));
+    }
+
+    return 0;
+}
+
+/** @brief Add a destination like "udp:host:port" or "unix:path".
+ *  @return 0 on success, -1 on error (reported).
+ */
+static int telegram_socket_add(struct telegram_socket *s, const char *spec)
+{
+    if (s->destinations == TELEGRAM_SOCKET_DESTINATIONS_MAX)
+    {
+        fprintf(stderr, "rtl_wmbus: at most %u destinations may be given with -U\n", TELEGRAM_SOCKET_DESTINATIONS_MAX);
+        return -1;
+    }
+
+    struct telegram_socket_destination *d = &s->destination[s->destinations];
+    int error;
+
+    memset(d, 0, sizeof(*d));
+    snprintf(d->name, sizeof(d->name), "%s", spec);
+
+    if (strncmp(spec, "udp:", 4) == 0) error = telegram_socket_address_udp(d, &spec[4]);
+    else if (strncmp(spec, "unix:", 5) == 0) error = telegram_socket_address_unix(d, &spec[5]);
+    else error = -1;
+
+    if (error == -1) fprintf(stderr, "rtl_wmbus: -U expects udp:host:port or unix:path, not \"%s\"\n", spec);
+    if (error) return -1;
+
+    d->fd = socket(d->address.ss_family, SOCK_DGRAM, 0);
+    if (d->fd < 0 || fcntl(d->fd, F_SETFL, fcntl(d->fd, F_GETFL) | O_NONBLOCK) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot open a socket for \"%s\": %s\n", spec, strerror(errno));
+        if (d->fd >= 0) close(d->fd);
+        return -1;
+    }
+
+    if (telegram_socket_multicast(d) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot set up multicast for \"%s\": %s\n", spec, strerror(errno));
+        close(d->fd);
+        return -1;
+    }
+
+    s->destinations++;
+    return 0;
+}
+
+static void telegram_socket_send_locked(struct telegram_socket *s)
+{
+    struct mmsghdr messages[TELEGRAM_SOCKET_BATCH];
+
+    for (unsigned k = 0; k < s->destinations; k++)
+    {
+        struct telegram_socket_destination *d = &s->destination[k];
+
+        memset(messages, 0, s->count * sizeof(messages[0]));
+        for (unsigned m = 0; m < s->count; m++)
+        {
+            messages[m].msg_hdr.msg_name = &d->address;
+            messages[m].msg_hdr.msg_namelen = d->address_length;
+            messages[m].msg_hdr.msg_iov = &s->iov[m];
+            messages[m].msg_hdr.msg_iovlen = 1;
+        }
+
+        for (unsigned m = 0; m < s->count; )
+        {
+            const int sent = sendmmsg(d->fd, &messages[m], s->count - m, 0);
+
+            if (sent > 0)
+            {
+                m += (unsigned)sent;
+                d->sent += (unsigned)sent;
+                d->error = 0;
+                continue;
+            }
+            if (sent < 0 && errno == EINTR) continue;
+
+            if (sent == 0 || errno == EAGAIN || errno == EWOULDBLOCK)
+            {   // The socket buffer is full; the rest would not fit either.
+                d->dropped += s->count - m;
+                break;
+            }
+
+            if (errno != d->error)
+            {
+                fprintf(stderr, "rtl_wmbus: cannot send to %s: %s; datagrams are dropped\n", d->name, strerror(errno));
+                d->error = errno;
+            }
+            d->dropped++; // e.g. a transient ECONNREFUSED: skip this one only
+            m++;
+        }
+    }
+
+    s->count = 0;
+    s->used = 0;
+}
+
+/* Installed as telegram_send. */
+static void telegram_socket_output(const char *data, size_t n)
+{
+    struct telegram_socket *s = &telegram_socket;
+
+    pthread_mutex_lock(&s->lock);
+
+    if (s->count == TELEGRAM_SOCKET_BATCH || s->used + n > sizeof(s->buffer)) telegram_socket_send_locked(s);
+    if (n > sizeof(s->buffer)) n = sizeof(s->buffer);
+    if (s->count == 0) s->oldest_ms = telegram_writer_now_ms();
+
+    memcpy(&s->buffer[s->used], data, n);
+    s->iov[s->count].iov_base = &s->buffer[s->used];
+    s->iov[s->count].iov_len = n;
+    s->used += n;
+    s->count++;
+
+    if (s->count == TELEGRAM_SOCKET_BATCH || telegram_writer_now_ms() - s->oldest_ms >= s->window_ms) telegram_socket_send_locked(s);
+
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Installed as telegram_send_tick: sends datagrams which waited for the window. */
+static void telegram_socket_tick(void)
+{
+    struct telegram_socket *s = &telegram_socket;
+
+    if (__atomic_load_n(&s->count, __ATOMIC_RELAXED) == 0) return;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->count && telegram_writer_now_ms() - s->oldest_ms >= s->window_ms) telegram_socket_send_locked(s);
+    pthread_mutex_unlock(&s->lock);
+}
+
+static void telegram_socket_print_statistics(struct telegram_socket *s, FILE *stream)
+{
+    pthread_mutex_lock(&s->lock);
+    for (unsigned k = 0; k < s->destinations; k++)
+    {
+        fprintf(stream, "rtl_wmbus: %s: %llu sent, %llu dropped\n", s->destination[k].name,
+                (unsigned long long)s->destination[k].sent, (unsigned long long)s->destination[k].dropped);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Sends the datagrams still collected and closes the sockets. */
+static void telegram_socket_close(struct telegram_socket *s)
+{
+    pthread_mutex_lock(&s->lock);
+    if (s->count) telegram_socket_send_locked(s);
+    pthread_mutex_unlock(&s->lock);
+
+    telegram_socket_print_statistics(s, stderr);
+
+    for (unsigned k = 0; k < s->destinations; k++) close(s->destination[k].fd);
+    s->destinations = 0;
+}
+
+#endif /* TELEGRAM_SOCKET_H */
@@ -0,0 +1,467 @@
+#ifndef TELEGRAM_STORE_H
+#define TELEGRAM_STORE_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Append-only store of the emitted datagrams. Datagrams are appended as
+ * fixed size records to segment files named after the time of their first
+ * record. A full segment is sealed by writing its index: the entries of all
+ * records sorted by ident number and time. A query binary searches the
+ * index of every segment overlapping the time range, so only a few pages
+ * of the index and the matching records are read.
+ *
+ * Each record carries a checksum. A segment left without index by a crash
+ * is cut behind its last complete record and sealed the next time the
+ * store is opened. The index is written to a temporary file first and
+ * renamed, so a segment either has a complete index or none; a query scans
+ * a segment without index (the one being written) from start to end.
+ *
+ * Records are stored in host byte order.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dsp_kernels.h"
+#include "telegram.h"
+
+#define TELEGRAM_STORE_SEGMENT_RECORDS 65536u
+#define TELEGRAM_STORE_DATA_LENGTH 256u
+#define TELEGRAM_STORE_INDEX_MAGIC 0x58444957u // "WIDX"
+
+struct telegram_store_record
+{
+    int64_t wall_us;       // timestamp of the datagram, microseconds since the epoch
+    uint64_t sample;       // sample time of the input
+    uint32_t ident;        // LINK_LAYER_IDENT_NO as printed
+    uint16_t manufacturer;
+    uint16_t length;
+    char mode[2];
+    uint8_t crc_ok;
+    uint8_t ok_3outof6;
+    uint16_t packet_rssi;
+    uint16_t current_rssi;
+    uint16_t check;        // inverted CRC of the fields above and the data
+    uint8_t reserved[6];
+    uint8_t data[TELEGRAM_STORE_DATA_LENGTH];
+};
+
+_Static_assert(sizeof(struct telegram_store_record) == 296, "record layout");
+
+struct telegram_store_index_entry
+{
+    uint32_t ident;
+    uint32_t record;
+    int64_t wall_us;
+};
+
+struct telegram_store_index_header
+{
+    uint32_t magic;
+    uint32_t count;
+    int64_t first_us;
+    int64_t last_us;
+    uint64_t reserved;
+};
+
+struct telegram_store
+{
+    const char *dir;
+    int fd;                // segment being written, -1 if none
+    char path[4096];
+    uint32_t records;
+    struct telegram_store_index_entry *index; // entries of the segment being written
+};
+
+static struct telegram_store telegram_store = { .fd = -1 };
+
+static uint16_t telegram_store_check(const struct telegram_store_record *r)
+{
+    return (uint16_t)~dsp_crc16(dsp_crc16(0, (const uint8_t *)r, offsetof(struct telegram_store_record, check)), r->data, r->length);
+}
+
+static int telegram_store_record_valid(const struct telegram_store_record *r)
+{
+    return r->length <= TELEGRAM_STORE_DATA_LENGTH && r->check == telegram_store_check(r);
+}
+
+static int telegram_store_index_compare(const void *a, const void *b)
+{
+    const struct telegram_store_index_entry *x = a, *y = b;
+
+    if (x->ident != y->ident) return x->ident < y->ident ? -1 : 1;
+    if (x->wall_us != y->wall_us) return x->wall_us < y->wall_us ? -1 : 1;
+    return x->record < y->record ? -1 : x->record > y->record;
+}
+
+static int telegram_store_sync_dir(const char *dir)
+{
+    const int fd = open(dir, O_RDONLY);
+    if (fd < 0) return -1;
+
+    const int result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+/** @brief Write the index of a segment: sorted entries into "<segment>.idx" via a temporary file. */
+static int telegram_store_write_index(const char *dir, const char *segment, struct telegram_store_index_entry *entries, uint32_t count)
+{
+    char path[4096], tmp[4096];
+    struct telegram_store_index_header header = { TELEGRAM_STORE_INDEX_MAGIC, count, INT64_MAX, INT64_MIN, 0 };
+
+    for (uint32_t k = 0; k < count; k++)
+    {
+        if (entries[k].wall_us < header.first_us) header.first_us = entries[k].wall_us;
+        if (entries[k].wall_us > header.last_us) header.last_us = entries[k].wall_us;
+    }
+    qsort(entries, count, sizeof(entries[0]), telegram_store_index_compare);
+
+    snprintf(path, sizeof(path), "%s.idx", segment);
+    snprintf(tmp, sizeof(tmp), "%s.idx.tmp", segment);
+
+    FILE *file = fopen(tmp, "wb");
+    if (file == NULL ||
+        fwrite(&header, sizeof(header), 1, file) != 1 ||
+        (count && fwrite(entries, sizeof(entries[0]), count, file) != count) ||
+        fflush(file) != 0 || fsync(fileno(file)) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot write index \"%s\": %s\n", tmp, strerror(errno));
+        if (file) fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    if (rename(tmp, path) != 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot rename index \"%s\": %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    return telegram_store_sync_dir(dir);
+}
+
+/* Cuts a segment behind its last valid record and writes its index. */
+static int telegram_store_seal(const char *dir, const char *segment)
+{
+    FILE *file = fopen(segment, "r+b");
+    struct telegram_store_record r;
+    struct telegram_store_index_entry *entries = NULL;
+    uint32_t count = 0, capacity = 0;
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot open segment \"%s\": %s\n", segment, strerror(errno));
+        return -1;
+    }
+
+    while (fread(&r, sizeof(r), 1, file) == 1 && telegram_store_record_valid(&r))
+    {
+        if (count == capacity)
+        {
+            capacity = capacity ? 2*capacity : 1024;
+            struct telegram_store_index_entry *grown = realloc(entries, capacity * sizeof(entries[0]));
+            if (grown == NULL)
+            {
+                fprintf(stderr, "rtl_wmbus: out of memory sealing \"%s\"!\n", segment);
+                free(entries);
+                fclose(file);
+                return -1;
+            }
+            entries = grown;
+        }
+        entries[count] = (struct telegram_store_index_entry){ r.ident, count, r.wall_us };
+        count++;
+    }
+
+    const int result = ftruncate(fileno(file), (off_t)count * sizeof(r)) == 0 && fsync(fileno(file)) == 0 ? 0 : -1;
+    fclose(file);
+
+    if (result == 0) fprintf(stderr, "rtl_wmbus: sealed \"%s\" with %u records\n", segment, count);
+
+    const int written = result == 0 ? telegram_store_write_index(dir, segment, entries, count) : -1;
+    free(entries);
+    return written;
+}
+
+static int telegram_store_is_segment(const struct dirent *entry)
+{
+    const size_t length = strlen(entry->d_name);
+    return length > 4 && strcmp(&entry->d_name[length - 4], ".seg") == 0;
+}
+
+/** @brief Open a store, creating its directory if needed and sealing segments left by a crash.
+ *  @return 0 on success, -1 otherwise.
+ */
+static int telegram_store_open(struct telegram_store *store, const char *dir)
+{
+    struct dirent **segments;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot create store \"%s\": %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    const int count = scandir(dir, &segments, telegram_store_is_segment, alphasort);
+    if (count < 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot read store \"%s\": %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    int result = 0;
+    for (int k = 0; k < count; k++)
+    {
+        char segment[4096], index[sizeof(segment) + 8];
+        struct stat st;
+
+        snprintf(segment, sizeof(segment), "%s/%s", dir, segments[k]->d_name);
+        snprintf(index, sizeof(index), "%s.idx", segment);
+        if (result == 0 && stat(index, &st) != 0) result = telegram_store_seal(dir, segment);
+        free(segments[k]);
+    }
+    free(segments);
+
+    store->dir = dir;
+    store->fd = -1;
+    store->records = 0;
+    store->index = calloc(TELEGRAM_STORE_SEGMENT_RECORDS, sizeof(store->index[0]));
+
+    if (store->index == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: out of memory opening store \"%s\"!\n", dir);
+        return -1;
+    }
+    return result;
+}
+
+/* Seals the segment being written. */
+static void telegram_store_rotate(struct telegram_store *store)
+{
+    if (store->fd < 0) return;
+
+    if (fsync(store->fd) != 0) fprintf(stderr, "rtl_wmbus: cannot sync \"%s\": %s\n", store->path, strerror(errno));
+    close(store->fd);
+    store->fd = -1;
+
+    telegram_store_write_index(store->dir, store->path, store->index, store->records);
+    store->records = 0;
+}
+
+static void telegram_store_append(struct telegram_store *store, const struct telegram *t)
+{
+    struct telegram_store_record r;
+
+    memset(&r, 0, sizeof(r));
+    r.wall_us = t->time_ns / 1000;
+    r.sample = telegram_sample(t);
+    r.ident = t->serial;
+    r.manufacturer = t->length >= 4 ? (uint16_t)(t->data[2] | (t->data[3] << 8)) : 0;
+    r.length = (uint16_t)(t->length < TELEGRAM_STORE_DATA_LENGTH ? t->length : TELEGRAM_STORE_DATA_LENGTH);
+    memcpy(r.mode, t->mode, 2);
+    r.crc_ok = (uint8_t)t->crc_ok;
+    r.ok_3outof6 = (uint8_t)t->ok_3outof6;
+    r.packet_rssi = (uint16_t)t->packet_rssi;
+    r.current_rssi = (uint16_t)t->current_rssi;
+    memcpy(r.data, t->data, r.length);
+    r.check = telegram_store_check(&r);
+
+    for (int64_t name = r.wall_us; store->fd < 0; name++)
+    {   // Named after the first record; never appends to an existing segment.
+        snprintf(store->path, sizeof(store->path), "%s/%016llx.seg", store->dir, (unsigned long long)name);
+        store->fd = open(store->path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+        if (store->fd < 0 && errno == EEXIST) continue;
+        if (store->fd < 0)
+        {
+            fprintf(stderr, "rtl_wmbus: cannot create segment \"%s\": %s\n", store->path, strerror(errno));
+            return;
+        }
+        telegram_store_sync_dir(store->dir);
+    }
+
+    if (write(store->fd, &r, sizeof(r)) != (ssize_t)sizeof(r))
+    {
+        fprintf(stderr, "rtl_wmbus: cannot append to \"%s\": %s\n", store->path, strerror(errno));
+        return;
+    }
+
+    store->index[store->records] = (struct telegram_store_index_entry){ r.ident, store->records, r.wall_us };
+    if (++store->records == TELEGRAM_STORE_SEGMENT_RECORDS) telegram_store_rotate(store);
+}
+
+/* Added to the telegram tees. */
+static void telegram_store_output(const struct telegram *t)
+{
+    telegram_store_append(&telegram_store, t);
+}
+
+static void telegram_store_close(struct telegram_store *store)
+{
+    telegram_store_rotate(store);
+    free(store->index);
+    store->index = NULL;
+}
+
+
+/* Prints a stored record as a received datagram. */
+static void telegram_store_print(const struct telegram_store_record *r)
+{
+    char mode[3] = { r->mode[0], r->mode[1], '\0' };
+
+    const struct telegram t =
+    {
+        .algorithm = "",
+        .mode = mode,
+        .crc_ok = r->crc_ok,
+        .ok_3outof6 = r->ok_3outof6,
+        .time_ns = r->wall_us * 1000,
+        .packet_rssi = r->packet_rssi,
+        .current_rssi = r->current_rssi,
+        .serial = r->ident,
+        .data = r->data,
+        .length = r->length,
+    };
+    telegram_print(&t);
+}
+
+static int telegram_store_wanted(const struct telegram_store_record *r, uint32_t ident, int64_t from_us, int64_t to_us)
+{
+    return telegram_store_record_valid(r) && r->ident == ident && r->wall_us >= from_us && r->wall_us <= to_us;
+}
+
+/* Looks the records up in the index of a sealed segment. */
+static size_t telegram_store_query_indexed(int segment, int index, uint32_t ident, int64_t from_us, int64_t to_us)
+{
+    struct stat st;
+    size_t found = 0;
+
+    if (fstat(index, &st) != 0 || (size_t)st.st_size < sizeof(struct telegram_store_index_header)) return 0;
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, index, 0);
+    if (map == MAP_FAILED) return 0;
+
+    const struct telegram_store_index_header *header = map;
+    const struct telegram_store_index_entry *entries = (const void *)(header + 1);
+    const size_t count = ((size_t)st.st_size - sizeof(*header)) / sizeof(entries[0]);
+
+    if (header->magic == TELEGRAM_STORE_INDEX_MAGIC && header->count == count && header->last_us >= from_us && header->first_us <= to_us)
+    {
+        size_t lo = 0, hi = count;
+        while (lo < hi)
+        {   // first entry not less than (ident, from_us)
+            const size_t mid = lo + (hi - lo)/2;
+            if (entries[mid].ident < ident || (entries[mid].ident == ident && entries[mid].wall_us < from_us)) lo = mid + 1;
+            else hi = mid;
+        }
+
+        for (; lo < count && entries[lo].ident == ident && entries[lo].wall_us <= to_us; lo++)
+        {
+            struct telegram_store_record r;
+            if (pread(segment, &r, sizeof(r), (off_t)entries[lo].record * sizeof(r)) != (ssize_t)sizeof(r)) break;
+            if (!telegram_store_wanted(&r, ident, from_us, to_us)) continue;
+
+            telegram_store_print(&r);
+            found++;
+        }
+    }
+
+    munmap(map, (size_t)st.st_size);
+    return found;
+}
+
+/* Scans a segment without index from start to end. */
+static size_t telegram_store_query_scan(int segment, uint32_t ident, int64_t from_us, int64_t to_us)
+{
+    struct telegram_store_record r;
+    size_t found = 0;
+
+    for (off_t offset = 0; pread(segment, &r, sizeof(r), offset) == (ssize_t)sizeof(r); offset += sizeof(r))
+    {
+        if (!telegram_store_wanted(&r, ident, from_us, to_us)) continue;
+
+        telegram_store_print(&r);
+        found++;
+    }
+    return found;
+}
+
+/** @brief Print all datagrams of a meter stored in dir within [from_us, to_us], oldest segment first.
+ *  @return the number of datagrams found, -1 if the store cannot be read.
+ */
+static long telegram_store_query(const char *dir, uint32_t ident, int64_t from_us, int64_t to_us)
+{
+    struct dirent **segments;
+    long found = 0;
+
+    const int count = scandir(dir, &segments, telegram_store_is_segment, alphasort);
+    if (count < 0)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot read store \"%s\": %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    for (int k = 0; k < count; k++)
+    {
+        char path[4096], index_path[sizeof(path) + 8];
+
+        snprintf(path, sizeof(path), "%s/%s", dir, segments[k]->d_name);
+        snprintf(index_path, sizeof(index_path), "%s.idx", path);
+        const int64_t first_us = (int64_t)strtoull(segments[k]->d_name, NULL, 16);
+        free(segments[k]);
+
+        if (first_us > to_us) continue; // and so are all later segments
+
+        const int segment = open(path, O_RDONLY);
+        if (segment < 0) continue;
+
+        const int index = open(index_path, O_RDONLY);
+        if (index >= 0)
+        {
+            found += (long)telegram_store_query_indexed(segment, index, ident, from_us, to_us);
+            close(index);
+        }
+        else
+        {
+            found += (long)telegram_store_query_scan(segment, ident, from_us, to_us);
+        }
+        close(segment);
+    }
+    free(segments);
+
+    return found;
+}
+
+#endif /* TELEGRAM_STORE_H */
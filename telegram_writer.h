@@ -0,0 +1,259 @@
+#ifndef TELEGRAM_WRITER_H
+#define TELEGRAM_WRITER_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Output of the printed datagrams. A line is rendered into a buffer without
+ * stdio (hex pairs are looked up in a table) and handed to the writer, which
+ * collects lines and writes them to stdout with a single write() according
+ * to its flush policy: after every line (the default), after N lines and/or
+ * once the oldest line waits for N ms. The main loop calls
+ * telegram_tick() so lines get out on a quiet channel as well.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TELEGRAM_LINE_SIZE 8192u
+#define TELEGRAM_WRITER_SIZE 65536u
+
+static const char TELEGRAM_HEX_PAIRS[512 + 1] =
+    "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+struct telegram_line
+{
+    size_t length;
+    char data[TELEGRAM_LINE_SIZE]; // truncated if full
+};
+
+static inline void telegram_line_append(struct telegram_line *line, const char *s, size_t n)
+{
+    if (n > TELEGRAM_LINE_SIZE - line->length) n = TELEGRAM_LINE_SIZE - line->length;
+    memcpy(&line->data[line->length], s, n);
+    line->length += n;
+}
+
+static inline void telegram_line_puts(struct telegram_line *line, const char *s)
+{
+    telegram_line_append(line, s, strlen(s));
+}
+
+static inline void telegram_line_putc(struct telegram_line *line, char c)
+{
+    if (line->length < TELEGRAM_LINE_SIZE) line->data[line->length++] = c;
+}
+
+__attribute__((format(printf, 2, 3)))
+static void telegram_line_printf(struct telegram_line *line, const char *format, ...)
+{
+    const size_t space = TELEGRAM_LINE_SIZE - line->length;
+    va_list args;
+
+    va_start(args, format);
+    const int n = space ? vsnprintf(&line->data[line->length], space, format, args) : 0;
+    va_end(args);
+
+    if (n > 0) line->length += (size_t)n < space ? (size_t)n : space - 1;
+}
+
+/* Lower case hex pairs of data. */
+static void telegram_line_hex(struct telegram_line *line, const uint8_t *data, size_t n)
+{
+    if (2*n > TELEGRAM_LINE_SIZE - line->length) n = (TELEGRAM_LINE_SIZE - line->length) / 2;
+
+    char *dst = &line->data[line->length];
+    for (size_t k = 0; k < n; k++, dst += 2) memcpy(dst, &TELEGRAM_HEX_PAIRS[2*data[k]], 2);
+    line->length += 2*n;
+}
+
+/* Upper case hex of value with 8 digits, as %08X. */
+static void telegram_line_hex32(struct telegram_line *line, uint32_t value)
+{
+    static const char DIGITS[] = "0123456789ABCDEF";
+    char hex[8];
+
+    for (unsigned k = 8; k > 0; k--, value >>= 4) hex[k - 1] = DIGITS[value & 0x0Fu];
+    telegram_line_append(line, hex, sizeof(hex));
+}
+
+static void telegram_line_uint(struct telegram_line *line, unsigned long long value)
+{
+    char digits[20];
+    unsigned n = sizeof(digits);
+
+    do
+    {
+        digits[--n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    telegram_line_append(line, &digits[n], sizeof(digits) - n);
+}
+
+
+struct telegram_writer
+{
+    int fd;
+    unsigned flush_lines;  // flush after that many lines, 0 for no limit
+    unsigned flush_ms;     // flush once the oldest line is that old, 0 for no limit
+    unsigned lines;
+    uint64_t oldest_ms;    // time the oldest buffered line was written
+    size_t used;
+    pthread_mutex_t lock;  // lines may come from the burst worker
+    char buffer[TELEGRAM_WRITER_SIZE];
+};
+
+static struct telegram_writer telegram_writer = { .fd = 1, .flush_lines = 1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t telegram_writer_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u;
+}
+
+static void telegram_writer_write_all(int fd, const char *data, size_t n)
+{
+    while (n > 0)
+    {
+        const ssize_t written = write(fd, data, n);
+
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return; // e.g. the reader went away; nothing better to do
+
+        data += written;
+        n -= (size_t)written;
+    }
+}
+
+static void telegram_writer_flush_locked(struct telegram_writer *w)
+{
+    telegram_writer_write_all(w->fd, w->buffer, w->used);
+    w->used = 0;
+    w->lines = 0;
+}
+
+/** @brief Append one line or record; it is written at once if the flush policy says so. */
+static void telegram_writer_write(struct telegram_writer *w, const void *data, size_t n)
+{
+    pthread_mutex_lock(&w->lock);
+
+    if (w->used + n > sizeof(w->buffer)) telegram_writer_flush_locked(w);
+
+    if (n > sizeof(w->buffer))
+    {
+        telegram_writer_write_all(w->fd, data, n);
+    }
+    else
+    {
+        if (w->used == 0 && w->flush_ms) w->oldest_ms = telegram_writer_now_ms();
+
+        memcpy(&w->buffer[w->used], data, n);
+        w->used += n;
+        w->lines++;
+
+        if ((w->flush_lines && w->lines >= w->flush_lines) ||
+            (w->flush_ms && telegram_writer_now_ms() - w->oldest_ms >= w->flush_ms)) telegram_writer_flush_locked(w);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Called regularly: writes lines which waited for flush_ms. */
+static void telegram_writer_tick(struct telegram_writer *w)
+{
+    if (!w->flush_ms || __atomic_load_n(&w->used, __ATOMIC_RELAXED) == 0) return;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->used && telegram_writer_now_ms() - w->oldest_ms >= w->flush_ms) telegram_writer_flush_locked(w);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void telegram_writer_flush(struct telegram_writer *w)
+{
+    pthread_mutex_lock(&w->lock);
+    telegram_writer_flush_locked(w);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void telegram_writer_flush_at_exit(void)
+{
+    telegram_writer_flush(&telegram_writer);
+}
+
+/** @brief Parse a flush policy like "10", "100ms" or "10,100ms".
+ *  @return 0 on success, -1 if the policy is malformed.
+ */
+static int telegram_writer_parse_policy(struct telegram_writer *w, const char *policy)
+{
+    unsigned lines = 0, ms = 0;
+
+    for (const char *p = policy; *p; )
+    {
+        char *end;
+        const unsigned long value = strtoul(p, &end, 10);
+
+        if (end == p || value == 0) return -1;
+
+        if (strncmp(end, "ms", 2) == 0)
+        {
+            ms = (unsigned)value;
+            end += 2;
+        }
+        else
+        {
+            lines = (unsigned)value;
+        }
+
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+
+    if (lines == 0 && ms == 0) return -1;
+
+    w->flush_lines = lines;
+    w->flush_ms = ms;
+    return 0;
+}
+
+#endif /* TELEGRAM_WRITER_H */
@@ -0,0 +1,402 @@
+#ifndef WMBUS_FRAME_H
+#define WMBUS_FRAME_H
+
+/*-
+ * Copyright (c) 2024 <xael.south@yandex.com>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Parsing of the data link layer (DLL), the extended link layer (ELL) and
+ * the transport layer (TPL) headers of a datagram, and decryption of
+ * security mode 5 (AES-128-CBC) payloads with the keys of a key file.
+ *
+ * A key file holds one meter per line as a meter list (see meter_filter.h)
+ * followed by the key in 32 hex digits:
+ *
+ *   KAM 12345678 000102030405060708090A0B0C0D0E0F
+ *
+ * The parsed fields are appended to the printed datagram:
+ *
+ *   ...;C;MANUFACTURER;IDENT;VERSION;DEVICE_TYPE;CI;ACCESS_NO;STATUS;SECURITY_MODE;DECRYPTION;APPLICATION_DATA
+ *
+ * The address fields are the ones of the meter, i.e. of the long TPL header
+ * if there is one. ACCESS_NO, STATUS and SECURITY_MODE are empty if there is
+ * no TPL header. DECRYPTION is one of
+ *
+ *   plain        the payload is not encrypted
+ *   decrypted    decrypted and verified by the 0x2F2F in front
+ *   nokey        encrypted, but there is no key for the meter
+ *   badkey       decrypted, but the 0x2F2F is missing
+ *   unsupported  encrypted in a mode other than 5, or the CI field is unknown
+ *   truncated    the datagram is shorter than its headers say
+ *
+ * APPLICATION_DATA follows the TPL header, decrypted if possible. If data
+ * records are selected, they follow as a last field, see mbus_records.h.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "aes128.h"
+#include "dsp_kernels.h"
+#include "mbus_records.h"
+#include "meter_filter.h"
+#include "telegram.h"
+
+#define WMBUS_DLL_LENGTH 10u // L, C, M, A (ident, version, device type)
+#define WMBUS_CI_NONE 0x100u  // no CI field received
+
+enum wmbus_tpl_header
+{
+    WMBUS_TPL_NONE,
+    WMBUS_TPL_SHORT,
+    WMBUS_TPL_LONG,
+};
+
+enum wmbus_decryption
+{
+    WMBUS_PLAIN,
+    WMBUS_DECRYPTED,
+    WMBUS_NO_KEY,
+    WMBUS_BAD_KEY,
+    WMBUS_UNSUPPORTED,
+    WMBUS_TRUNCATED,
+};
+
+static const char *const WMBUS_DECRYPTION_NAMES[] = { "plain", "decrypted", "nokey", "badkey", "unsupported", "truncated" };
+
+struct wmbus_frame
+{
+    uint8_t c;
+    uint16_t manufacturer;
+    uint32_t ident;
+    uint8_t version;
+    uint8_t device_type;
+    unsigned ci;                 // CI field of the TPL, WMBUS_CI_NONE if missing
+    enum wmbus_tpl_header tpl;
+    uint8_t access_no;
+    uint8_t status;
+    uint16_t config;
+    unsigned security_mode;
+    enum wmbus_decryption decryption;
+    const uint8_t *payload;      // application data, points into the datagram or into plain
+    size_t payload_length;
+    uint8_t plain[256];          // decrypted application data
+};
+
+struct wmbus_key_entry
+{
+    uint64_t key; // meter_key(), 0 for an empty slot
+    struct aes128_key aes;
+};
+
+struct wmbus_keys
+{
+    struct wmbus_key_entry *entries;
+    size_t mask;  // number of slots - 1
+    size_t count;
+};
+
+static struct wmbus_keys wmbus_keys;
+
+/* Data records to print, none if the count is 0. */
+static struct mbus_record_filter wmbus_frame_records;
+
+static struct wmbus_key_entry *wmbus_keys_slot(const struct wmbus_keys *keys, uint64_t key)
+{
+    size_t k = meter_set_slot(&(struct meter_set){ .mask = keys->mask }, key);
+
+    while (keys->entries[k].key != 0 && keys->entries[k].key != key) k = (k + 1) & keys->mask;
+
+    return &keys->entries[k];
+}
+
+static const struct aes128_key *wmbus_keys_find(const struct wmbus_keys *keys, uint16_t manufacturer, uint32_t ident)
+{
+    if (keys->count == 0) return NULL;
+
+    const struct wmbus_key_entry *e = wmbus_keys_slot(keys, meter_key(manufacturer, ident));
+    if (e->key == 0) e = wmbus_keys_slot(keys, meter_key(METER_ANY_MANUFACTURER, ident));
+
+    return e->key != 0 ? &e->aes : NULL;
+}
+
+static int wmbus_parse_key(const char *s, uint8_t secret[AES128_BLOCK_SIZE])
+{
+    if (strlen(s) != 2*AES128_BLOCK_SIZE) return -1;
+
+    for (unsigned k = 0; k < AES128_BLOCK_SIZE; k++)
+    {
+        unsigned byte;
+        if (!isxdigit((unsigned char)s[2*k]) || !isxdigit((unsigned char)s[2*k + 1]) || sscanf(&s[2*k], "%2x", &byte) != 1) return -1;
+        secret[k] = (uint8_t)byte;
+    }
+    return 0;
+}
+
+/** @brief Load a key file; dsp_kernels_init() must have been called.
+ *  @return 0 on success, -1 if the file cannot be read or has a bad line.
+ */
+static int wmbus_keys_load(struct wmbus_keys *keys, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+    size_t lines = 0, capacity = 16;
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: cannot open key file \"%s\"!\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) lines++;
+    while (capacity < 2*lines) capacity *= 2;
+    rewind(file);
+
+    keys->entries = calloc(capacity, sizeof(keys->entries[0]));
+    keys->mask = capacity - 1;
+    keys->count = 0;
+
+    if (keys->entries == NULL)
+    {
+        fprintf(stderr, "rtl_wmbus: out of memory loading key file \"%s\"!\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    for (size_t number = 1; fgets(line, sizeof(line), file) != NULL; number++)
+    {
+        char first[40], second[40], third[40];
+        uint16_t manufacturer = METER_ANY_MANUFACTURER;
+        uint32_t ident;
+        uint8_t secret[AES128_BLOCK_SIZE];
+        const int fields = sscanf(line, "%39s %39s %39s", first, second, third);
+
+        if (fields <= 0 || first[0] == '#') continue;
+
+        if ((fields == 2 && meter_parse_ident(first, &ident) == 0 && wmbus_parse_key(second, secret) == 0) ||
+            (fields == 3 && meter_parse_manufacturer(first, &manufacturer) == 0 && meter_parse_ident(second, &ident) == 0 && wmbus_parse_key(third, secret) == 0))
+        {
+            struct wmbus_key_entry *e = wmbus_keys_slot(keys, meter_key(manufacturer, ident));
+
+            if (e->key == 0) keys->count++;
+            e->key = meter_key(manufacturer, ident);
+            aes128_key_expand(&e->aes, secret);
+            continue;
+        }
+
+        fprintf(stderr, "rtl_wmbus: bad key in \"%s\", line %zu\n", path, number);
+        fclose(file);
+        free(keys->entries);
+        keys->entries = NULL;
+        keys->count = 0;
+        return -1;
+    }
+
+    fclose(file);
+    fprintf(stderr, "rtl_wmbus: %zu meter keys loaded\n", keys->count);
+    return 0;
+}
+
+static inline uint32_t wmbus_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Length of the ELL behind CI field ci, 0 if ci is no ELL. */
+static size_t wmbus_ell_length(unsigned ci)
+{
+    switch (ci)
+    {
+    case 0x8C: return 2;  // CC, ACC
+    case 0x8D: return 8;  // CC, ACC, SN, payload CRC
+    case 0x8E: return 10; // CC, ACC, M, A
+    case 0x8F: return 16; // CC, ACC, M, A, SN, payload CRC
+    default: return 0;
+    }
+}
+
+static enum wmbus_tpl_header wmbus_tpl_header(unsigned ci)
+{
+    switch (ci)
+    {
+    case 0x5A: case 0x61: case 0x65: case 0x6E: case 0x74: case 0x7A: case 0x7B: case 0x7D: case 0x7F: case 0x8A:
+        return WMBUS_TPL_SHORT;
+    case 0x5B: case 0x60: case 0x64: case 0x6F: case 0x72: case 0x73: case 0x75: case 0x7C: case 0x7E: case 0x8B:
+        return WMBUS_TPL_LONG;
+    default:
+        return WMBUS_TPL_NONE;
+    }
+}
+
+/* Security mode 5: the IV is the address of the meter followed by 8 times the access number. */
+static void wmbus_frame_decrypt(struct wmbus_frame *f, const uint8_t *encrypted, size_t length)
+{
+    const size_t blocks = (f->config >> 4) & 0x0Fu;
+    const struct aes128_key *key = wmbus_keys_find(&wmbus_keys, f->manufacturer, f->ident);
+
+    if (blocks == 0 || blocks*AES128_BLOCK_SIZE > length)
+    {
+        f->decryption = WMBUS_TRUNCATED;
+        return;
+    }
+    if (key == NULL)
+    {
+        f->decryption = WMBUS_NO_KEY;
+        return;
+    }
+
+    uint8_t iv[AES128_BLOCK_SIZE] = { (uint8_t)f->manufacturer, (uint8_t)(f->manufacturer >> 8),
+                                      (uint8_t)f->ident, (uint8_t)(f->ident >> 8), (uint8_t)(f->ident >> 16), (uint8_t)(f->ident >> 24),
+                                      f->version, f->device_type };
+    memset(&iv[8], f->access_no, 8);
+
+    dsp_aes128_cbc_decrypt(key, iv, encrypted, f->plain, blocks);
+    memcpy(&f->plain[blocks*AES128_BLOCK_SIZE], &encrypted[blocks*AES128_BLOCK_SIZE], length - blocks*AES128_BLOCK_SIZE);
+
+    f->payload = f->plain;
+    f->decryption = (f->plain[0] == 0x2F && f->plain[1] == 0x2F) ? WMBUS_DECRYPTED : WMBUS_BAD_KEY;
+}
+
+/** @brief Parse the headers of a datagram as printed (without CRC bytes) and decrypt its payload.
+ *  @return 0 on success, -1 if the datagram is shorter than the DLL header.
+ */
+static int wmbus_frame_parse(struct wmbus_frame *f, const uint8_t *data, size_t length)
+{
+    if (length < WMBUS_DLL_LENGTH || length > sizeof(f->plain)) return -1;
+
+    f->c = data[1];
+    f->manufacturer = (uint16_t)(data[2] | (data[3] << 8));
+    f->ident = wmbus_le32(&data[4]);
+    f->version = data[8];
+    f->device_type = data[9];
+    f->ci = WMBUS_CI_NONE;
+    f->tpl = WMBUS_TPL_NONE;
+    f->security_mode = 0;
+    f->decryption = WMBUS_PLAIN;
+    f->payload = &data[length];
+    f->payload_length = 0;
+
+    size_t pos = WMBUS_DLL_LENGTH;
+
+    if (pos < length && wmbus_ell_length(data[pos]) != 0)
+    {
+        const size_t ell = wmbus_ell_length(data[pos]);
+
+        if (pos + 1 + ell > length)
+        {
+            f->decryption = WMBUS_TRUNCATED;
+            return 0;
+        }
+        if ((data[pos] == 0x8D || data[pos] == 0x8F) && (data[pos + ell - 2] >> 5) != 0)
+        {   // The rest is encrypted by the ELL (AES-CTR with a session key).
+            f->ci = data[pos];
+            f->payload = &data[pos + 1 + ell];
+            f->payload_length = length - (pos + 1 + ell);
+            f->decryption = WMBUS_UNSUPPORTED;
+            return 0;
+        }
+        pos += 1 + ell;
+    }
+
+    if (pos == length) return 0;
+
+    f->ci = data[pos++];
+    f->tpl = wmbus_tpl_header(f->ci);
+
+    const size_t header = f->tpl == WMBUS_TPL_LONG ? 12 : f->tpl == WMBUS_TPL_SHORT ? 4 : 0;
+
+    if (pos + header > length)
+    {
+        f->tpl = WMBUS_TPL_NONE;
+        f->decryption = WMBUS_TRUNCATED;
+        return 0;
+    }
+
+    if (f->tpl == WMBUS_TPL_LONG)
+    {
+        f->ident = wmbus_le32(&data[pos]);
+        f->manufacturer = (uint16_t)(data[pos + 4] | (data[pos + 5] << 8));
+        f->version = data[pos + 6];
+        f->device_type = data[pos + 7];
+        pos += 8;
+    }
+
+    f->payload = &data[f->tpl == WMBUS_TPL_NONE ? pos : pos + 4];
+    f->payload_length = length - (size_t)(f->payload - data);
+
+    if (f->tpl == WMBUS_TPL_NONE)
+    {
+        if (f->ci != 0x78) f->decryption = WMBUS_UNSUPPORTED;
+        return 0;
+    }
+
+    f->access_no = data[pos];
+    f->status = data[pos + 1];
+    f->config = (uint16_t)(data[pos + 2] | (data[pos + 3] << 8));
+    f->security_mode = (f->config >> 8) & 0x1Fu;
+
+    if (f->security_mode == 5) wmbus_frame_decrypt(f, f->payload, f->payload_length);
+    else if (f->security_mode != 0) f->decryption = WMBUS_UNSUPPORTED;
+
+    return 0;
+}
+
+/* Installed as telegram_fields. */
+static void wmbus_frame_print_fields(struct telegram_line *line, const struct telegram *t)
+{
+    struct wmbus_frame f;
+
+    if (wmbus_frame_parse(&f, t->data, t->length) != 0)
+    {
+        telegram_line_printf(line, ";;;;;;;;;;%s;%s", WMBUS_DECRYPTION_NAMES[WMBUS_TRUNCATED], wmbus_frame_records.count ? ";" : "");
+        return;
+    }
+
+    const unsigned m = f.manufacturer;
+    telegram_line_printf(line, ";%02X;%c%c%c;%08X;%02X;%02X;", f.c,
+            '@' + ((m >> 10) & 0x1F), '@' + ((m >> 5) & 0x1F), '@' + (m & 0x1F),
+            f.ident, f.version, f.device_type);
+
+    if (f.ci != WMBUS_CI_NONE) telegram_line_printf(line, "%02X", f.ci);
+
+    if (f.tpl != WMBUS_TPL_NONE) telegram_line_printf(line, ";%02X;%02X;%u;", f.access_no, f.status, f.security_mode);
+    else telegram_line_printf(line, ";;;;");
+
+    telegram_line_printf(line, "%s;0x", WMBUS_DECRYPTION_NAMES[f.decryption]);
+    telegram_line_hex(line, f.payload, f.payload_length);
+
+    if (wmbus_frame_records.count == 0) return;
+
+    telegram_line_putc(line, ';');
+    if ((f.ci == 0x72 || f.ci == 0x7A || f.ci == 0x78) && (f.decryption == WMBUS_PLAIN || f.decryption == WMBUS_DECRYPTED))
+    {
+        mbus_records_print(line, f.payload, f.payload_length, &wmbus_frame_records);
+    }
+}
+
+#endif /* WMBUS_FRAME_H */